@@ -32,7 +32,9 @@
 #include <sys/socket.h>
 #include <sys/utsname.h>
 
+#include <limits.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -54,6 +56,7 @@
 
 /* From the header file */
 int GSMainLoop;
+volatile sig_atomic_t GSReloadRequested;
 
 pthread_t GSCoreThread;
 pthread_t GSRedirThread;
@@ -78,9 +81,13 @@ static const char *GSParentNames[] = {
 /**
  * Child Scheduling
  */
-/* How many children, a.ka. threads may be made */
-static const size_t GSChildSize = 500;
+/* How many children, a.ka. threads may be made (OMWorkerThreadCount) */
+static size_t GSChildSize;
+static pthread_attr_t GSChildAttributes;
+/* GSDestroy is also called when GSInit failed before initializing them. */
+static bool GSChildAttributesInitialized = false;
 static struct GSThread *GSChildThreads;
+static size_t GSChildActive = 0;
 static pthread_mutex_t GSChildMutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* Prototyping */
@@ -118,6 +125,13 @@ GSDestroy(void) {
 	}
 
 	free(GSChildThreads);
+	GSChildThreads = NULL;
+	GSChildSize = 0;
+
+	if (GSChildAttributesInitialized) {
+		pthread_attr_destroy(&GSChildAttributes);
+		GSChildAttributesInitialized = false;
+	}
 
 	if (GSRedirSocket > -1) {
 		close(GSRedirSocket);
@@ -178,15 +192,32 @@ GSInit(void) {
 		return false;
 	}
 
-	GSChildThreads = calloc(GSChildSize, sizeof(struct GSThread));
+	GSChildThreads = calloc(OMWorkerThreadCount, sizeof(struct GSThread));
 	if (GSChildThreads == NULL) {
 		perror(ANSI_COLOR_RED"[GSInit] Failed to allocate"ANSI_COLOR_RESETLN);
 		return false;
 	}
+	GSChildSize = OMWorkerThreadCount;
 
 	for (i = 0; i < GSChildSize; i++)
 		GSChildThreads[i].sockfd = -1;
 
+	if (pthread_attr_init(&GSChildAttributes) != 0) {
+		fputs(ANSI_COLOR_RED"[GSInit] pthread_attr_init failed"
+			  ANSI_COLOR_RESETLN, stderr);
+		return false;
+	}
+	GSChildAttributesInitialized = true;
+
+	if (OMWorkerStackSize != 0 &&
+		pthread_attr_setstacksize(&GSChildAttributes,
+			OMWorkerStackSize < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN
+												  : OMWorkerStackSize) != 0) {
+		fputs(ANSI_COLOR_RED"[GSInit] Invalid OMWorkerStackSize"
+			  ANSI_COLOR_RESETLN, stderr);
+		return false;
+	}
+
 	GSCoreSocket = IOCreateSocket(443, 1);
 
 	if (GSCoreSocket < 0) {
@@ -212,6 +243,9 @@ GSNotify(enum GSAction action) {
 		case GSA_INTERRUPT:
 			GSMainLoop = 0;
 			break;
+		case GSA_RELOAD:
+			GSReloadRequested = 1;
+			break;
 		default:
 			printf("[GSNotify] Unknown GSAction: %X\n", action);
 	}
@@ -219,7 +253,7 @@ GSNotify(enum GSAction action) {
 
 bool
 GSScheduleChildThread(enum GSThreadParent parent,
-					  void *(*routine) (void *), int sockfd) {
+					  void *(*routine) (void *), int sockfd, void *data) {
 	int	state;
 	struct GSThread *thread;
 
@@ -237,18 +271,24 @@ GSScheduleChildThread(enum GSThreadParent parent,
 		}
 
 		if (thread->state) {
+			pthread_mutex_unlock(&GSChildMutex);
 			fputs(ANSI_COLOR_RED"[GSScheduleChildThread] All threads are in"
 				" use at the moment."ANSI_COLOR_RESETLN, stderr);
 			return false;
 		}
 
 		thread->sockfd = sockfd;
+		thread->data = data;
 		thread->state = 1;
+		GSChildActive += 1;
 	}
 	pthread_mutex_unlock(&GSChildMutex);
 
+	clock_gettime(CLOCK_MONOTONIC, &thread->scheduleTime);
+
 
-	state = pthread_create(&thread->thread, NULL, routine, thread);
+	state = pthread_create(&thread->thread, &GSChildAttributes, routine,
+						   thread);
 	if (state != 0) {
 		char *buf;
 
@@ -265,6 +305,7 @@ GSScheduleChildThread(enum GSThreadParent parent,
 		{
 			thread->sockfd = -1;
 			thread->state = 0;
+			GSChildActive -= 1;
 		}
 		pthread_mutex_unlock(&GSChildMutex);
 
@@ -287,10 +328,24 @@ GSChildThreadRelease(struct GSThread *thread) {
 	}
 
 	thread->state = 0;
+	GSChildActive -= 1;
 
 	pthread_mutex_unlock(&GSChildMutex);
 }
 
+unsigned int
+GSGetChildThreadOccupancy(void) {
+	size_t active;
+
+	pthread_mutex_lock(&GSChildMutex);
+	{
+		active = GSChildActive;
+	}
+	pthread_mutex_unlock(&GSChildMutex);
+
+	return active * 100 / GSChildSize;
+}
+
 bool
 GSPopulateProductName(void) {
 	memcpy(internalProductName, "WFS", 4);
@@ -33,7 +33,9 @@
 #define BASE_GLOBAL_STATE_H
 
 #include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
+#include <time.h>
 
 #include <stdbool.h>
 
@@ -41,11 +43,17 @@ struct GSThread {
 	int			 state;
 	pthread_t	 thread;
 	int			 sockfd;
+	/* Parent-specific data, e.g. the TLS client of the core service. */
+	void		*data;
+	/* The (CLOCK_MONOTONIC) time at which the thread was scheduled. */
+	struct timespec scheduleTime;
 };
 
 enum GSAction {
 	/* ^C was pressed */
 	GSA_INTERRUPT,
+	/* SIGHUP was received */
+	GSA_RELOAD,
 };
 
 enum GSThreadParent {
@@ -56,6 +64,9 @@ enum GSThreadParent {
 /* Boolean */
 extern int GSMainLoop;
 
+/* Boolean: whether the certificates should be reloaded */
+extern volatile sig_atomic_t GSReloadRequested;
+
 extern pthread_t GSCoreThread;
 extern pthread_t GSRedirThread;
 
@@ -76,13 +87,21 @@ GSChildThreadRelease(struct GSThread *);
 void
 GSDestroy(void);
 
+/* Returns the percentage (0-100) of child threads that are in use. */
+unsigned int
+GSGetChildThreadOccupancy(void);
+
 bool
 GSInit(void);
 
 void
 GSNotify(enum GSAction);
 
+/**
+ * Starts the routine in a child thread for the connection. The last parameter
+ * is stored in the 'data' member of the thread.
+ */
 bool
-GSScheduleChildThread(enum GSThreadParent, void *(*) (void *), int);
+GSScheduleChildThread(enum GSThreadParent, void *(*) (void *), int, void *);
 
 #endif /* BASE_GLOBAL_STATE_H */
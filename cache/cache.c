@@ -27,14 +27,22 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef __linux__
+/* memfd_create(2) */
+#define _GNU_SOURCE
+#endif
+
 #include "cache.h"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <ctype.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +50,8 @@
 #include <unistd.h>
 
 #include "cache/compression.h"
+#include "cache/early_hints.h"
+#include "http/path.h"
 #include "http/response_headers.h"
 #include "http/strings.h"
 #include "misc/default.h"
@@ -49,6 +59,8 @@
 #include "misc/options.h"
 
 #define FCSTEP 8
+#define FC_PATH_SIZE 2048
+#define FC_INDEX_SUFFIX "/index.html"
 #define FC_CALCULATE_USAGE
 
 /* Path */
@@ -61,6 +73,22 @@ struct FCEntry **fcEntries = NULL;
 char **fcNames = NULL;
 size_t fcSize = 0;
 
+/**
+ * The lookup index is an open-addressing hash table with linear probing. The
+ * names are hashed case-insensitively. Besides the name of every entry, the
+ * index contains the directory of every 'index.html' as an alias, e.g. '/a/'
+ * for '/a/index.html'. Aliases point into the name of the entry, so only the
+ * length differs.
+ */
+struct FCIndexEntry {
+	struct FCEntry	*entry;
+	size_t			 length;
+	const char		*name;
+};
+
+struct FCIndexEntry *fcIndex = NULL;
+size_t fcIndexMask = 0;
+
 /* Subroutines */
 void
 calculateUsage(void);
@@ -68,6 +96,198 @@ calculateUsage(void);
 bool
 setFileContents(const char *, const char *, struct FCEntry *);
 
+/* FNV-1a */
+static uint64_t
+hashName(const char *name, size_t length) {
+	uint64_t hash;
+	size_t i;
+
+	hash = 0xcbf29ce484222325ULL;
+	for (i = 0; i < length; i++) {
+		hash ^= (unsigned char) tolower((unsigned char) name[i]);
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static struct FCIndexEntry *
+findIndexEntry(const char *name, size_t length) {
+	size_t i;
+
+	i = hashName(name, length) & fcIndexMask;
+	while (fcIndex[i].name != NULL) {
+		if (fcIndex[i].length == length &&
+			strncasecmp(fcIndex[i].name, name, length) == 0)
+			break;
+		i = (i + 1) & fcIndexMask;
+	}
+
+	return &fcIndex[i];
+}
+
+/* The first entry with a name wins, like it did with a linear search. */
+static void
+insertIndexEntry(const char *name, size_t length, struct FCEntry *entry) {
+	struct FCIndexEntry *indexEntry;
+
+	indexEntry = findIndexEntry(name, length);
+	if (indexEntry->name != NULL)
+		return;
+
+	indexEntry->entry = entry;
+	indexEntry->length = length;
+	indexEntry->name = name;
+}
+
+bool
+buildIndex(void) {
+	size_t i;
+	size_t size;
+	size_t suffixLength;
+
+	/* At most two names per entry, and a load factor of at most 50%. */
+	size = 16;
+	while (size < fcCount * 4)
+		size *= 2;
+
+	fcIndex = calloc(size, sizeof(struct FCIndexEntry));
+	if (fcIndex == NULL) {
+		fputs(ANSI_COLOR_RED"[Cache::buildIndex] Allocation failure."
+			  ANSI_COLOR_RESETLN, stderr);
+		return false;
+	}
+
+	fcIndexMask = size - 1;
+	suffixLength = strlen(FC_INDEX_SUFFIX);
+
+	for (i = 0; i < fcCount; i++) {
+		size_t length;
+
+		length = strlen(fcNames[i]);
+		insertIndexEntry(fcNames[i], length, fcEntries[i]);
+
+		/* Keep the trailing slash of the directory. */
+		if (length >= suffixLength &&
+			strcasecmp(fcNames[i] + length - suffixLength,
+					   FC_INDEX_SUFFIX) == 0)
+			insertIndexEntry(fcNames[i], length - suffixLength + 1,
+							 fcEntries[i]);
+	}
+
+	return true;
+}
+
+/**
+ * Moves the data of the version into a memfd and maps it, so the version can
+ * be sent using sendfile(2) and the data isn't stored twice.
+ */
+bool
+backVersion(struct FCVersion *version) {
+#ifdef __linux__
+	char *buf;
+	size_t len;
+	void *mapping;
+
+	version->fd = memfd_create("cache", MFD_CLOEXEC);
+	if (version->fd == -1) {
+		perror(ANSI_COLOR_RED"[Cache::backVersion] memfd_create() failure"
+			   ANSI_COLOR_RESET);
+		return false;
+	}
+
+	buf = version->data;
+	len = version->size;
+	while (len != 0) {
+		ssize_t ret;
+
+		ret = write(version->fd, buf, len);
+		if (ret == -1) {
+			perror(ANSI_COLOR_RED"[Cache::backVersion] write() failure"
+				   ANSI_COLOR_RESET);
+			close(version->fd);
+			version->fd = -1;
+			return false;
+		}
+
+		buf += ret;
+		len -= ret;
+	}
+
+	mapping = mmap(NULL, version->size, PROT_READ, MAP_SHARED, version->fd,
+				   0);
+	if (mapping == MAP_FAILED) {
+		perror(ANSI_COLOR_RED"[Cache::backVersion] mmap() failure"
+			   ANSI_COLOR_RESET);
+		close(version->fd);
+		version->fd = -1;
+		return false;
+	}
+
+	free(version->data);
+	version->data = mapping;
+#else
+	UNUSED(version);
+#endif
+
+	return true;
+}
+
+bool
+backEntries(void) {
+	size_t i;
+
+	for (i = 0; i < fcCount; i++) {
+		struct FCVersion *versions[3];
+		size_t j;
+
+		versions[0] = &fcEntries[i]->br;
+		versions[1] = &fcEntries[i]->gzip;
+		versions[2] = &fcEntries[i]->uncompressed;
+
+		for (j = 0; j < 3; j++) {
+			if (versions[j]->data == NULL ||
+				versions[j]->size < OMCacheSendFileThreshold)
+				continue;
+
+			if (!backVersion(versions[j]))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* Releases the data of the version, which might be mapped. */
+void
+destroyVersion(struct FCVersion *version) {
+	if (version->fd == -1) {
+		free(version->data);
+		return;
+	}
+
+	munmap(version->data, version->size);
+	close(version->fd);
+}
+
+/**
+ * The early hints of an HTML file can only be discovered when all other files
+ * are in the cache, since only those resources are hinted.
+ */
+bool
+discoverEarlyHints(void) {
+	size_t i;
+
+	for (i = 0; i < fcCount; i++) {
+		if (strcasecmp(fcEntries[i]->mediaType, MT_html) != 0)
+			continue;
+
+		if (!FCDiscoverEarlyHints(fcNames[i], fcEntries[i]))
+			return false;
+	}
+
+	return true;
+}
 
 bool
 addFile(const char *directory, const char *fileName) {
@@ -106,6 +326,9 @@ addFile(const char *directory, const char *fileName) {
 
 	/* Create entry */
 	memset(entry, 0, sizeof(struct FCEntry));
+	entry->br.fd = -1;
+	entry->gzip.fd = -1;
+	entry->uncompressed.fd = -1;
 	if (!setFileContents(name, name + pathLength, entry)) {
 		fputs(ANSI_COLOR_RED"[Cache::addFile] setFileContents() failed."
 			  ANSI_COLOR_RESETLN, stderr);
@@ -213,6 +436,25 @@ FCSetup(void) {
 		return false;
 	}
 
+	if (!buildIndex()) {
+		FCDestroy();
+		return false;
+	}
+
+	if (OMCacheSendFileThreshold != 0 && !backEntries()) {
+		fputs(ANSI_COLOR_RED"[Cache::FCSetup] backEntries() failed."
+			  ANSI_COLOR_RESETLN, stderr);
+		FCDestroy();
+		return false;
+	}
+
+	if (OMCacheEarlyHints && !discoverEarlyHints()) {
+		fputs(ANSI_COLOR_RED"[Cache::FCSetup] discoverEarlyHints() failed."
+			  ANSI_COLOR_RESETLN, stderr);
+		FCDestroy();
+		return false;
+	}
+
 #ifdef FC_CALCULATE_USAGE
 	calculateUsage();
 #endif
@@ -222,41 +464,43 @@ FCSetup(void) {
 
 bool
 FCLookup(const char *path, struct FCResult *result, enum FCFlags flags) {
-	UNUSED(path);
-	UNUSED(result);
-
-	struct FCEntry		*entry;
-	size_t i;
-	struct FCVersion	*version;
+	char canonical[FC_PATH_SIZE];
+	struct FCEntry *entry;
+	struct FCIndexEntry *indexEntry;
+	size_t length;
+	struct FCVersion *version;
 
-	/* FIXME */
-	if (strcmp(path, "/") == 0)
-		path = "/index.html";
+	length = strlen(path);
+	if (length >= FC_PATH_SIZE ||
+		!HTTPCanonicalizePath(path, length, canonical, &length))
+		return false;
 
-	for (i = 0; i < fcCount; i++) {
-		if (strcasecmp(path, fcNames[i]) == 0) {
-			entry = fcEntries[i];
+	indexEntry = findIndexEntry(canonical, length);
+	if (indexEntry->name == NULL)
+		return false;
 
-			result->mediaCharset = entry->mediaCharset;
-			result->mediaType = entry->mediaType;
-			result->modificationDate = entry->modificationDate;
+	entry = indexEntry->entry;
 
-			if (flags & FCF_BROTLI && entry->br.data)
-				version = &entry->br;
-			else if (flags & FCF_GZIP && entry->gzip.data)
-				version = &entry->gzip;
-			else
-				version = &entry->uncompressed;
+	result->earlyHints = entry->earlyHints;
+	result->earlyHintsSize = entry->earlyHintsSize;
+	result->earlyHintsLink = entry->earlyHintsLink;
+	result->mediaCharset = entry->mediaCharset;
+	result->mediaType = entry->mediaType;
+	result->modificationDate = entry->modificationDate;
 
-			result->data = version->data;
-			result->encoding = version->encoding;
-			result->size = version->size;
+	if (flags & FCF_BROTLI && entry->br.data)
+		version = &entry->br;
+	else if (flags & FCF_GZIP && entry->gzip.data)
+		version = &entry->gzip;
+	else
+		version = &entry->uncompressed;
 
-			return true;
-		}
-	}
+	result->data = version->data;
+	result->encoding = version->encoding;
+	result->fd = version->fd;
+	result->size = version->size;
 
-	return false;
+	return true;
 }
 
 void
@@ -266,9 +510,11 @@ FCDestroy(void) {
 		size_t i;
 
 		for (i = 0; i < fcCount; i++) {
-			free(fcEntries[i]->uncompressed.data);
-			free(fcEntries[i]->br.data);
-			free(fcEntries[i]->gzip.data);
+			destroyVersion(&fcEntries[i]->uncompressed);
+			destroyVersion(&fcEntries[i]->br);
+			destroyVersion(&fcEntries[i]->gzip);
+			free(fcEntries[i]->earlyHints);
+			free(fcEntries[i]->earlyHintsLink);
 			free(fcEntries[i]);
 			free(fcNames[i]);
 		}
@@ -276,6 +522,7 @@ FCDestroy(void) {
 
 	free(fcEntries);
 	free(fcNames);
+	free(fcIndex);
 
 	FCCompressionDestroy();
 }
@@ -35,13 +35,22 @@
 #include <stdbool.h>
 #include <time.h>
 
+/**
+ * Large versions are backed by a file descriptor (a memfd), so they can be
+ * sent with sendfile(2). The data is then a read-only mapping of that file.
+ * The descriptor is -1 for versions that aren't backed.
+ */
 struct FCVersion {
 	char		*data;
 	const char	*encoding;
+	int			 fd;
 	size_t		 size;
 };
 
 struct FCEntry {
+	char			*earlyHints;
+	size_t			 earlyHintsSize;
+	char			*earlyHintsLink;
 	const char		*mediaCharset;
 	const char		*mediaType;
 	time_t			 modificationDate;
@@ -57,7 +66,11 @@ enum FCFlags {
 
 struct FCResult {
 	const char	*data;
+	const char	*earlyHints;
+	size_t		 earlyHintsSize;
+	const char	*earlyHintsLink;
 	const char	*encoding;
+	int			 fd;
 	const char	*mediaCharset;
 	const char	*mediaType;
 	time_t		 modificationDate;
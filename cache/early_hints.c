@@ -0,0 +1,389 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "early_hints.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cache/cache.h"
+#include "http/syntax.h"
+#include "misc/default.h"
+
+/* No more than this amount of resources are hinted per document. */
+#define FC_EARLY_HINTS_MAX 16
+#define FC_EARLY_HINTS_URL_SIZE 512
+#define FC_EARLY_HINTS_AS_SIZE 32
+
+static const char earlyHintsFormat[] =
+	"HTTP/1.1 103 Early Hints\r\n"
+	"Link: %s\r\n"
+	"\r\n";
+
+struct Hint {
+	char		 as[FC_EARLY_HINTS_AS_SIZE];
+	bool		 crossOrigin;
+	const char	*rel;
+	const char	*url;
+	size_t		 urlLength;
+};
+
+static bool
+isWhitespace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f';
+}
+
+/**
+ * Finds the value of the attribute with the given name in the tag between
+ * 'begin' and 'end'. Returns false if the tag doesn't have the attribute.
+ */
+static bool
+findAttribute(const char *begin, const char *end, const char *name,
+			  const char **outValue, size_t *outLength) {
+	size_t nameLength;
+
+	nameLength = strlen(name);
+
+	while (begin < end) {
+		const char *attribute;
+		size_t attributeLength;
+		const char *value;
+		size_t valueLength;
+
+		while (begin < end && (isWhitespace(*begin) || *begin == '/'))
+			begin++;
+
+		attribute = begin;
+		while (begin < end && !isWhitespace(*begin) && *begin != '=' &&
+			   *begin != '/')
+			begin++;
+		attributeLength = begin - attribute;
+
+		while (begin < end && isWhitespace(*begin))
+			begin++;
+
+		value = begin;
+		valueLength = 0;
+		if (begin < end && *begin == '=') {
+			begin++;
+			while (begin < end && isWhitespace(*begin))
+				begin++;
+
+			if (begin < end && (*begin == '"' || *begin == '\'')) {
+				const char *quote;
+
+				quote = memchr(begin + 1, *begin, end - begin - 1);
+				if (quote == NULL)
+					return false;
+
+				value = begin + 1;
+				valueLength = quote - value;
+				begin = quote + 1;
+			} else {
+				value = begin;
+				while (begin < end && !isWhitespace(*begin))
+					begin++;
+				valueLength = begin - value;
+			}
+		}
+
+		if (attributeLength == nameLength &&
+			strncasecmp(attribute, name, nameLength) == 0) {
+			*outValue = value;
+			*outLength = valueLength;
+			return true;
+		}
+
+		if (attributeLength == 0 && valueLength == 0)
+			begin++;
+	}
+
+	return false;
+}
+
+/* Checks if the space-separated list contains the token. */
+static bool
+hasToken(const char *list, size_t length, const char *token) {
+	const char *end;
+	size_t tokenLength;
+
+	end = list + length;
+	tokenLength = strlen(token);
+
+	while (list < end) {
+		const char *begin;
+
+		while (list < end && isWhitespace(*list))
+			list++;
+
+		begin = list;
+		while (list < end && !isWhitespace(*list))
+			list++;
+
+		if ((size_t) (list - begin) == tokenLength &&
+			strncasecmp(begin, token, tokenLength) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* Interprets a <link> or <script> tag. Returns false if it isn't critical. */
+static bool
+parseTag(const char *begin, const char *end, bool isScript,
+		 struct Hint *hint) {
+	const char *value;
+	size_t length;
+
+	hint->as[0] = '\0';
+	hint->crossOrigin = findAttribute(begin, end, "crossorigin", &value,
+									  &length);
+
+	if (isScript) {
+		if (!findAttribute(begin, end, "type", &value, &length) ||
+			length != 6 || strncasecmp(value, "module", 6) != 0)
+			return false;
+
+		hint->rel = "modulepreload";
+		return findAttribute(begin, end, "src", &hint->url, &hint->urlLength);
+	}
+
+	if (!findAttribute(begin, end, "rel", &value, &length))
+		return false;
+
+	if (hasToken(value, length, "stylesheet")) {
+		hint->rel = "preload";
+		strcpy(hint->as, "style");
+	} else if (hasToken(value, length, "modulepreload")) {
+		hint->rel = "modulepreload";
+	} else if (hasToken(value, length, "preload")) {
+		size_t i;
+
+		hint->rel = "preload";
+
+		/* The 'as' attribute is mandatory for preload links. */
+		if (!findAttribute(begin, end, "as", &value, &length) ||
+			length == 0 || length >= FC_EARLY_HINTS_AS_SIZE)
+			return false;
+
+		for (i = 0; i < length; i++)
+			if (!HTTPIsTokenCharacter(value[i]))
+				return false;
+
+		memcpy(hint->as, value, length);
+		hint->as[length] = '\0';
+	} else {
+		return false;
+	}
+
+	return findAttribute(begin, end, "href", &hint->url, &hint->urlLength);
+}
+
+/**
+ * Resolves the URL of the hint relative to the document, and checks if the
+ * resource is present in the cache. Only same-origin URLs are hinted.
+ */
+static bool
+resolveHint(const char *document, const struct Hint *hint, char *url) {
+	size_t directoryLength;
+	size_t i;
+	size_t length;
+	struct FCResult result;
+
+	if (hint->urlLength == 0 || hint->url[0] == '#' ||
+		(hint->urlLength > 1 && hint->url[0] == '/' && hint->url[1] == '/'))
+		return false;
+
+	for (i = 0; i < hint->urlLength; i++) {
+		/* A scheme means the URL is absolute (or e.g. a data: URL) */
+		if (hint->url[i] == ':')
+			return false;
+
+		/* These characters can't be put in a Link header as-is. */
+		if (hint->url[i] < 0x21 || hint->url[i] > 0x7E ||
+			hint->url[i] == '<' || hint->url[i] == '>')
+			return false;
+
+		if (hint->url[i] == '/' || hint->url[i] == '?' || hint->url[i] == '#')
+			break;
+	}
+
+	if (hint->url[0] == '/') {
+		directoryLength = 0;
+	} else {
+		directoryLength = strrchr(document, '/') - document + 1;
+	}
+
+	length = directoryLength + hint->urlLength;
+	if (length >= FC_EARLY_HINTS_URL_SIZE)
+		return false;
+
+	memcpy(url, document, directoryLength);
+	memcpy(url + directoryLength, hint->url, hint->urlLength);
+	url[length] = '\0';
+
+	for (i = directoryLength; i < length; i++)
+		if (url[i] < 0x21 || url[i] > 0x7E || url[i] == '<' || url[i] == '>')
+			return false;
+
+	/* FCLookup() strips the query and resolves dot segments. */
+	return FCLookup(url, &result, 0);
+}
+
+/* Checks if the URL is already in the Link header value. */
+static bool
+isHinted(const char *links, const char *url) {
+	size_t length;
+
+	if (links == NULL)
+		return false;
+
+	length = strlen(url);
+	while ((links = strstr(links, url)) != NULL) {
+		if (links[-1] == '<' && links[length] == '>')
+			return true;
+		links += length;
+	}
+
+	return false;
+}
+
+/* Appends the hint to the Link header value. */
+static bool
+appendHint(char **links, size_t *linksSize, const char *url,
+		   const struct Hint *hint) {
+	char *newLinks;
+	int length;
+
+	length = snprintf(NULL, 0, "%s<%s>; rel=%s%s%s%s",
+					  *linksSize == 0 ? "" : ", ", url, hint->rel,
+					  hint->as[0] == '\0' ? "" : "; as=", hint->as,
+					  hint->crossOrigin ? "; crossorigin" : "");
+	if (length < 0)
+		return false;
+
+	newLinks = realloc(*links, *linksSize + length + 1);
+	if (newLinks == NULL)
+		return false;
+
+	sprintf(newLinks + *linksSize, "%s<%s>; rel=%s%s%s%s",
+			*linksSize == 0 ? "" : ", ", url, hint->rel,
+			hint->as[0] == '\0' ? "" : "; as=", hint->as,
+			hint->crossOrigin ? "; crossorigin" : "");
+
+	*links = newLinks;
+	*linksSize += length;
+	return true;
+}
+
+bool
+FCDiscoverEarlyHints(const char *name, struct FCEntry *entry) {
+	const char *data;
+	const char *end;
+	size_t count;
+	char *links;
+	size_t linksSize;
+	int size;
+
+	data = entry->uncompressed.data;
+	end = data + entry->uncompressed.size;
+	count = 0;
+	links = NULL;
+	linksSize = 0;
+
+	while (data < end && count < FC_EARLY_HINTS_MAX) {
+		const char *tagEnd;
+		bool isScript;
+		struct Hint hint;
+		char url[FC_EARLY_HINTS_URL_SIZE];
+
+		data = memchr(data, '<', end - data);
+		if (data == NULL)
+			break;
+		data += 1;
+
+		/* Resources in the body aren't render-blocking. */
+		if (end - data >= 5 && (strncasecmp(data, "/head", 5) == 0 ||
+								strncasecmp(data, "body", 4) == 0))
+			break;
+
+		if (end - data >= 5 && strncasecmp(data, "link", 4) == 0 &&
+			isWhitespace(data[4])) {
+			isScript = false;
+			data += 5;
+		} else if (end - data >= 7 && strncasecmp(data, "script", 6) == 0 &&
+				   isWhitespace(data[6])) {
+			isScript = true;
+			data += 7;
+		} else {
+			continue;
+		}
+
+		tagEnd = memchr(data, '>', end - data);
+		if (tagEnd == NULL)
+			break;
+
+		if (parseTag(data, tagEnd, isScript, &hint) &&
+			resolveHint(name, &hint, url) &&
+			!isHinted(links, url)) {
+			if (!appendHint(&links, &linksSize, url, &hint)) {
+				fputs(ANSI_COLOR_RED"[Cache::FCDiscoverEarlyHints] Allocation "
+					  "failure."ANSI_COLOR_RESETLN, stderr);
+				free(links);
+				return false;
+			}
+
+			count++;
+		}
+
+		data = tagEnd + 1;
+	}
+
+	if (links == NULL)
+		return true;
+
+	size = snprintf(NULL, 0, earlyHintsFormat, links);
+	entry->earlyHints = malloc(size + 1);
+	if (entry->earlyHints == NULL) {
+		fputs(ANSI_COLOR_RED"[Cache::FCDiscoverEarlyHints] Allocation failure."
+			  ANSI_COLOR_RESETLN, stderr);
+		free(links);
+		return false;
+	}
+
+	entry->earlyHintsSize = sprintf(entry->earlyHints, earlyHintsFormat,
+									links);
+	entry->earlyHintsLink = links;
+
+	printf("Cache (early hints for '%s': %s)\n", name, links);
+	return true;
+}
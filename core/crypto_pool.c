@@ -0,0 +1,480 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* RSA_METHOD and EC_KEY_METHOD are deprecated in OpenSSL 3.0, but a provider
+ * can't pause an async job in the middle of a signature either. */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include "crypto_pool.h"
+
+#include <sys/eventfd.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/async.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+
+#include "misc/default.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+enum CPTaskType {
+	CPT_ECDSA_SIGN,
+	CPT_RSA_PRIVATE_ENCRYPT
+};
+
+/**
+ * A private key operation. The input and output buffers follow the structure,
+ * so the task doesn't depend on the stack of the job, which is never resumed
+ * when the connection is destroyed while the job is paused.
+ *
+ * The job and the crypto thread each hold a reference. The last one closes
+ * the file descriptor and frees the task.
+ */
+struct CPTask {
+	struct CPTask	*next;
+	enum CPTaskType	 type;
+
+	/* The EC_KEY or RSA, with a reference held by the task. */
+	void			*key;
+	/* The digest type (NID) of ECDSA, or the padding of RSA. */
+	int				 parameter;
+
+	unsigned char	*input;
+	size_t			 inputSize;
+	unsigned char	*output;
+	size_t			 outputSize;
+	int				 result;
+
+	/* The eventfd(2) that is signaled when the task is done. */
+	int				 fd;
+	bool			 isDone;
+	unsigned int	 references;
+};
+
+/* The key of the file descriptors in the ASYNC_WAIT_CTX of the jobs. */
+static const char CPWaitKey;
+
+static pthread_t *CPThreads;
+static size_t CPThreadCount;
+static bool CPIsRunning;
+
+/* Protects the queue, the state of the tasks and CPIsRunning. */
+static pthread_mutex_t CPMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t CPCondition = PTHREAD_COND_INITIALIZER;
+static struct CPTask *CPQueueHead;
+static struct CPTask *CPQueueTail;
+
+static EC_KEY_METHOD *CPECMethod;
+static RSA_METHOD *CPRSAMethod;
+
+/* The implementations of OpenSSL, which perform the actual operations. */
+static int (*CPECDSASign)(int, const unsigned char *, int, unsigned char *,
+						  unsigned int *, const BIGNUM *, const BIGNUM *,
+						  EC_KEY *);
+static int (*CPRSAPrivateEncrypt)(int, const unsigned char *, unsigned char *,
+								  RSA *, int);
+
+static struct CPTask *
+createTask(enum CPTaskType type, const unsigned char *input, size_t inputSize,
+		   size_t outputSize) {
+	struct CPTask *task;
+
+	task = malloc(sizeof(struct CPTask) + inputSize + outputSize);
+	if (task == NULL)
+		return NULL;
+
+	memset(task, 0, sizeof(struct CPTask));
+	task->type = type;
+	task->input = (unsigned char *) (task + 1);
+	task->inputSize = inputSize;
+	task->output = task->input + inputSize;
+	task->outputSize = outputSize;
+	task->fd = -1;
+	task->references = 1;
+	memcpy(task->input, input, inputSize);
+	return task;
+}
+
+static void
+releaseTask(struct CPTask *task) {
+	bool isLast;
+
+	pthread_mutex_lock(&CPMutex);
+	{
+		task->references -= 1;
+		isLast = task->references == 0;
+	}
+	pthread_mutex_unlock(&CPMutex);
+
+	if (!isLast)
+		return;
+
+	if (task->fd != -1)
+		close(task->fd);
+
+	if (task->type == CPT_ECDSA_SIGN)
+		EC_KEY_free(task->key);
+	else
+		RSA_free(task->key);
+
+	free(task);
+}
+
+/* Called by OpenSSL when a connection is destroyed while its job waits. */
+static void
+cleanupWait(ASYNC_WAIT_CTX *context, const void *key, OSSL_ASYNC_FD fd,
+			void *task) {
+	UNUSED(context);
+	UNUSED(key);
+	UNUSED(fd);
+
+	releaseTask(task);
+}
+
+static bool
+isTaskDone(struct CPTask *task) {
+	bool isDone;
+
+	pthread_mutex_lock(&CPMutex);
+	{
+		isDone = task->isDone;
+	}
+	pthread_mutex_unlock(&CPMutex);
+
+	return isDone;
+}
+
+/**
+ * Queues the task and pauses the current job until a crypto thread has
+ * performed it. Returns false if the task couldn't be queued, in which case
+ * the caller should perform it itself.
+ */
+static bool
+runTask(struct CPTask *task) {
+	ASYNC_WAIT_CTX *waitContext;
+	uint64_t value;
+
+	waitContext = ASYNC_get_wait_ctx(ASYNC_get_current_job());
+
+	task->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (task->fd == -1)
+		return false;
+
+	if (!ASYNC_WAIT_CTX_set_wait_fd(waitContext, &CPWaitKey, task->fd, task,
+									cleanupWait))
+		return false;
+
+	pthread_mutex_lock(&CPMutex);
+	{
+		task->references += 1;
+		if (CPQueueTail == NULL)
+			CPQueueHead = task;
+		else
+			CPQueueTail->next = task;
+		CPQueueTail = task;
+		pthread_cond_signal(&CPCondition);
+	}
+	pthread_mutex_unlock(&CPMutex);
+
+	/* The job may be resumed before the file descriptor is readable. */
+	do {
+		ASYNC_pause_job();
+	} while (!isTaskDone(task));
+
+	/* Clearing the file descriptor doesn't call cleanupWait(). */
+	if (read(task->fd, &value, sizeof(value)) == -1)
+		perror(ANSI_COLOR_RED"[CryptoPool::runTask] read"ANSI_COLOR_RESETLN);
+	ASYNC_WAIT_CTX_clear_fd(waitContext, &CPWaitKey);
+
+	SMAddCounter(SMC_TLS_SIGNATURES_OFFLOADED, 1);
+	return true;
+}
+
+static void
+performTask(struct CPTask *task) {
+	unsigned int size;
+
+	switch (task->type) {
+		case CPT_ECDSA_SIGN:
+			size = (unsigned int) task->outputSize;
+			task->result = CPECDSASign(task->parameter, task->input,
+									   (int) task->inputSize, task->output,
+									   &size, NULL, NULL, task->key);
+			task->outputSize = size;
+			break;
+		case CPT_RSA_PRIVATE_ENCRYPT:
+			task->result = CPRSAPrivateEncrypt((int) task->inputSize,
+											   task->input, task->output,
+											   task->key, task->parameter);
+			break;
+	}
+}
+
+static void *
+runCryptoThread(void *unused) {
+	struct CPTask *task;
+	uint64_t value;
+
+	UNUSED(unused);
+
+	while (true) {
+		pthread_mutex_lock(&CPMutex);
+		{
+			while (CPQueueHead == NULL && CPIsRunning)
+				pthread_cond_wait(&CPCondition, &CPMutex);
+
+			task = CPQueueHead;
+			if (task != NULL) {
+				CPQueueHead = task->next;
+				if (CPQueueHead == NULL)
+					CPQueueTail = NULL;
+			}
+		}
+		pthread_mutex_unlock(&CPMutex);
+
+		if (task == NULL)
+			return NULL;
+
+		performTask(task);
+
+		pthread_mutex_lock(&CPMutex);
+		{
+			task->isDone = true;
+		}
+		pthread_mutex_unlock(&CPMutex);
+
+		/* The file descriptor stays open until the reference is released. */
+		value = 1;
+		if (write(task->fd, &value, sizeof(value)) == -1)
+			perror(ANSI_COLOR_RED"[CryptoPool::runCryptoThread] write"
+				   ANSI_COLOR_RESETLN);
+
+		releaseTask(task);
+	}
+}
+
+static int
+signECDSA(int type, const unsigned char *digest, int digestSize,
+		  unsigned char *signature, unsigned int *signatureSize,
+		  const BIGNUM *kinv, const BIGNUM *r, EC_KEY *key) {
+	struct CPTask *task;
+	int result;
+
+	/* Precomputed values are never used by TLS, so these aren't supported
+	 * by the crypto threads. */
+	if (ASYNC_get_current_job() == NULL || kinv != NULL || r != NULL)
+		return CPECDSASign(type, digest, digestSize, signature,
+						   signatureSize, kinv, r, key);
+
+	task = createTask(CPT_ECDSA_SIGN, digest, (size_t) digestSize,
+					  (size_t) ECDSA_size(key));
+	if (task == NULL)
+		return 0;
+
+	task->key = key;
+	task->parameter = type;
+	EC_KEY_up_ref(key);
+
+	if (!runTask(task)) {
+		releaseTask(task);
+		return CPECDSASign(type, digest, digestSize, signature,
+						   signatureSize, kinv, r, key);
+	}
+
+	result = task->result;
+	if (result == 1) {
+		memcpy(signature, task->output, task->outputSize);
+		*signatureSize = (unsigned int) task->outputSize;
+	}
+
+	releaseTask(task);
+	return result;
+}
+
+static int
+encryptRSA(int size, const unsigned char *input, unsigned char *output,
+		   RSA *key, int padding) {
+	struct CPTask *task;
+	int result;
+
+	if (ASYNC_get_current_job() == NULL)
+		return CPRSAPrivateEncrypt(size, input, output, key, padding);
+
+	task = createTask(CPT_RSA_PRIVATE_ENCRYPT, input, (size_t) size,
+					  (size_t) RSA_size(key));
+	if (task == NULL)
+		return -1;
+
+	task->key = key;
+	task->parameter = padding;
+	RSA_up_ref(key);
+
+	if (!runTask(task)) {
+		releaseTask(task);
+		return CPRSAPrivateEncrypt(size, input, output, key, padding);
+	}
+
+	result = task->result;
+	if (result > 0)
+		memcpy(output, task->output, (size_t) result);
+
+	releaseTask(task);
+	return result;
+}
+
+void
+CPDestroy(void) {
+	size_t i;
+
+	pthread_mutex_lock(&CPMutex);
+	{
+		CPIsRunning = false;
+		pthread_cond_broadcast(&CPCondition);
+	}
+	pthread_mutex_unlock(&CPMutex);
+
+	for (i = 0; i < CPThreadCount; i++)
+		pthread_join(CPThreads[i], NULL);
+
+	free(CPThreads);
+	CPThreads = NULL;
+	CPThreadCount = 0;
+
+	/* Unlike RSA_meth_free, EC_KEY_METHOD_free doesn't accept NULL, which it
+	 * is when the pool is disabled or failed to set up. */
+	if (CPECMethod != NULL)
+		EC_KEY_METHOD_free(CPECMethod);
+	CPECMethod = NULL;
+	RSA_meth_free(CPRSAMethod);
+	CPRSAMethod = NULL;
+}
+
+bool
+CPIsEnabled(void) {
+	return CPThreadCount != 0;
+}
+
+bool
+CPSetup(void) {
+	int (*signSetup)(EC_KEY *, BN_CTX *, BIGNUM **, BIGNUM **);
+	ECDSA_SIG *(*signSig)(const unsigned char *, int, const BIGNUM *,
+						  const BIGNUM *, EC_KEY *);
+
+	if (OMSCryptoThreadCount == 0)
+		return true;
+
+	if (!ASYNC_is_capable()) {
+		fputs(ANSI_COLOR_RED"[CryptoPool::CPSetup] Async jobs aren't "
+			  "supported, signing on the event loop instead."
+			  ANSI_COLOR_RESETLN, stderr);
+		return true;
+	}
+
+	/* Copies of the default methods, of which only the private key operation
+	 * is replaced. */
+	CPECMethod = EC_KEY_METHOD_new(EC_KEY_OpenSSL());
+	CPRSAMethod = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+	if (CPECMethod == NULL || CPRSAMethod == NULL) {
+		CPDestroy();
+		return false;
+	}
+
+	EC_KEY_METHOD_get_sign(CPECMethod, &CPECDSASign, &signSetup, &signSig);
+	EC_KEY_METHOD_set_sign(CPECMethod, signECDSA, signSetup, signSig);
+
+	CPRSAPrivateEncrypt = RSA_meth_get_priv_enc(CPRSAMethod);
+	if (!RSA_meth_set_priv_enc(CPRSAMethod, encryptRSA)) {
+		CPDestroy();
+		return false;
+	}
+
+	CPThreads = calloc(OMSCryptoThreadCount, sizeof(pthread_t));
+	if (CPThreads == NULL) {
+		CPDestroy();
+		return false;
+	}
+
+	CPIsRunning = true;
+	for (CPThreadCount = 0; CPThreadCount < OMSCryptoThreadCount;
+		 CPThreadCount++) {
+		if (pthread_create(&CPThreads[CPThreadCount], NULL, runCryptoThread,
+						   NULL) != 0) {
+			fputs(ANSI_COLOR_RED"[CryptoPool::CPSetup] Failed to create a "
+				  "crypto thread"ANSI_COLOR_RESETLN, stderr);
+			CPDestroy();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+EVP_PKEY *
+CPWrapPrivateKey(EVP_PKEY *key) {
+	EVP_PKEY *wrapped;
+	EC_KEY *ecKey;
+	RSA *rsaKey;
+
+	wrapped = EVP_PKEY_new();
+	if (wrapped == NULL)
+		return NULL;
+
+	/* Keys with a method other than the default one are handled by the
+	 * legacy code paths of OpenSSL, which call the method. */
+	switch (EVP_PKEY_get_base_id(key)) {
+		case EVP_PKEY_EC:
+			ecKey = EVP_PKEY_get1_EC_KEY(key);
+			if (ecKey != NULL && EC_KEY_set_method(ecKey, CPECMethod) &&
+				EVP_PKEY_assign_EC_KEY(wrapped, ecKey))
+				return wrapped;
+			EC_KEY_free(ecKey);
+			break;
+		case EVP_PKEY_RSA:
+			rsaKey = EVP_PKEY_get1_RSA(key);
+			if (rsaKey != NULL && RSA_set_method(rsaKey, CPRSAMethod) &&
+				EVP_PKEY_assign_RSA(wrapped, rsaKey))
+				return wrapped;
+			RSA_free(rsaKey);
+			break;
+		default:
+			break;
+	}
+
+	EVP_PKEY_free(wrapped);
+	return NULL;
+}
@@ -0,0 +1,70 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * CP is an abbreviation for Crypto Pool.
+ *
+ * The signature of a full TLS handshake is its most expensive step. To keep
+ * it from blocking the handshake event loop, the private keys are wrapped so
+ * that their signing operations are performed by a pool of crypto threads
+ * when they are called from an OpenSSL async job (SSL_MODE_ASYNC). The job is
+ * paused meanwhile, and SSL_accept() reports SSL_ERROR_WANT_ASYNC. The
+ * handshake should be continued once the file descriptor of the job, see
+ * SSL_get_all_async_fds(), is readable.
+ *
+ * Outside of an async job, the operations are performed by the calling
+ * thread.
+ */
+
+#ifndef CORE_CRYPTO_POOL_H
+#define CORE_CRYPTO_POOL_H
+
+#include <stdbool.h>
+
+#include <openssl/evp.h>
+
+/* Stops the crypto threads after they have finished the queued work. */
+void
+CPDestroy(void);
+
+/* Returns whether the crypto threads are running. */
+bool
+CPIsEnabled(void);
+
+/* Starts OMSCryptoThreadCount crypto threads. */
+bool
+CPSetup(void);
+
+/**
+ * Returns a new key with the same key material, of which the private key
+ * operations are performed by the crypto threads. Only RSA and EC keys are
+ * supported; NULL is returned for other keys or on failure.
+ */
+EVP_PKEY *
+CPWrapPrivateKey(EVP_PKEY *);
+
+#endif /* CORE_CRYPTO_POOL_H */
@@ -31,6 +31,7 @@
 
 #include <sys/time.h>
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -41,9 +42,13 @@
 
 #include "base/global_state.h"
 #include "cache/cache.h"
+#include "core/load_shedding.h"
 #include "core/security.h"
 #include "core/timings.h"
 #include "misc/default.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+#include "http/request.h"
 #include "http/strings.h"
 #include "http/syntax.h"
 
@@ -53,32 +58,9 @@
  * ceil(log(2^64 - 1))
  */
 #define DOCUMENT_SIZE_CHARACTER_SIZE 19
-#define METHOD_SIZE			64
-#define PATH_SIZE			2048
-#define VERSION_SIZE		8
-#define HEADER_NAME_SIZE	64
-#define HEADER_VALUE_SIZE	256
-#define HEADER_STEP_SIZE 	8
 
 #define TIME_FORMAT "%a, %d %b %Y %T GMT"
 
-struct HTTPHeader {
-	/* Even though a perfect-sized-buffer is better memory wise, doing a lot of
-	 * allocations is worse CPU wise. */
-	char name[HEADER_NAME_SIZE];
-	char value[HEADER_VALUE_SIZE];
-};
-
-struct HTTPRequest {
-	char	buffer[2];
-	struct HTTPHeader	*headers;
-	uint8_t headersSize;
-	uint8_t headerCount;
-	char	method[METHOD_SIZE];
-	char	path[PATH_SIZE];
-	char	version[VERSION_SIZE];
-};
-
 enum HTTPError {
 	HTTP_ERROR_FILE_NOT_FOUND,
 	HTTP_ERROR_HEADER_ALLOCATION_FAILURE,
@@ -100,7 +82,7 @@ enum HTTPError {
 
 static const char messageFormat[] =
 	"HTTP/1.1 %s\r\n"
-	"Connection: keep-alive\r\n"
+	"Connection: %s\r\n"
 	"Content-Encoding: %s\r\n"
 	"Content-Length: %zu\r\n"
 	"Content-Type: %s\r\n"
@@ -114,7 +96,7 @@ static const char messageFormat[] =
 
 static const char messageNotModified[] =
 	"HTTP/1.1 304 Not Modified\r\n"
-	"Connection: keep-alive\r\n"
+	"Connection: %s\r\n"
 	"Date: %s\r\n"
 	"Referrer-Policy: no-referrer\r\n"
 	"Server: %s\r\n"
@@ -122,6 +104,41 @@ static const char messageNotModified[] =
 	"X-Content-Type-Options: nosniff\r\n"
 	"\r\n";
 
+/**
+ * The response for shed requests. It is rendered only once, so shedding is
+ * as cheap as possible. RFC 7231 § 7.1.1.2 allows omitting the Date header in
+ * 5xx responses.
+ */
+static const char messageServiceUnavailable[] =
+	"HTTP/1.1 %s\r\n"
+	"Connection: close\r\n"
+	"Content-Length: %zu\r\n"
+	"Content-Type: text/html;charset=utf-8\r\n"
+	"Referrer-Policy: no-referrer\r\n"
+	"Retry-After: %zu\r\n"
+	"Server: %s\r\n"
+	"Strict-Transport-Security: max-age=31536000\r\n"
+	"X-Content-Type-Options: nosniff\r\n"
+	"\r\n"
+	"%s";
+
+static const char documentServiceUnavailable[] =
+	"<!doctype html>"
+	"<html>"
+	"<head>"
+	"<title>503 Service Unavailable</title>"
+	"</head>"
+	"<body>"
+	"<h1>Service Unavailable</h1>"
+	"</body>"
+	"</html>";
+
+static char		*renderedServiceUnavailable = NULL;
+static int		 renderedServiceUnavailableSize;
+static pthread_once_t renderServiceUnavailableOnce = PTHREAD_ONCE_INIT;
+
+static const char connectionClose[] = "close";
+static const char connectionKeepAlive[] = "keep-alive";
 
 bool
 handleRequest(CSSClient, struct HTTPRequest *);
@@ -132,30 +149,91 @@ handleRequestStage2(CSSClient, struct HTTPRequest *, struct Timings *);
 bool
 recoverError(CSSClient, enum HTTPError, struct HTTPRequest *);
 
+bool
+shedRequest(CSSClient, struct HTTPRequest *);
+
 bool
 writeResponse(CSSClient);
 
+/**
+ * Returns the idle timeout in milliseconds. When the worker threads are getting
+ * occupied, the timeout is reduced so idle connections make room for new ones.
+ */
+static size_t
+getKeepAliveTimeout(void) {
+	unsigned int occupancy;
+	size_t range;
+
+	/* A minimum above the timeout leaves nothing to reduce, and would
+	 * make the unsigned range below wrap around. */
+	occupancy = GSGetChildThreadOccupancy();
+	if (occupancy <= OMKeepAliveAdaptiveThreshold ||
+		OMKeepAliveAdaptiveThreshold >= 100 ||
+		OMKeepAliveMinimumTimeout >= OMKeepAliveTimeout)
+		return OMKeepAliveTimeout;
+
+	range = OMKeepAliveTimeout - OMKeepAliveMinimumTimeout;
+	return OMKeepAliveTimeout - range *
+		(occupancy - OMKeepAliveAdaptiveThreshold) /
+		(100 - OMKeepAliveAdaptiveThreshold);
+}
+
+/* Checks if the comma-separated list 'value' contains the token. */
+static bool
+hasHeaderToken(const char *value, const char *token) {
+	size_t len;
+
+	len = strlen(token);
+	while (*value != '\0') {
+		while (*value == ' ' || *value == '\t' || *value == ',')
+			value++;
+
+		if (strncasecmp(value, token, len) == 0 &&
+			(value[len] == '\0' || value[len] == ',' ||
+			 value[len] == ' ' || value[len] == '\t'))
+			return true;
+
+		while (*value != '\0' && *value != ',')
+			value++;
+	}
+
+	return false;
+}
+
 void
 CSHandleHTTP1(CSSClient client) {
+	time_t begin;
+	size_t count;
 	struct HTTPRequest *request;
 	bool status;
 
-	request = malloc(sizeof(struct HTTPRequest));
-
-	if (!request)
-		return;
+	begin = time(NULL);
+	count = 0;
 
 	do {
+		if (!CSSWaitClient(client, getKeepAliveTimeout() * 1000))
+			break;
+
+		/* The request is only allocated once data has arrived, so idle
+		 * keep-alive connections don't hold on to its buffers. */
+		request = malloc(sizeof(struct HTTPRequest));
+		if (!request)
+			break;
+
+		count += 1;
+		request->closeConnection = count >= OMKeepAliveMaxRequests ||
+								   time(NULL) - begin >= OMKeepAliveMaxLifetime;
 		status = handleRequest(client, request);
+		free(request);
 	} while (status);
-
-	free(request);
 }
 
 bool
 handleRequest(CSSClient client, struct HTTPRequest *request) {
 	bool bret;
 	float diff;
+	size_t i;
+	bool isKeepAliveDefault;
 	struct HTTPHeader *newHeaders;
 	size_t pos;
 	size_t ret;
@@ -244,6 +322,9 @@ handleRequest(CSSClient client, struct HTTPRequest *request) {
 		return recoverError(client, HTTP_ERROR_VERSION_UNKNOWN, request);
 	timings.readVersion.after = clock();
 
+	/* HTTP/1.0 connections are closed unless asked otherwise. */
+	isKeepAliveDefault = request->version[7] != '0';
+
 	/* Consume CRLF */
 	if (!CSSReadClient(client, request->buffer, 2))
 		return recoverError(client, HTTP_ERROR_READ, request);
@@ -366,6 +447,24 @@ handleRequest(CSSClient client, struct HTTPRequest *request) {
 	} while (1);
 	timings.readHeaders.after = clock();
 
+	/* RFC 7230 § 6.1: Connection Management */
+	for (i = 0; i < request->headerCount; i++) {
+		if (strcasecmp(request->headers[i].name, "Connection") == 0) {
+			if (hasHeaderToken(request->headers[i].value, connectionClose))
+				request->closeConnection = true;
+			else if (hasHeaderToken(request->headers[i].value,
+									connectionKeepAlive))
+				isKeepAliveDefault = true;
+		}
+	}
+
+	if (!isKeepAliveDefault)
+		request->closeConnection = true;
+
+	SMAddCounter(SMC_HTTP_REQUESTS, 1);
+	if (LSShouldShed())
+		return shedRequest(client, request);
+
 	strncpy(timings.path, request->path, 256);
 
 	/* TODO Check if there was a [ message-body ] */
@@ -431,6 +530,7 @@ bool
 recoverError(CSSClient client, enum HTTPError error,
 				 struct HTTPRequest *request) {
 	char *buf;
+	const char *connection;
 	char date[32];
 	size_t formattedBufSize;
 	int ret;
@@ -449,6 +549,12 @@ recoverError(CSSClient client, enum HTTPError error,
 	 */
 	free(request->headers);
 
+	/* Errors that don't affect the connection can keep it alive. */
+	if (error == HTTP_ERROR_FILE_NOT_FOUND && !request->closeConnection)
+		connection = connectionKeepAlive;
+	else
+		connection = connectionClose;
+
 	/* TODO Create a 'personalized' error message for each error. */
 	const char document[] =
 		"<!doctype html>"
@@ -473,6 +579,7 @@ recoverError(CSSClient client, enum HTTPError error,
 	buf = malloc(
 		strlen(messageFormat) +
 		strlen(HTTPStatus404NotFound) +
+		strlen(connection) +
 		sizeof(encoding) / sizeof(encoding[0]) - 1 +
 		DOCUMENT_SIZE_CHARACTER_SIZE +
 		sizeof(mediaType) / sizeof(mediaType[0]) - 1 +
@@ -487,6 +594,7 @@ recoverError(CSSClient client, enum HTTPError error,
 
 	formattedBufSize = sprintf(buf, messageFormat,
 		HTTPStatus404NotFound,
+		connection,
 		encoding,
 		sizeof(document) / sizeof(document[0]) - 1,
 		mediaType,
@@ -507,14 +615,47 @@ recoverError(CSSClient client, enum HTTPError error,
 	if (!ret)
 		return false;
 
-	switch (error) {
-		/* Errors that don't affect the connection should return 1, and errors
-		 * that do should return 0. */
-		case HTTP_ERROR_FILE_NOT_FOUND:
-			return true;
-		default:
-			return false;
+	return connection == connectionKeepAlive;
+}
+
+static void
+renderServiceUnavailable(void) {
+	int size;
+
+	size = snprintf(NULL, 0, messageServiceUnavailable,
+					HTTPStatus503ServiceUnavailable,
+					sizeof(documentServiceUnavailable) - 1,
+					OMLoadSheddingRetryAfter, GSServerProductName,
+					documentServiceUnavailable);
+	if (size < 0)
+		return;
+
+	renderedServiceUnavailable = malloc(size + 1);
+	if (!renderedServiceUnavailable) {
+		perror("Allocation failure");
+		return;
 	}
+
+	renderedServiceUnavailableSize = sprintf(renderedServiceUnavailable,
+		messageServiceUnavailable, HTTPStatus503ServiceUnavailable,
+		sizeof(documentServiceUnavailable) - 1, OMLoadSheddingRetryAfter,
+		GSServerProductName, documentServiceUnavailable);
+}
+
+/* Answers the request with the pre-rendered 503 response and closes the
+ * connection, without consulting the cache. */
+bool
+shedRequest(CSSClient client, struct HTTPRequest *request) {
+	free(request->headers);
+
+	SMAddCounter(SMC_LOAD_SHED_REQUESTS, 1);
+
+	pthread_once(&renderServiceUnavailableOnce, renderServiceUnavailable);
+	if (renderedServiceUnavailable != NULL)
+		CSSWriteClient(client, renderedServiceUnavailable,
+					   renderedServiceUnavailableSize);
+
+	return false;
 }
 
 bool
@@ -522,6 +663,7 @@ handleRequestStage2(CSSClient client, struct HTTPRequest *request,
 						struct Timings *timings) {
 	/* TODO Improve variable naming. */
 	char *buf;
+	const char *connection;
 	char date[32]; /* "Sun, 06 Nov 1994 08:49:37 GMT" = 29 characters */
 	char dateLastModified[64];
 	size_t formattedBufSize;
@@ -540,6 +682,18 @@ handleRequestStage2(CSSClient client, struct HTTPRequest *request,
 	/* TODO Parse 'Accept-Encoding' */
 	ret = FCLookup(request->path, &result, FCF_BROTLI | FCF_GZIP);
 
+	/* A request sent as early data might be a replay, so only requests that
+	 * are safe to repeat are answered before the handshake has completed. */
+	if (CSSIsHandshakePending(client) &&
+		(!ret || (strcmp(request->method, "GET") != 0 &&
+				  strcmp(request->method, "HEAD") != 0))) {
+		SMAddCounter(SMC_TLS_EARLY_DATA_DEFERRED, 1);
+		if (!CSSCompleteHandshake(client)) {
+			free(request->headers);
+			return false;
+		}
+	}
+
 	if (!ret) {
 		timings->flags |= TF_NOT_FOUND;
 		return recoverError(client, HTTP_ERROR_FILE_NOT_FOUND, request);
@@ -584,6 +738,9 @@ handleRequestStage2(CSSClient client, struct HTTPRequest *request,
 	/* Done with request handling, so resources can be released: */
 	free(request->headers);
 
+	connection = request->closeConnection ? connectionClose
+										  : connectionKeepAlive;
+
 	if (result.encoding != MTE_none) {
 		timings->flags |= TF_COMPRESSED;
 	}
@@ -591,22 +748,27 @@ handleRequestStage2(CSSClient client, struct HTTPRequest *request,
 	if (isUnchanged) {
 		timings->flags |= TF_CLIENT_CACHED;
 
-		buf = malloc(strlen(messageNotModified) + strlen(date) +
-					 strlen(GSServerProductName) + 1);
+		buf = malloc(strlen(messageNotModified) + strlen(connection) +
+					 strlen(date) + strlen(GSServerProductName) + 1);
 		if (!buf) {
 			perror("Allocation failure");
 			return false;
 		}
 
-		formattedBufSize = sprintf(buf, messageNotModified, date,
+		formattedBufSize = sprintf(buf, messageNotModified, connection, date,
 								   GSServerProductName);
 		ret = CSSWriteClient(client, buf, formattedBufSize);
 		free(buf);
 
-		/* is the following ?: really necessary? */
-		return ret ? true : false;
+		return ret && !request->closeConnection;
 	}
 
+	/* Informational responses were introduced in HTTP/1.1, so HTTP/1.0
+	 * clients can't receive early hints. */
+	if (result.earlyHints != NULL && request->version[7] != '0' &&
+		!CSSWriteClient(client, result.earlyHints, result.earlyHintsSize))
+		return false;
+
 	/* Follow-up for the dateLastModified header */
 	len += 15; /* starting position of header value. */
 	dateLastModified[len] = '\r';
@@ -617,6 +779,7 @@ handleRequestStage2(CSSClient client, struct HTTPRequest *request,
 	buf = malloc(
 		strlen(messageFormat) +
 		strlen(HTTPStatus200OK) +
+		strlen(connection) +
 		strlen(result.encoding) +
 		DOCUMENT_SIZE_CHARACTER_SIZE +
 		strlen(mediaInfo) +
@@ -633,6 +796,7 @@ handleRequestStage2(CSSClient client, struct HTTPRequest *request,
 
 	formattedBufSize = sprintf(buf, messageFormat,
 		HTTPStatus200OK,
+		connection,
 		result.encoding,
 		result.size,
 		mediaInfo,
@@ -647,7 +811,7 @@ handleRequestStage2(CSSClient client, struct HTTPRequest *request,
 	if (!ret)
 		return false;
 
-	ret = CSSWriteClient(client, result.data, result.size);
+	ret = CSSSendFile(client, result.fd, result.data, result.size);
 
-	return ret ? true : false;
+	return ret && !request->closeConnection;
 }
@@ -29,41 +29,124 @@
 
 #include "h2.h"
 
-#ifdef __FreeBSD__
-	#include <sys/endian.h>
-#else
-	#include <endian.h>
-#endif
-
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
+#include "base/global_state.h"
+#include "cache/cache.h"
+#include "core/load_shedding.h"
 #include "core/security.h"
-#include "http2/debugging.h"
+#include "http/request.h"
+#include "http/strings.h"
+#include "http2/frames/data.h"
+#include "http2/frames/goaway.h"
+#include "http2/frames/headers.h"
+#include "http2/frames/ping.h"
+#include "http2/frames/priority.h"
+#include "http2/frames/priority_update.h"
+#include "http2/frames/push_promise.h"
+#include "http2/frames/rst_stream.h"
 #include "http2/frames/settings.h"
+#include "http2/frames/window_update.h"
 #include "http2/frame.h"
+#include "http2/hpack.h"
+#include "http2/scheduler.h"
 #include "http2/session.h"
+#include "http2/settings.h"
+#include "http2/stream.h"
 #include "misc/default.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+/* The header block of a response, which easily fits the fields below */
+#define RESPONSE_BLOCK_SIZE 4096
+
+#define TIME_FORMAT "%a, %d %b %Y %T GMT"
+
+struct ResponseBlock {
+	uint8_t data[RESPONSE_BLOCK_SIZE];
+	size_t size;
+	/* Set when a field didn't fit, which desynchronizes the encoder */
+	bool isOverflowed;
+};
 
 const char HTTP2Preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
 
+static const char documentNotFound[] =
+	"<!doctype html>"
+	"<html>"
+	"<head>"
+	"<title>404 Not Found</title>"
+	"</head>"
+	"<body>"
+	"<h1>File Not Found</h1>"
+	"</body>"
+	"</html>";
+
+static const char documentServiceUnavailable[] =
+	"<!doctype html>"
+	"<html>"
+	"<head>"
+	"<title>503 Service Unavailable</title>"
+	"</head>"
+	"<body>"
+	"<h1>Service Unavailable</h1>"
+	"</body>"
+	"</html>";
+
 /* Prototypes */
 bool
 checkPreface(struct H2Session *);
 
+static uint32_t
+getInitialWindowSize(void);
+
+static bool
+handleRequest(struct H2Session *, struct H2Stream *, struct HTTPRequest *);
+
+static void
+destroySession(struct H2Session *);
+
 void CSHandleHTTP2(CSSClient client) {
 	bool (*frameHandlers[])(struct H2Session *, struct H2Frame *) = {
+		H2HandleData,
+		H2HandleHeaders,
+		H2HandlePriority,
+		H2HandleRstStream,
+		H2HandleSettings,
+		H2HandlePushPromise,
+		H2HandlePing,
+		H2HandleGoAway,
+		H2HandleWindowUpdate,
+		H2HandleContinuation,
+		NULL,
+		NULL,
 		NULL,
 		NULL,
 		NULL,
 		NULL,
-		H2HandleSettings
+		H2HandlePriorityUpdate
 	};
 
+	uint32_t windowSize = getInitialWindowSize();
+	bool isSending;
 	bool ret;
 	struct H2Session *session;
+	struct H2Setting settings[] = {
+		{ H2_SETTING_MAX_CONCURRENT_STREAMS, OMHTTP2MaxConcurrentStreams },
+		{ H2_SETTING_INITIAL_WINDOW_SIZE, windowSize },
+		{ H2_SETTING_MAX_HEADER_LIST_SIZE, OMHTTP2MaxHeaderListSize }
+	};
+
+	/* Requests are multiplexed, so they can't be told apart from early data
+	 * that might be replayed. */
+	if (!CSSCompleteHandshake(client))
+		return;
 
 	session = malloc(sizeof(*session));
 	if (session == NULL) {
@@ -73,42 +156,344 @@ void CSHandleHTTP2(CSSClient client) {
 	}
 
 	session->client = client;
+	session->inputStart = 0;
+	session->inputEnd = 0;
+	session->outputSliceCount = 0;
+	session->outputQueued = 0;
+	session->outputSize = 0;
+	session->error = H2_ERROR_NO_ERROR;
+	session->lastStream = 0;
+	session->isGoingAway = false;
+	session->headerBlock = NULL;
+	session->headerBlockSize = 0;
+	session->headerBlockCapacity = 0;
+	session->headerStream = 0;
+	session->hasHeaderPriority = false;
+	session->isHeaderSelfDependent = false;
+	session->virtualTime = 0;
+	session->isRFC7540Priority = false;
+	session->isRFC9218Priority = false;
+	session->pendingPriorityCount = 0;
+	session->requestHandler = handleRequest;
+	session->sendWindow = H2_DEFAULT_WINDOW_SIZE;
+	session->receiveWindow = windowSize;
+	session->receiveWindowSize = windowSize;
+	session->isBandwidthSampling = false;
+	session->bandwidthSample = 0;
+	session->remoteSettings.headerTableSize = HP_DEFAULT_TABLE_SIZE;
+	session->remoteSettings.enablePush = 1;
+	session->remoteSettings.maxConcurrentStreams = UINT32_MAX;
+	session->remoteSettings.initialWindowSize = H2_DEFAULT_WINDOW_SIZE;
+	session->remoteSettings.maxFrameSize = H2_DEFAULT_MAX_FRAME_SIZE;
+	session->remoteSettings.maxHeaderListSize = UINT32_MAX;
+	HPInitDecoder(&session->decoder);
+	HPInitEncoder(&session->encoder);
+
+	if (!H2InitStreams(session, OMHTTP2MaxConcurrentStreams)) {
+		fputs(ANSI_COLOR_RED"[H2] Failed to allocate the stream table"
+			  ANSI_COLOR_RESETLN, stderr);
+		destroySession(session);
+		return;
+	}
 
 	if (!checkPreface(session)) {
-		free(session);
+		destroySession(session);
 		fputs(ANSI_COLOR_RED"[H2] Preface comparison failed"ANSI_COLOR_RESETLN,
 			  stderr);
 		return;
 	}
 
-	/* Server preface = (potentially empty) settings frame */
-	if (!H2SendSettings(session, NULL, 0)) {
+	/* Server preface = settings frame. The window of the connection can't
+	 * be set with SETTINGS, so it is enlarged right away. */
+	if (!H2SendSettings(session, settings,
+						sizeof(settings) / sizeof(settings[0]))
+		|| (windowSize > H2_DEFAULT_WINDOW_SIZE
+			&& !H2SendWindowUpdate(session, 0,
+								   windowSize - H2_DEFAULT_WINDOW_SIZE))) {
 		fputs(ANSI_COLOR_RED"[H2] Failed to send settings"ANSI_COLOR_RESETLN,
 			  stderr);
+		destroySession(session);
 		return;
 	}
 
 	while (true) {
-		if (!H2ReadFrame(session, &session->frameBuffer))
+		/* Incoming frames take precedence over sending DATA, so resets and
+		 * window updates are applied as early as possible. Without data to
+		 * send, the connection is idle and waits for the client, after
+		 * sending what is queued. */
+		isSending = H2HasStreamData(session);
+		if (!isSending && !H2FlushOutput(session))
+			break;
+
+		if (session->isGoingAway && session->streamCount == 0) {
+			H2SendGoAway(session, H2_ERROR_NO_ERROR);
 			break;
+		}
+
+		if (!H2IsFrameBuffered(session) && !CSSWaitClient(client,
+				isSending ? 0 : OMKeepAliveTimeout * 1000)) {
+			if (!isSending) {
+				H2SendGoAway(session, H2_ERROR_NO_ERROR);
+				break;
+			}
 
-		if (session->frameBuffer.type
+			if (!H2SendStreamData(session))
+				break;
+			continue;
+		}
+
+		if (!H2ReadFrame(session, &session->frameBuffer)) {
+			if (session->error != H2_ERROR_NO_ERROR)
+				H2SendGoAway(session, session->error);
+			break;
+		}
+
+		/* A header block can only be continued by CONTINUATION frames of the
+		 * same stream (RFC 7540 § 6.10). */
+		if ((session->headerStream != 0) != (session->frameBuffer.type
+				== H2_FRAME_CONTINUATION)
+			|| (session->headerStream != 0 && session->frameBuffer.stream
+				!= session->headerStream)) {
+			session->error = H2_ERROR_PROTOCOL_ERROR;
+			ret = false;
+		} else if (session->frameBuffer.type
 				< sizeof(frameHandlers) / sizeof(frameHandlers[0])
 			&& frameHandlers[session->frameBuffer.type] != NULL) {
 			ret = frameHandlers[session->frameBuffer.type](session,
 													 &session->frameBuffer);
+		} else {
+			/* Unknown and extension frames are ignored (RFC 7540 § 4.1) */
+			ret = true;
+		}
 
-			if (!ret) {
-				/* TODO */
-			}
-		} else
-			printf(ANSI_COLOR_YELLOW"W: Ignored Frame %s"ANSI_COLOR_RESETLN,
-				   H2DFrameTypeNames[session->frameBuffer.type]);
+		if (!ret) {
+			H2SendGoAway(session, session->error);
+			break;
+		}
+	}
+
+	/* A GOAWAY frame can still be queued */
+	H2FlushOutput(session);
+	destroySession(session);
+}
+
+static void
+formatDate(char *buffer, size_t size, time_t time) {
+	struct tm brokenDownTime;
+
+	gmtime_r(&time, &brokenDownTime);
+	strftime(buffer, size, TIME_FORMAT, &brokenDownTime);
+}
+
+/**
+ * The receive windows are shared by the connection and its streams, so they
+ * can't start below the initial window of the connection.
+ */
+static uint32_t
+getInitialWindowSize(void) {
+	size_t size = OMHTTP2InitialReceiveWindow;
+
+	if (size > OMHTTP2MaxReceiveWindow)
+		size = OMHTTP2MaxReceiveWindow;
+	if (size > H2_MAX_WINDOW_SIZE)
+		size = H2_MAX_WINDOW_SIZE;
+	if (size < H2_DEFAULT_WINDOW_SIZE)
+		size = H2_DEFAULT_WINDOW_SIZE;
+	return size;
+}
+
+static void
+addField(struct H2Session *session, struct ResponseBlock *block,
+		 const char *name, const char *value, enum HPIndexing indexing) {
+	size_t size;
+
+	if (block->isOverflowed)
+		return;
+
+	size = HPEncode(&session->encoder, block->data + block->size,
+					sizeof(block->data) - block->size, name, strlen(name),
+					value, strlen(value), indexing);
+	if (size == 0)
+		block->isOverflowed = true;
+	block->size += size;
+}
 
-		/* TODO: The frameBuffer payload is literally re-malloc'ed, maybe use a
-		 * size_t + realloc solution? */
-		free(session->frameBuffer.payload);
+/* The fields every response ends with. They never change, so they are indexed
+ * and cost a single octet after the first response. */
+static void
+addCommonFields(struct H2Session *session, struct ResponseBlock *block) {
+	addField(session, block, "referrer-policy", "no-referrer",
+			 HP_INDEXING_INCREMENTAL);
+	addField(session, block, "server", GSServerProductName,
+			 HP_INDEXING_INCREMENTAL);
+	addField(session, block, "strict-transport-security", "max-age=31536000",
+			 HP_INDEXING_INCREMENTAL);
+	addField(session, block, "x-content-type-options", "nosniff",
+			 HP_INDEXING_INCREMENTAL);
+}
+
+static bool
+sendBlock(struct H2Session *session, struct H2Stream *stream,
+		  struct ResponseBlock *block, bool isEndStream) {
+	if (block->isOverflowed) {
+		session->error = H2_ERROR_INTERNAL_ERROR;
+		return false;
+	}
+
+	if (!H2SendHeaders(session, stream->id, block->data, block->size,
+					   isEndStream))
+		return false;
+
+	if (isEndStream)
+		H2TransitionStream(session, stream, H2_STREAM_EVENT_SEND_END);
+	return true;
+}
+
+/**
+ * Sends the header block of a response and queues its body. The body has to
+ * outlive the stream, which holds for both cached files and static documents.
+ */
+static bool
+sendResponse(struct H2Session *session, struct H2Stream *stream,
+			 struct ResponseBlock *block, const char *data, size_t size,
+			 bool isHead) {
+	bool isEndStream = isHead || size == 0;
+
+	stream->data = data;
+	stream->remaining = isEndStream ? 0 : size;
+	return sendBlock(session, stream, block, isEndStream);
+}
+
+static bool
+sendDocument(struct H2Session *session, struct H2Stream *stream,
+			 const char *status, const char *document, size_t size,
+			 bool isHead) {
+	struct ResponseBlock block = { .size = 0, .isOverflowed = false };
+	char date[32];
+	char length[24];
+
+	formatDate(date, sizeof(date), time(NULL));
+	snprintf(length, sizeof(length), "%zu", size);
+
+	addField(session, &block, ":status", status, HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "content-length", length, HP_INDEXING_NONE);
+	addField(session, &block, "content-type", "text/html;charset=utf-8",
+			 HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "date", date, HP_INDEXING_NONE);
+	addCommonFields(session, &block);
+
+	return sendResponse(session, stream, &block, document, size, isHead);
+}
+
+/**
+ * The HTTP/2 equivalent of shedding in HTTP/1.1. Only the stream is refused,
+ * since the connection itself costs little to keep.
+ */
+static bool
+shedRequest(struct H2Session *session, struct H2Stream *stream,
+			bool isHead) {
+	struct ResponseBlock block = { .size = 0, .isOverflowed = false };
+	char length[24];
+	char retryAfter[24];
+
+	SMAddCounter(SMC_LOAD_SHED_REQUESTS, 1);
+
+	snprintf(length, sizeof(length), "%zu",
+			 sizeof(documentServiceUnavailable) - 1);
+	snprintf(retryAfter, sizeof(retryAfter), "%zu", OMLoadSheddingRetryAfter);
+
+	addField(session, &block, ":status", "503", HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "content-length", length,
+			 HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "content-type", "text/html;charset=utf-8",
+			 HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "retry-after", retryAfter,
+			 HP_INDEXING_INCREMENTAL);
+	addCommonFields(session, &block);
+
+	return sendResponse(session, stream, &block, documentServiceUnavailable,
+						sizeof(documentServiceUnavailable) - 1, isHead);
+}
+
+/**
+ * Sends a '103 Early Hints' response for the resources of an HTML document.
+ * The list of links is skipped if it takes up too much of the header block.
+ */
+static bool
+sendEarlyHints(struct H2Session *session, struct H2Stream *stream,
+			   const char *link) {
+	struct ResponseBlock block = { .size = 0, .isOverflowed = false };
+
+	if (strlen(link) > RESPONSE_BLOCK_SIZE / 2)
+		return true;
+
+	addField(session, &block, ":status", "103", HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "link", link, HP_INDEXING_INCREMENTAL);
+	return sendBlock(session, stream, &block, false);
+}
+
+static bool
+handleRequest(struct H2Session *session, struct H2Stream *stream,
+			  struct HTTPRequest *request) {
+	struct ResponseBlock block = { .size = 0, .isOverflowed = false };
+	char date[32];
+	bool isHead;
+	char lastModified[32];
+	char length[24];
+	char mediaInfo[128];
+	struct FCResult result;
+	size_t i;
+
+	SMAddCounter(SMC_HTTP_REQUESTS, 1);
+
+	isHead = strcmp(request->method, "HEAD") == 0;
+	if (LSShouldShed())
+		return shedRequest(session, stream, isHead);
+
+	if (!FCLookup(request->path, &result, FCF_BROTLI | FCF_GZIP))
+		return sendDocument(session, stream, "404", documentNotFound,
+							sizeof(documentNotFound) - 1, isHead);
+
+	formatDate(date, sizeof(date), time(NULL));
+	formatDate(lastModified, sizeof(lastModified), result.modificationDate);
+
+	for (i = 0; i < request->headerCount; i++) {
+		if (strcasecmp(request->headers[i].name, "if-modified-since") == 0
+			&& strcmp(request->headers[i].value, lastModified) == 0) {
+			addField(session, &block, ":status", "304",
+					 HP_INDEXING_INCREMENTAL);
+			addField(session, &block, "date", date, HP_INDEXING_NONE);
+			addCommonFields(session, &block);
+			return sendBlock(session, stream, &block, true);
+		}
 	}
+
+	if (result.earlyHintsLink != NULL
+		&& !sendEarlyHints(session, stream, result.earlyHintsLink))
+		return false;
+
+	if (result.mediaCharset != NULL)
+		snprintf(mediaInfo, sizeof(mediaInfo), "%s;charset=%s",
+				 result.mediaType, result.mediaCharset);
+	else
+		snprintf(mediaInfo, sizeof(mediaInfo), "%s", result.mediaType);
+	snprintf(length, sizeof(length), "%zu", result.size);
+
+	addField(session, &block, ":status", "200", HP_INDEXING_INCREMENTAL);
+	if (result.encoding != MTE_none)
+		addField(session, &block, "content-encoding", result.encoding,
+				 HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "content-length", length, HP_INDEXING_NONE);
+	addField(session, &block, "content-type", mediaInfo,
+			 HP_INDEXING_INCREMENTAL);
+	addField(session, &block, "date", date, HP_INDEXING_NONE);
+	addField(session, &block, "last-modified", lastModified,
+			 HP_INDEXING_INCREMENTAL);
+	addCommonFields(session, &block);
+
+	H2SetDefaultPriority(stream, result.mediaType);
+	return sendResponse(session, stream, &block, result.data, result.size,
+						isHead);
 }
 
 bool
@@ -120,3 +505,12 @@ checkPreface(struct H2Session *session) {
 
 	return memcmp(buf, HTTP2Preface, 24) == 0;
 }
+
+static void
+destroySession(struct H2Session *session) {
+	HPDestroyDecoder(&session->decoder);
+	HPDestroyEncoder(&session->encoder);
+	H2DestroyStreams(session);
+	free(session->headerBlock);
+	free(session);
+}
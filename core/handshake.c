@@ -0,0 +1,212 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "handshake.h"
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/load_shedding.h"
+#include "core/security.h"
+#include "misc/io.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+/**
+ * Handshakes waiting for the crypto pool get a longer deadline, since a busy
+ * pool isn't the fault of the client. They aren't exempted though, so a stuck
+ * crypto thread can't keep the handshake slots occupied forever.
+ */
+#define HS_ASYNC_TIMEOUT_FACTOR 3
+
+/* Returns the amount of microseconds since 'begin'. */
+static uint64_t
+getElapsed(const struct timespec *begin) {
+	struct timespec now;
+	int64_t elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	elapsed = (int64_t) (now.tv_sec - begin->tv_sec) * 1000000 +
+			  (now.tv_nsec - begin->tv_nsec) / 1000;
+	return elapsed < 0 ? 0 : (uint64_t) elapsed;
+}
+
+static void
+abortHandshake(CSSClient client, int sockfd) {
+	CSSDestroyClient(client);
+	close(sockfd);
+}
+
+/**
+ * Continues the handshake. Returns true if it has finished, successfully or
+ * not, in which case it is no longer owned by the queue.
+ */
+static bool
+continueHandshake(struct HSQueue *queue, struct HSHandshake *handshake) {
+	uint64_t elapsed;
+
+	handshake->status = CSSContinueHandshake(handshake->client);
+	switch (handshake->status) {
+		case CSSHS_WANT_ASYNC:
+			/* Without a file descriptor, the handshake would never be woken
+			 * up. */
+			if (CSSGetAsyncFD(handshake->client) != -1)
+				return false;
+			SMAddCounter(SMC_TLS_HANDSHAKES_FAILED, 1);
+			abortHandshake(handshake->client, handshake->sockfd);
+			return true;
+		case CSSHS_WANT_READ:
+		case CSSHS_WANT_WRITE:
+			return false;
+		case CSSHS_ERROR:
+			SMAddCounter(SMC_TLS_HANDSHAKES_FAILED, 1);
+			abortHandshake(handshake->client, handshake->sockfd);
+			return true;
+		case CSSHS_DONE:
+			break;
+	}
+
+	elapsed = getElapsed(&handshake->begin);
+	SMAddCounter(SMC_TLS_HANDSHAKE_MICROSECONDS, elapsed);
+	LSNotifyHandshake(&handshake->begin);
+
+	queue->callback(handshake->client, handshake->sockfd);
+	return true;
+}
+
+void
+HSDestroy(struct HSQueue *queue) {
+	size_t i;
+
+	for (i = 0; i < queue->count; i++)
+		abortHandshake(queue->handshakes[i].client,
+					   queue->handshakes[i].sockfd);
+
+	free(queue->handshakes);
+	queue->handshakes = NULL;
+	queue->count = 0;
+}
+
+bool
+HSInit(struct HSQueue *queue, size_t capacity, HSCallback callback) {
+	queue->handshakes = calloc(capacity, sizeof(struct HSHandshake));
+	queue->capacity = capacity;
+	queue->count = 0;
+	queue->callback = callback;
+	return queue->handshakes != NULL;
+}
+
+size_t
+HSPreparePoll(const struct HSQueue *queue, struct pollfd *pollInfo) {
+	size_t i;
+
+	for (i = 0; i < queue->count; i++) {
+		const struct HSHandshake *handshake;
+
+		handshake = &queue->handshakes[i];
+		if (handshake->status == CSSHS_WANT_ASYNC)
+			pollInfo[i].fd = CSSGetAsyncFD(handshake->client);
+		else
+			pollInfo[i].fd = handshake->sockfd;
+
+		pollInfo[i].events = handshake->status == CSSHS_WANT_WRITE
+			? POLLOUT : POLLIN;
+		pollInfo[i].revents = 0;
+	}
+
+	return queue->count;
+}
+
+void
+HSProcess(struct HSQueue *queue, const struct pollfd *pollInfo) {
+	uint64_t timeout;
+	uint64_t asyncTimeout;
+	size_t i;
+
+	timeout = (uint64_t) OMSHandshakeTimeout * 1000;
+	asyncTimeout = timeout * HS_ASYNC_TIMEOUT_FACTOR;
+
+	/* Iterating backwards, a finished handshake can be replaced by the last
+	 * one, which has already been processed. */
+	for (i = queue->count; i-- > 0;) {
+		struct HSHandshake *handshake;
+		bool hasFinished;
+
+		handshake = &queue->handshakes[i];
+
+		/* The task of a paused job stays valid after the job is abandoned,
+		 * see the crypto pool, so those handshakes can time out as well. */
+		if (pollInfo[i].revents != 0) {
+			hasFinished = continueHandshake(queue, handshake);
+		} else if (getElapsed(&handshake->begin) >=
+				   (handshake->status == CSSHS_WANT_ASYNC ? asyncTimeout
+														  : timeout)) {
+			SMAddCounter(SMC_TLS_HANDSHAKES_TIMED_OUT, 1);
+			abortHandshake(handshake->client, handshake->sockfd);
+			hasFinished = true;
+		} else {
+			hasFinished = false;
+		}
+
+		if (hasFinished) {
+			queue->count -= 1;
+			*handshake = queue->handshakes[queue->count];
+		}
+	}
+}
+
+bool
+HSSubmit(struct HSQueue *queue, int sockfd) {
+	struct HSHandshake *handshake;
+
+	if (queue->count == queue->capacity)
+		return false;
+
+	if (!IOSetNonBlocking(sockfd, true))
+		return false;
+
+	handshake = &queue->handshakes[queue->count];
+	handshake->client = CSSCreateClient(sockfd);
+	if (handshake->client == NULL)
+		return false;
+
+	handshake->sockfd = sockfd;
+	clock_gettime(CLOCK_MONOTONIC, &handshake->begin);
+
+	/* The ClientHello has usually arrived already. */
+	if (!continueHandshake(queue, handshake))
+		queue->count += 1;
+
+	return true;
+}
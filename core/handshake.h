@@ -0,0 +1,106 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * HS is an abbreviation for Handshake Service.
+ *
+ * TLS handshakes take at least one round trip, during which a worker thread
+ * would be blocked. Instead, handshakes are driven by the event loop of the
+ * core service using non-blocking sockets, and a worker thread is only
+ * assigned once the handshake has completed.
+ */
+
+#ifndef CORE_HANDSHAKE_H
+#define CORE_HANDSHAKE_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "core/security.h"
+
+/**
+ * Called when a handshake has completed. The socket is still non-blocking,
+ * and the ownership of the client and the socket is passed to the callback.
+ */
+typedef void (*HSCallback) (CSSClient, int);
+
+struct HSHandshake {
+	CSSClient	 client;
+	int			 sockfd;
+	/* CSSHS_WANT_READ, CSSHS_WANT_WRITE or CSSHS_WANT_ASYNC. */
+	enum CSSHandshakeStatus status;
+	/* The (CLOCK_MONOTONIC) time at which the connection was accepted. */
+	struct timespec begin;
+};
+
+struct HSQueue {
+	struct HSHandshake	*handshakes;
+	size_t				 capacity;
+	size_t				 count;
+	HSCallback			 callback;
+};
+
+/* Aborts the pending handshakes and frees the queue. */
+void
+HSDestroy(struct HSQueue *);
+
+/**
+ * Parameters:
+ * struct HSQueue *	the queue to initialize
+ * size_t			the maximum amount of pending handshakes
+ * HSCallback		the callback for completed handshakes
+ */
+bool
+HSInit(struct HSQueue *, size_t, HSCallback);
+
+/**
+ * Stores the events to wait for, one pollfd per pending handshake, in the
+ * array, which must have room for 'count' entries. Returns the amount of
+ * entries written.
+ */
+size_t
+HSPreparePoll(const struct HSQueue *, struct pollfd *);
+
+/**
+ * Continues the handshakes of which the sockets are ready, according to the
+ * array filled by HSPreparePoll() and then passed to poll(). Handshakes that
+ * have failed or timed out are aborted.
+ */
+void
+HSProcess(struct HSQueue *, const struct pollfd *);
+
+/**
+ * Starts the handshake of a newly accepted connection. Returns false if the
+ * queue is full or the client couldn't be created, in which case the caller
+ * should close the socket.
+ */
+bool
+HSSubmit(struct HSQueue *, int);
+
+#endif /* CORE_HANDSHAKE_H */
@@ -0,0 +1,116 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "load_shedding.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "base/global_state.h"
+#include "misc/options.h"
+
+/**
+ * The averages are exponentially weighted moving averages, where every new
+ * sample has a weight of 1/8. They are updated without locks; losing a sample
+ * when two threads race isn't a problem for an average.
+ */
+#define LS_AVERAGE_SHIFT 3
+
+static atomic_uint_least64_t LSHandshakeLatency;
+static atomic_uint_least64_t LSQueueWait;
+static atomic_bool LSShedding;
+
+/* Returns the amount of microseconds since 'begin'. */
+static uint64_t
+getElapsed(const struct timespec *begin) {
+	struct timespec now;
+	int64_t elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	elapsed = (int64_t) (now.tv_sec - begin->tv_sec) * 1000000 +
+			  (now.tv_nsec - begin->tv_nsec) / 1000;
+	return elapsed < 0 ? 0 : (uint64_t) elapsed;
+}
+
+static void
+updateAverage(atomic_uint_least64_t *average, uint64_t sample) {
+	uint64_t value;
+
+	value = atomic_load_explicit(average, memory_order_relaxed);
+	value = value - (value >> LS_AVERAGE_SHIFT) + (sample >> LS_AVERAGE_SHIFT);
+	atomic_store_explicit(average, value, memory_order_relaxed);
+}
+
+void
+LSNotifyHandshake(const struct timespec *begin) {
+	updateAverage(&LSHandshakeLatency, getElapsed(begin));
+}
+
+void
+LSNotifyQueueWait(const struct timespec *begin) {
+	updateAverage(&LSQueueWait, getElapsed(begin));
+}
+
+/* Checks if any of the metrics is above 'percentage' of its threshold. */
+static bool
+isOverloaded(unsigned int percentage) {
+	uint64_t handshake;
+	uint64_t queue;
+
+	handshake = atomic_load_explicit(&LSHandshakeLatency,
+									 memory_order_relaxed);
+	queue = atomic_load_explicit(&LSQueueWait, memory_order_relaxed);
+
+	return GSGetChildThreadOccupancy() * 100 >=
+			OMLoadSheddingOccupancy * percentage ||
+		   handshake * 100 >= OMLoadSheddingHandshakeLatency * percentage ||
+		   queue * 100 >= OMLoadSheddingQueueWait * percentage;
+}
+
+bool
+LSShouldShed(void) {
+	bool shedding;
+
+	if (!OMLoadSheddingEnabled)
+		return false;
+
+	/* To prevent flapping between the two states, shedding only stops when
+	 * all metrics are comfortably below their thresholds. */
+	shedding = atomic_load_explicit(&LSShedding, memory_order_relaxed);
+	if (shedding)
+		shedding = isOverloaded(OMLoadSheddingRecoveryPercentage);
+	else
+		shedding = isOverloaded(100);
+
+	atomic_store_explicit(&LSShedding, shedding, memory_order_relaxed);
+	return shedding;
+}
@@ -0,0 +1,54 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LS is an abbreviation for Load Shedding.
+ *
+ * The load shedding controller decides whether new requests should be
+ * answered with a '503 Service Unavailable' instead of being served. It keeps
+ * track of the occupancy of the worker threads, the time connections wait for
+ * a worker thread, and the duration of TLS handshakes.
+ */
+
+#ifndef CORE_LOAD_SHEDDING_H
+#define CORE_LOAD_SHEDDING_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/* The parameter is the (CLOCK_MONOTONIC) time the handshake began. */
+void
+LSNotifyHandshake(const struct timespec *);
+
+/* The parameter is the (CLOCK_MONOTONIC) time the connection was queued. */
+void
+LSNotifyQueueWait(const struct timespec *);
+
+bool
+LSShouldShed(void);
+
+#endif /* CORE_LOAD_SHEDDING_H */
@@ -0,0 +1,537 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "resumption.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+#include "misc/default.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+#define SR_SHARD_COUNT 16
+#define SR_SECRET_SIZE 32
+#define SR_TICKET_NAME_SIZE 16
+#define SR_TICKET_KEY_SIZE 32
+#define SR_REPLAY_BUCKETS 1024
+#define SR_REPLAY_WAYS 4
+
+struct SRSession {
+	time_t			 expires;
+	unsigned char	 id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	unsigned int	 idLength;
+	unsigned char	*data;
+	size_t			 dataLength;
+};
+
+/* Every shard has its own lock, so handshakes rarely contend. */
+struct SRShard {
+	pthread_mutex_t	 mutex;
+	struct SRSession *sessions;
+};
+
+/**
+ * The key that encrypts the tickets during an epoch. Tickets of the previous
+ * epoch are still accepted (and renewed), so a ticket is valid for at least
+ * one and at most two epochs.
+ */
+struct SRTicketKey {
+	uint64_t		 epoch;
+	unsigned char	 name[SR_TICKET_NAME_SIZE];
+	unsigned char	 aesKey[SR_TICKET_KEY_SIZE];
+	unsigned char	 hmacKey[SR_TICKET_KEY_SIZE];
+};
+
+/* A ClientHello with early data, identified by its random. */
+struct SRReplayEntry {
+	unsigned char	 random[SSL3_RANDOM_SIZE];
+	time_t			 seen;
+};
+
+static struct SRShard SRShards[SR_SHARD_COUNT];
+static size_t SRShardSize;
+
+static unsigned char SRSecret[SR_SECRET_SIZE];
+static pthread_mutex_t SRTicketKeysMutex = PTHREAD_MUTEX_INITIALIZER;
+/* The key of the current epoch, and of the previous epoch. */
+static struct SRTicketKey SRTicketKeys[2];
+static bool SRTicketKeysDerived = false;
+
+/**
+ * The anti-replay window is a set-associative table of recently seen
+ * ClientHellos. When every entry in a bucket is still inside the window, new
+ * early data is rejected; the client then simply sends its request after the
+ * handshake.
+ */
+static pthread_mutex_t SRReplayMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct SRReplayEntry SRReplayWindow[SR_REPLAY_BUCKETS][SR_REPLAY_WAYS];
+
+/* FNV-1a, session IDs are random anyway. */
+static uint64_t
+hashID(const unsigned char *id, unsigned int length) {
+	uint64_t hash;
+	unsigned int i;
+
+	hash = 0xcbf29ce484222325ULL;
+	for (i = 0; i < length; i++) {
+		hash ^= id[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * The session cache is direct-mapped: every ID has exactly one slot, and a
+ * newer session simply replaces the older one. This keeps the cache bounded
+ * without any bookkeeping.
+ */
+static struct SRSession *
+findSlot(const unsigned char *id, unsigned int length, struct SRShard **shard) {
+	uint64_t hash;
+
+	hash = hashID(id, length);
+	*shard = &SRShards[hash % SR_SHARD_COUNT];
+	return &(*shard)->sessions[(hash / SR_SHARD_COUNT) % SRShardSize];
+}
+
+static int
+newSessionCallback(SSL *ssl, SSL_SESSION *session) {
+	unsigned char *data;
+	int dataLength;
+	const unsigned char *id;
+	unsigned int idLength;
+	struct SRShard *shard;
+	struct SRSession *slot;
+	unsigned char *writer;
+
+	UNUSED(ssl);
+
+	id = SSL_SESSION_get_id(session, &idLength);
+	if (idLength == 0)
+		return 0;
+
+	dataLength = i2d_SSL_SESSION(session, NULL);
+	if (dataLength <= 0)
+		return 0;
+
+	data = malloc(dataLength);
+	if (data == NULL)
+		return 0;
+
+	writer = data;
+	i2d_SSL_SESSION(session, &writer);
+
+	slot = findSlot(id, idLength, &shard);
+	pthread_mutex_lock(&shard->mutex);
+	{
+		free(slot->data);
+		slot->data = data;
+		slot->dataLength = dataLength;
+		slot->expires = time(NULL) + SSL_SESSION_get_timeout(session);
+		memcpy(slot->id, id, idLength);
+		slot->idLength = idLength;
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	/* The session was serialized, so no reference is kept. */
+	return 0;
+}
+
+static SSL_SESSION *
+getSessionCallback(SSL *ssl, const unsigned char *id, int idLength,
+				   int *copy) {
+	struct SRShard *shard;
+	SSL_SESSION *session;
+	struct SRSession *slot;
+
+	UNUSED(ssl);
+
+	*copy = 0;
+	session = NULL;
+
+	slot = findSlot(id, idLength, &shard);
+	pthread_mutex_lock(&shard->mutex);
+	{
+		if (slot->data != NULL && slot->idLength == (unsigned int) idLength &&
+			memcmp(slot->id, id, idLength) == 0 &&
+			slot->expires > time(NULL)) {
+			const unsigned char *reader;
+
+			reader = slot->data;
+			session = d2i_SSL_SESSION(NULL, &reader, slot->dataLength);
+		}
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	SMAddCounter(session == NULL ? SMC_TLS_SESSION_CACHE_MISSES
+								 : SMC_TLS_SESSION_CACHE_HITS, 1);
+	return session;
+}
+
+static void
+removeSessionCallback(SSL_CTX *context, SSL_SESSION *session) {
+	const unsigned char *id;
+	unsigned int idLength;
+	struct SRShard *shard;
+	struct SRSession *slot;
+
+	UNUSED(context);
+
+	id = SSL_SESSION_get_id(session, &idLength);
+	if (idLength == 0)
+		return;
+
+	slot = findSlot(id, idLength, &shard);
+	pthread_mutex_lock(&shard->mutex);
+	{
+		if (slot->idLength == idLength && memcmp(slot->id, id, idLength) == 0) {
+			free(slot->data);
+			slot->data = NULL;
+			slot->idLength = 0;
+		}
+	}
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/* Derives the name and keys of an epoch from the secret using HKDF. */
+static bool
+deriveTicketKey(uint64_t epoch, struct SRTicketKey *key) {
+	EVP_PKEY_CTX *context;
+	unsigned char info[14] = "ticket";
+	unsigned char output[SR_TICKET_NAME_SIZE + 2 * SR_TICKET_KEY_SIZE];
+	size_t outputLength;
+	size_t i;
+	bool ret;
+
+	for (i = 0; i < 8; i++)
+		info[6 + i] = (unsigned char) (epoch >> (56 - 8 * i));
+
+	context = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+	if (context == NULL)
+		return false;
+
+	outputLength = sizeof(output);
+	ret = EVP_PKEY_derive_init(context) > 0 &&
+		  EVP_PKEY_CTX_set_hkdf_md(context, EVP_sha256()) > 0 &&
+		  EVP_PKEY_CTX_set1_hkdf_key(context, SRSecret, SR_SECRET_SIZE) > 0 &&
+		  EVP_PKEY_CTX_add1_hkdf_info(context, info, sizeof(info)) > 0 &&
+		  EVP_PKEY_derive(context, output, &outputLength) > 0;
+	EVP_PKEY_CTX_free(context);
+
+	if (!ret)
+		return false;
+
+	key->epoch = epoch;
+	memcpy(key->name, output, SR_TICKET_NAME_SIZE);
+	memcpy(key->aesKey, output + SR_TICKET_NAME_SIZE, SR_TICKET_KEY_SIZE);
+	memcpy(key->hmacKey, output + SR_TICKET_NAME_SIZE + SR_TICKET_KEY_SIZE,
+		   SR_TICKET_KEY_SIZE);
+	OPENSSL_cleanse(output, sizeof(output));
+	return true;
+}
+
+/* Rotates the keys if a new epoch has begun. The mutex must be held. */
+static bool
+rotateTicketKeys(void) {
+	uint64_t epoch;
+
+	epoch = (uint64_t) time(NULL) / OMSTicketKeyLifetime;
+	if (SRTicketKeysDerived && SRTicketKeys[0].epoch == epoch)
+		return true;
+
+	if (SRTicketKeysDerived && SRTicketKeys[0].epoch + 1 == epoch)
+		SRTicketKeys[1] = SRTicketKeys[0];
+	else if (!deriveTicketKey(epoch - 1, &SRTicketKeys[1]))
+		return false;
+
+	SRTicketKeysDerived = deriveTicketKey(epoch, &SRTicketKeys[0]);
+	return SRTicketKeysDerived;
+}
+
+static int
+ticketKeyCallback(SSL *ssl, unsigned char name[SR_TICKET_NAME_SIZE],
+				  unsigned char *iv, EVP_CIPHER_CTX *cipherContext,
+				  EVP_MAC_CTX *macContext, int encrypt) {
+	OSSL_PARAM parameters[3];
+	struct SRTicketKey key;
+	int ret;
+
+	UNUSED(ssl);
+
+	pthread_mutex_lock(&SRTicketKeysMutex);
+	{
+		if (!rotateTicketKeys()) {
+			ret = -1;
+		} else if (encrypt) {
+			key = SRTicketKeys[0];
+			ret = 1;
+		} else if (memcmp(name, SRTicketKeys[0].name,
+						  SR_TICKET_NAME_SIZE) == 0) {
+			key = SRTicketKeys[0];
+			ret = 1;
+		} else if (memcmp(name, SRTicketKeys[1].name,
+						  SR_TICKET_NAME_SIZE) == 0) {
+			/* Valid, but the client should get a ticket with the new key. */
+			key = SRTicketKeys[1];
+			ret = 2;
+		} else {
+			/* Unknown or expired key, fall back to a full handshake. */
+			ret = 0;
+		}
+	}
+	pthread_mutex_unlock(&SRTicketKeysMutex);
+
+	if (ret <= 0)
+		return ret;
+
+	parameters[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+		key.hmacKey, SR_TICKET_KEY_SIZE);
+	parameters[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+		(char *) "SHA256", 0);
+	parameters[2] = OSSL_PARAM_construct_end();
+
+	if (encrypt) {
+		memcpy(name, key.name, SR_TICKET_NAME_SIZE);
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0 ||
+			!EVP_EncryptInit_ex(cipherContext, EVP_aes_256_cbc(), NULL,
+								key.aesKey, iv))
+			ret = -1;
+	} else if (!EVP_DecryptInit_ex(cipherContext, EVP_aes_256_cbc(), NULL,
+								   key.aesKey, iv)) {
+		ret = -1;
+	}
+
+	if (ret != -1 && !EVP_MAC_CTX_set_params(macContext, parameters))
+		ret = -1;
+
+	if (ret == 2)
+		SMAddCounter(SMC_TLS_TICKETS_RENEWED, 1);
+
+	OPENSSL_cleanse(&key, sizeof(key));
+	return ret;
+}
+
+static int
+allowEarlyDataCallback(SSL *ssl, void *argument) {
+	struct SRReplayEntry *bucket;
+	struct SRReplayEntry *slot;
+	size_t i;
+	time_t now;
+	unsigned char random[SSL3_RANDOM_SIZE];
+	bool result;
+
+	UNUSED(argument);
+
+	if (SSL_get_client_random(ssl, random, SSL3_RANDOM_SIZE) !=
+		SSL3_RANDOM_SIZE)
+		return 0;
+
+	bucket = SRReplayWindow[hashID(random, SSL3_RANDOM_SIZE) %
+							SR_REPLAY_BUCKETS];
+	now = time(NULL);
+	slot = NULL;
+	result = true;
+
+	pthread_mutex_lock(&SRReplayMutex);
+	{
+		for (i = 0; i < SR_REPLAY_WAYS; i++) {
+			if (bucket[i].seen + OMSEarlyDataReplayWindow < now) {
+				slot = &bucket[i];
+			} else if (memcmp(bucket[i].random, random,
+							  SSL3_RANDOM_SIZE) == 0) {
+				result = false;
+				break;
+			}
+		}
+
+		if (result && slot != NULL) {
+			memcpy(slot->random, random, SSL3_RANDOM_SIZE);
+			slot->seen = now;
+		} else {
+			result = false;
+		}
+	}
+	pthread_mutex_unlock(&SRReplayMutex);
+
+	if (!result)
+		SMAddCounter(SMC_TLS_EARLY_DATA_REPLAYED, 1);
+	return result;
+}
+
+/**
+ * Loads the ticket key secret from OMSTicketKeyFile. Without a file, a random
+ * secret is generated, which means tickets are only valid for this process.
+ */
+static bool
+loadSecret(void) {
+	FILE *file;
+	size_t size;
+
+	if (OMSTicketKeyFile == NULL)
+		return RAND_priv_bytes(SRSecret, SR_SECRET_SIZE) > 0;
+
+	file = fopen(OMSTicketKeyFile, "rb");
+	if (file == NULL) {
+		perror(ANSI_COLOR_RED"[Resumption::loadSecret] Failed to open the "
+			   "ticket key file"ANSI_COLOR_RESET);
+		return false;
+	}
+
+	size = fread(SRSecret, 1, SR_SECRET_SIZE, file);
+	fclose(file);
+
+	if (size != SR_SECRET_SIZE) {
+		fprintf(stderr, ANSI_COLOR_RED"[Resumption::loadSecret] The ticket "
+				"key file should contain at least %i octets."
+				ANSI_COLOR_RESETLN, SR_SECRET_SIZE);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+SRConfigureContext(SSL_CTX *context) {
+	SSL_CTX_set_timeout(context, OMSSessionLifetime);
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+	/* Most clients close the connection without a close_notify, which
+	 * OpenSSL 3 treats as an error that removes the session from the cache.
+	 * Truncation attacks don't apply to HTTP, since messages are delimited. */
+	SSL_CTX_set_options(context, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+	if (OMSSessionCacheSize == 0) {
+		SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+	} else {
+		/* OpenSSL's internal cache is a single locked hash table, so ours
+		 * replaces it. */
+		SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER |
+			SSL_SESS_CACHE_NO_INTERNAL | SSL_SESS_CACHE_NO_AUTO_CLEAR);
+		SSL_CTX_sess_set_new_cb(context, newSessionCallback);
+		SSL_CTX_sess_set_get_cb(context, getSessionCallback);
+		SSL_CTX_sess_set_remove_cb(context, removeSessionCallback);
+	}
+
+	if (OMSMaxEarlyData != 0) {
+		/* OpenSSL's own protection makes every ticket single-use through the
+		 * session cache. The replay window replaces it, so that tickets stay
+		 * stateless. */
+		SSL_CTX_set_options(context, SSL_OP_NO_ANTI_REPLAY);
+		SSL_CTX_set_allow_early_data_cb(context, allowEarlyDataCallback,
+										NULL);
+	}
+
+	if (OMSTicketKeyLifetime == 0) {
+		SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
+		return true;
+	}
+
+	if (!SSL_CTX_set_tlsext_ticket_key_evp_cb(context, ticketKeyCallback)) {
+		ERR_print_errors_fp(stderr);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+SRSetup(void) {
+	size_t i;
+
+	if (OMSSessionCacheSize != 0) {
+		SRShardSize = (OMSSessionCacheSize + SR_SHARD_COUNT - 1) /
+					  SR_SHARD_COUNT;
+
+		for (i = 0; i < SR_SHARD_COUNT; i++) {
+			pthread_mutex_init(&SRShards[i].mutex, NULL);
+			SRShards[i].sessions = calloc(SRShardSize,
+										  sizeof(struct SRSession));
+			if (SRShards[i].sessions == NULL) {
+				fputs(ANSI_COLOR_RED"[Resumption::SRSetup] Allocation "
+					  "failure."ANSI_COLOR_RESETLN, stderr);
+				SRDestroy();
+				return false;
+			}
+		}
+	}
+
+	if (OMSTicketKeyLifetime != 0 && !loadSecret()) {
+		SRDestroy();
+		return false;
+	}
+
+	return true;
+}
+
+void
+SRDestroy(void) {
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < SR_SHARD_COUNT; i++) {
+		if (SRShards[i].sessions == NULL)
+			continue;
+
+		for (j = 0; j < SRShardSize; j++)
+			free(SRShards[i].sessions[j].data);
+
+		free(SRShards[i].sessions);
+		SRShards[i].sessions = NULL;
+		pthread_mutex_destroy(&SRShards[i].mutex);
+	}
+
+	OPENSSL_cleanse(SRSecret, SR_SECRET_SIZE);
+	OPENSSL_cleanse(SRTicketKeys, sizeof(SRTicketKeys));
+	SRTicketKeysDerived = false;
+}
+
+void
+SRNotifyHandshake(SSL *ssl) {
+	SMAddCounter(SSL_session_reused(ssl) ? SMC_TLS_HANDSHAKES_RESUMED
+										 : SMC_TLS_HANDSHAKES_FULL, 1);
+
+	if (SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED)
+		SMAddCounter(SMC_TLS_EARLY_DATA_ACCEPTED, 1);
+}
@@ -0,0 +1,64 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * SR is an abbreviation for Session Resumption.
+ *
+ * Returning clients can resume their TLS session with an abbreviated
+ * handshake. Two mechanisms are supported: a sharded, bounded session cache
+ * for session IDs, and session tickets, whose keys are rotated periodically.
+ * The ticket keys are derived from a secret and the rotation epoch, so every
+ * process or instance configured with the same secret file uses the same
+ * keys.
+ */
+
+#ifndef CORE_RESUMPTION_H
+#define CORE_RESUMPTION_H
+
+#include <stdbool.h>
+
+#include <openssl/ossl_typ.h>
+
+/**
+ * Installs the session cache and ticket key callbacks in the context. Every
+ * context shares the same cache and keys, so sessions survive a reload of
+ * the certificates.
+ */
+bool
+SRConfigureContext(SSL_CTX *);
+
+bool
+SRSetup(void);
+
+void
+SRDestroy(void);
+
+/* Updates the handshake counters after a successful handshake. */
+void
+SRNotifyHandshake(SSL *);
+
+#endif /* CORE_RESUMPTION_H */
@@ -29,10 +29,33 @@
 
 #include "security.h"
 
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#include <brotli/types.h>
 
 #include <openssl/bio.h>
 #include <openssl/conf.h>
@@ -40,139 +63,1231 @@
 #include <openssl/engine.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
+#include <openssl/ocsp.h>
 #include <openssl/pem.h>
 #include <openssl/ssl.h> // IWYU pragma: keep
 #include <openssl/ssl3.h>
 #include <openssl/tls1.h>
 #include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "core/crypto_pool.h"
+#include "core/resumption.h"
+#include "misc/default.h"
+#include "misc/io.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define CSS_KTLS
+#endif
+
+/* Precompressed certificates (RFC 8879) are supported since OpenSSL 3.2. */
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L && !defined(OPENSSL_NO_COMP_ALG)
+#define CSS_CERTIFICATE_COMPRESSION
+#endif
+
+/* OCSP responses are usually a few kilobytes. */
+#define CSS_OCSP_MAX_SIZE 65536
+
+/* The size of the chunks early data is read in. */
+#define CSS_EARLY_DATA_CHUNK 4096
+
+const SSL_METHOD *SSLMethod;
+
+/**
+ * A certificate and its OCSP response. The leaf certificate of the current
+ * context is used to build the hostname table, which only happens on the
+ * main thread.
+ */
+struct CSSKeyPair {
+	const struct OMSKeyPair *files;
+	X509			*certificate;
+
+	/**
+	 * The DER-encoded OCSP response that is stapled, which is replaced when
+	 * the file is modified. The expiry is the nextUpdate time of the
+	 * response, or 0 if it doesn't have one. The key type (EVP_PKEY_*) of the
+	 * certificate matches the response with the certificate that OpenSSL
+	 * selected. These are protected by the mutex.
+	 */
+	unsigned char	*ocspResponse;
+	size_t			 ocspResponseSize;
+	time_t			 ocspResponseExpiry;
+	time_t			 ocspResponseModified;
+	int				 keyType;
+	pthread_mutex_t	 ocspMutex;
+};
+
+/**
+ * A certificate (directory) with its own context. The context is replaced
+ * when the certificates are reloaded. SSL_new() and SSL_set_SSL_CTX() take a
+ * reference to it, so it is only used under CSSContextMutex.
+ */
+struct CSSSite {
+	const struct OMSCertificate *certificate;
+	SSL_CTX			*context;
+
+	/* The modification time of the certificate files when they were
+	 * loaded. */
+	time_t			 certificatesModified;
+
+	struct CSSKeyPair keyPairs[OMS_MAX_KEY_PAIRS];
+	size_t			 keyPairCount;
+};
+
+/* An entry of the hash table that maps the hostnames of the certificates to
+ * their sites. Wildcard names are stored as they are, e.g. '*.example.com' */
+struct CSSHost {
+	char			*name;
+	struct CSSSite	*site;
+};
+
+struct CSSHostTable {
+	struct CSSHost	*hosts;
+	size_t			 mask;
+};
+
+/* The first site is the default one. */
+static struct CSSSite *CSSSites;
+static size_t CSSSiteCount;
+
+/* Rebuilt when the certificates are reloaded, protected by the mutex. */
+static struct CSSHostTable CSSHosts;
+static pthread_mutex_t CSSContextMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The index of the site in the ex_data of its contexts. */
+static int CSSSiteIndex = -1;
+
+/* OMSCipherList and OMSCipherSuites, ordered for this CPU. */
+static char *CSSCipherList;
+static char *CSSCipherSuites;
+
+/**
+ * The state of a connection that OpenSSL doesn't keep track of, attached to
+ * the SSL object using ex_data.
+ */
+struct CSSClientState {
+	/* Early (0-RTT) data that hasn't been read by the handler yet. */
+	char	*earlyData;
+	size_t	 earlyDataOffset;
+	size_t	 earlyDataSize;
+
+	/* Whether the handshake still waits for the client's Finished message,
+	 * i.e. whether the request being handled was sent as early data. */
+	bool	 isHandshakePending;
+
+	/* Whether SSL_read_early_data() has reported that all early data was
+	 * read, after which it may not be called anymore. */
+	bool	 hasReadEarlyData;
+
+	/* Whether the early data must be read completely before the handshake
+	 * continues, because the request can't be handled early. */
+	bool	 mustFinishEarlyData;
+
+	/* The amount of small records that were sent since the connection was
+	 * idle, and the (CLOCK_MONOTONIC) time of the last write. */
+	size_t	 smallRecords;
+	struct timespec lastWrite;
+};
+
+enum EarlyDataStatus {
+	EDS_ERROR,
+	EDS_FINISHED,
+	EDS_REQUEST_HEAD,
+	EDS_WANT_ASYNC,
+	EDS_WANT_READ,
+	EDS_WANT_WRITE
+};
+
+static int CSSClientStateIndex = -1;
+
+static const unsigned char ALPN_HTTP1[] = {
+	/* "http/1.1" */
+	0x68, 0x74, 0x74, 0x70, 0x2f, 0x31, 0x2e, 0x31
+};
+static const unsigned char ALPN_HTTP2[] = {
+	/* "http/2" */
+	0x68, 0x32
+};
+
+#define ALPN_HTTP1_LEN 8
+#define ALPN_HTTP2_LEN 2
+
+/**
+ * Returns whether the CPU has instructions for AES and for the carry-less
+ * multiplication of GCM: AES-NI and PCLMULQDQ (which every CPU with VAES has
+ * as well), or the ARMv8 cryptography extension. Without them, AES-GCM is
+ * several times slower than ChaCha20-Poly1305.
+ */
+static bool
+hasAESAcceleration(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax;
+	unsigned int ebx;
+	unsigned int ecx;
+	unsigned int edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	return (ecx & bit_AES) && (ecx & bit_PCLMUL);
+#elif defined(__aarch64__) && defined(__linux__)
+	unsigned long capabilities;
+
+	capabilities = getauxval(AT_HWCAP);
+	return (capabilities & HWCAP_AES) && (capabilities & HWCAP_PMULL);
+#else
+	return false;
+#endif
+}
+
+/**
+ * Returns a copy of the colon-separated cipher list. Without AES
+ * acceleration, the ChaCha20 ciphers are moved to the front, keeping the
+ * order of the others.
+ */
+static char *
+orderCiphers(const char *list, bool hasAES) {
+	const char *cipher;
+	char *result;
+	size_t length;
+	int pass;
+
+	result = malloc(strlen(list) + 1);
+	if (result == NULL || hasAES) {
+		if (result != NULL)
+			strcpy(result, list);
+		return result;
+	}
+
+	length = 0;
+	for (pass = 0; pass < 2; pass++) {
+		for (cipher = list; *cipher != '\0';) {
+			size_t size;
+			size_t i;
+			bool isChaCha;
+
+			size = strcspn(cipher, ":");
+			isChaCha = false;
+			for (i = 0; i + 8 <= size && !isChaCha; i++)
+				isChaCha = strncmp(cipher + i, "CHACHA20", 8) == 0;
+
+			if (size != 0 && isChaCha == (pass == 0)) {
+				if (length != 0)
+					result[length++] = ':';
+				memcpy(result + length, cipher, size);
+				length += size;
+			}
+
+			cipher += size;
+			if (*cipher == ':')
+				cipher++;
+		}
+	}
+
+	result[length] = '\0';
+	return result;
+}
+
+/* Counts the octets that were encrypted, by the cipher of the connection. */
+static void
+countEncrypted(CSSClient client, size_t size) {
+	const SSL_CIPHER *cipher;
+
+	cipher = SSL_get_current_cipher(client);
+	switch (cipher ? SSL_CIPHER_get_cipher_nid(cipher) : NID_undef) {
+		case NID_aes_128_gcm:
+			SMAddCounter(SMC_TLS_OCTETS_AES_128_GCM, size);
+			break;
+		case NID_aes_256_gcm:
+			SMAddCounter(SMC_TLS_OCTETS_AES_256_GCM, size);
+			break;
+		case NID_chacha20_poly1305:
+			SMAddCounter(SMC_TLS_OCTETS_CHACHA20_POLY1305, size);
+			break;
+		default:
+			SMAddCounter(SMC_TLS_OCTETS_OTHER_CIPHERS, size);
+			break;
+	}
+}
+
+static int
+alpnHandler(SSL *ssl,
+			const unsigned char **out,
+			unsigned char *outlen,
+			const unsigned char *in,
+			unsigned int inlen,
+			void *arg);
+
+/* The longest possible DNS name, excluding the NUL character. */
+#define CSS_HOSTNAME_SIZE 253
+
+/* Returns the modification time of the file, or 0 if it doesn't exist. */
+static time_t
+getModified(const char *path) {
+	struct stat info;
+
+	if (path == NULL || stat(path, &info) != 0)
+		return 0;
+	return info.st_mtime;
+}
+
+/* Reads the certificates of a chain file, or returns NULL on failure. */
+static STACK_OF(X509) *
+readChain(const char *path) {
+	BIO *bio;
+	STACK_OF(X509) *chain;
+	X509 *cert;
+
+	bio = BIO_new_file(path, "r");
+	if (bio == NULL)
+		return NULL;
+
+	chain = sk_X509_new_null();
+	while (chain != NULL
+		   && (cert = PEM_read_bio_X509(bio, NULL, 0, NULL)) != NULL) {
+		if (!sk_X509_push(chain, cert)) {
+			X509_free(cert);
+			sk_X509_pop_free(chain, X509_free);
+			chain = NULL;
+		}
+	}
+
+	/* Reading stops with an error at the end of the file */
+	ERR_clear_error();
+	BIO_free(bio);
+	return chain;
+}
+
+/**
+ * Checks if the OCSP response can be stapled for the leaf certificate, and
+ * retrieves the time at which it expires. The response has to be signed by
+ * the issuer in the chain file, or by a responder that it delegated to, and
+ * has to contain the status of the leaf.
+ */
+static bool
+parseOCSPResponse(const unsigned char *data, size_t size, X509 *leaf,
+				  const char *chainFile, time_t *expiry) {
+	OCSP_BASICRESP *basic;
+	STACK_OF(X509) *chain;
+	OCSP_CERTID *id;
+	X509 *issuer;
+	ASN1_GENERALIZEDTIME *nextUpdate;
+	OCSP_RESPONSE *response;
+	X509_STORE *store;
+	bool isValid;
+	int days;
+	int i;
+	int seconds;
+
+	response = d2i_OCSP_RESPONSE(NULL, &data, size);
+	if (response == NULL)
+		return false;
+
+	isValid = false;
+	basic = NULL;
+	chain = NULL;
+	id = NULL;
+	store = NULL;
+	if (OCSP_response_status(response) != OCSP_RESPONSE_STATUS_SUCCESSFUL)
+		goto end;
+
+	basic = OCSP_response_get1_basic(response);
+	if (basic == NULL || leaf == NULL)
+		goto end;
+
+	chain = readChain(chainFile);
+	if (chain == NULL)
+		goto end;
+
+	issuer = NULL;
+	for (i = 0; i < sk_X509_num(chain) && issuer == NULL; i++)
+		if (X509_check_issued(sk_X509_value(chain, i), leaf) == X509_V_OK)
+			issuer = sk_X509_value(chain, i);
+	if (issuer == NULL)
+		goto end;
+
+	/* The chain is trusted here, since it is the one that is served: the
+	 * signer only has to lead up to it, not to a root. */
+	store = X509_STORE_new();
+	if (store == NULL
+		|| !X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN))
+		goto end;
+	for (i = 0; i < sk_X509_num(chain); i++)
+		if (!X509_STORE_add_cert(store, sk_X509_value(chain, i)))
+			goto end;
+
+	if (OCSP_basic_verify(basic, chain, store, 0) <= 0)
+		goto end;
+
+	id = OCSP_cert_to_id(NULL, leaf, issuer);
+	nextUpdate = NULL;
+	if (id == NULL || !OCSP_resp_find_status(basic, id, NULL, NULL, NULL,
+											 NULL, &nextUpdate))
+		goto end;
+
+	*expiry = 0;
+	if (nextUpdate != NULL) {
+		if (!ASN1_TIME_diff(&days, &seconds, NULL, nextUpdate))
+			goto end;
+		*expiry = time(NULL) + (time_t) days * 86400 + seconds;
+	}
+
+	isValid = true;
+end:
+	ERR_clear_error();
+	OCSP_CERTID_free(id);
+	X509_STORE_free(store);
+	sk_X509_pop_free(chain, X509_free);
+	OCSP_BASICRESP_free(basic);
+	OCSP_RESPONSE_free(response);
+	return isValid;
+}
+
+/* Returns the EVP_PKEY_* type of the key of the certificate. */
+static int
+getKeyType(X509 *certificate) {
+	EVP_PKEY *key;
+
+	key = X509_get0_pubkey(certificate);
+	return key == NULL ? EVP_PKEY_NONE : EVP_PKEY_base_id(key);
+}
+
+/* Called during the handshake when the client asks for the OCSP response. */
+static int
+statusCallback(SSL *ssl, void *arg) {
+	struct CSSSite *site;
+	unsigned char *copy;
+	size_t size;
+	size_t i;
+	int keyType;
+
+	UNUSED(arg);
+
+	/* After SNI, this is the context of the selected site. */
+	site = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), CSSSiteIndex);
+	keyType = getKeyType(SSL_get_certificate(ssl));
+
+	copy = NULL;
+	size = 0;
+
+	/* The response is copied, since OpenSSL takes ownership of it. */
+	for (i = 0; i < site->keyPairCount && copy == NULL; i++) {
+		struct CSSKeyPair *keyPair;
+
+		keyPair = &site->keyPairs[i];
+		pthread_mutex_lock(&keyPair->ocspMutex);
+		{
+			if (keyPair->keyType == keyType &&
+				keyPair->ocspResponse != NULL &&
+				(keyPair->ocspResponseExpiry == 0 ||
+				 keyPair->ocspResponseExpiry > time(NULL))) {
+				copy = OPENSSL_memdup(keyPair->ocspResponse,
+									  keyPair->ocspResponseSize);
+				size = keyPair->ocspResponseSize;
+			}
+		}
+		pthread_mutex_unlock(&keyPair->ocspMutex);
+	}
+
+	if (copy == NULL)
+		return SSL_TLSEXT_ERR_NOACK;
+
+	if (!SSL_set_tlsext_status_ocsp_resp(ssl, copy, size)) {
+		OPENSSL_free(copy);
+		return SSL_TLSEXT_ERR_NOACK;
+	}
+
+	SMAddCounter(SMC_TLS_OCSP_STAPLED, 1);
+	return SSL_TLSEXT_ERR_OK;
+}
+
+/* FNV-1a of the lowercase name */
+static size_t
+hashHostname(const char *name) {
+	uint64_t hash;
+
+	hash = 0xcbf29ce484222325;
+	for (; *name != '\0'; name++) {
+		hash ^= (unsigned char) tolower((unsigned char) *name);
+		hash *= 0x100000001b3;
+	}
+
+	return (size_t) hash;
+}
+
+static struct CSSSite *
+findHost(const struct CSSHostTable *table, const char *name) {
+	size_t i;
+
+	for (i = hashHostname(name) & table->mask;
+		 table->hosts[i].name != NULL;
+		 i = (i + 1) & table->mask)
+		if (strcasecmp(table->hosts[i].name, name) == 0)
+			return table->hosts[i].site;
+
+	return NULL;
+}
+
+/**
+ * Looks up the site of the hostname, which is matched exactly or by the
+ * wildcard of its parent domain.
+ */
+static struct CSSSite *
+findSite(const struct CSSHostTable *table, const char *name) {
+	char wildcard[CSS_HOSTNAME_SIZE + 2];
+	struct CSSSite *site;
+	const char *parent;
+
+	site = findHost(table, name);
+	if (site != NULL)
+		return site;
+
+	parent = strchr(name, '.');
+	if (parent == NULL || strlen(parent) > CSS_HOSTNAME_SIZE)
+		return NULL;
+
+	wildcard[0] = '*';
+	strcpy(wildcard + 1, parent);
+	return findHost(table, wildcard);
+}
+
+/* The first site to add a name keeps it. */
+static bool
+addHost(struct CSSHostTable *table, const char *name, size_t length,
+		struct CSSSite *site) {
+	char *copy;
+	size_t i;
+
+	copy = strndup(name, length);
+	if (copy == NULL)
+		return false;
+
+	for (i = hashHostname(copy) & table->mask;
+		 table->hosts[i].name != NULL;
+		 i = (i + 1) & table->mask) {
+		if (strcasecmp(table->hosts[i].name, copy) == 0) {
+			free(copy);
+			return true;
+		}
+	}
+
+	table->hosts[i].name = copy;
+	table->hosts[i].site = site;
+	return true;
+}
+
+static void
+destroyHostTable(struct CSSHostTable *table) {
+	size_t i;
+
+	if (table->hosts == NULL)
+		return;
+
+	for (i = 0; i <= table->mask; i++)
+		free(table->hosts[i].name);
+
+	free(table->hosts);
+	table->hosts = NULL;
+}
+
+/**
+ * Adds the DNS names of the subjectAltName extension, or the common name if
+ * there are none, of the certificate.
+ */
+static bool
+addHosts(struct CSSHostTable *table, X509 *cert, struct CSSSite *site) {
+	GENERAL_NAMES *names;
+	X509_NAME_ENTRY *entry;
+	ASN1_STRING *value;
+	int i;
+
+	names = X509_get_ext_d2i(cert, NID_subject_alt_name, NULL, NULL);
+	if (names != NULL) {
+		for (i = 0; i < sk_GENERAL_NAME_num(names); i++) {
+			GENERAL_NAME *name;
+
+			name = sk_GENERAL_NAME_value(names, i);
+			if (name->type != GEN_DNS)
+				continue;
+
+			value = name->d.dNSName;
+			if (!addHost(table, (const char *) ASN1_STRING_get0_data(value),
+						 ASN1_STRING_length(value), site)) {
+				GENERAL_NAMES_free(names);
+				return false;
+			}
+		}
+
+		GENERAL_NAMES_free(names);
+		return true;
+	}
+
+	i = X509_NAME_get_index_by_NID(X509_get_subject_name(cert),
+								   NID_commonName, -1);
+	if (i == -1)
+		return true;
+
+	entry = X509_NAME_get_entry(X509_get_subject_name(cert), i);
+	value = X509_NAME_ENTRY_get_data(entry);
+	return addHost(table, (const char *) ASN1_STRING_get0_data(value),
+				   ASN1_STRING_length(value), site);
+}
+
+/* Builds the hostname table from the current contexts of the sites. */
+static bool
+buildHostTable(struct CSSHostTable *table) {
+	size_t capacity;
+	size_t i;
+
+	/* Certificates usually have a few names each, and the table is kept at
+	 * most half full. */
+	capacity = 16;
+	while (capacity < CSSSiteCount * OMS_MAX_KEY_PAIRS * 16)
+		capacity *= 2;
+
+	table->hosts = calloc(capacity, sizeof(struct CSSHost));
+	table->mask = capacity - 1;
+	if (table->hosts == NULL)
+		return false;
+
+	for (i = 0; i < CSSSiteCount; i++) {
+		size_t j;
+
+		for (j = 0; j < CSSSites[i].keyPairCount; j++) {
+			if (!addHosts(table, CSSSites[i].keyPairs[j].certificate,
+						  &CSSSites[i])) {
+				destroyHostTable(table);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* Selects the context of the site that the client requests using SNI. */
+static int
+serverNameCallback(SSL *ssl, int *alert, void *arg) {
+	struct CSSSite *site;
+	const char *name;
+
+	UNUSED(alert);
+	UNUSED(arg);
+
+	name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+	if (name == NULL)
+		return SSL_TLSEXT_ERR_OK;
+
+	pthread_mutex_lock(&CSSContextMutex);
+	{
+		site = findSite(&CSSHosts, name);
+		if (site != NULL && site->context != SSL_get_SSL_CTX(ssl))
+			SSL_set_SSL_CTX(ssl, site->context);
+	}
+	pthread_mutex_unlock(&CSSContextMutex);
+
+	/* Unknown names get the default certificate, like clients without
+	 * SNI. */
+	if (site == NULL)
+		SMAddCounter(SMC_TLS_SNI_UNKNOWN, 1);
+
+	return SSL_TLSEXT_ERR_OK;
+}
+
+#ifdef CSS_CERTIFICATE_COMPRESSION
+static void
+writeUint24(unsigned char *out, size_t value) {
+	out[0] = (value >> 16) & 0xFF;
+	out[1] = (value >> 8) & 0xFF;
+	out[2] = value & 0xFF;
+}
+
+/**
+ * Encodes the TLS 1.3 Certificate message of the leaf certificate and its
+ * chain, without a request context and without extensions. Returns NULL on
+ * failure.
+ */
+static unsigned char *
+encodeCertificateMessage(X509 *leaf, STACK_OF(X509) *chain, size_t *size) {
+	unsigned char *message;
+	unsigned char *position;
+	X509 *certificate;
+	size_t count;
+	size_t i;
+	int length;
+
+	count = 1 + (chain ? (size_t) sk_X509_num(chain) : 0);
+
+	/* certificate_request_context<0..2^8-1> and
+	 * certificate_list<0..2^24-1> */
+	*size = 4;
+	for (i = 0; i < count; i++) {
+		certificate = (i == 0) ? leaf : sk_X509_value(chain, i - 1);
+		length = i2d_X509(certificate, NULL);
+		if (length <= 0)
+			return NULL;
+
+		/* cert_data<1..2^24-1> and extensions<0..2^16-1> */
+		*size += 3 + (size_t) length + 2;
+	}
+
+	if (*size - 4 > 0xFFFFFF)
+		return NULL;
+
+	message = malloc(*size);
+	if (!message)
+		return NULL;
+
+	message[0] = 0;
+	writeUint24(message + 1, *size - 4);
+	position = message + 4;
+
+	for (i = 0; i < count; i++) {
+		certificate = (i == 0) ? leaf : sk_X509_value(chain, i - 1);
+		writeUint24(position, (size_t) i2d_X509(certificate, NULL));
+		position += 3;
+
+		/* i2d_X509 advances the position past the encoding. */
+		if (i2d_X509(certificate, &position) <= 0) {
+			free(message);
+			return NULL;
+		}
+
+		position[0] = 0;
+		position[1] = 0;
+		position += 2;
+	}
+
+	return message;
+}
+
+/**
+ * Compresses the certificate message of the certificate that was just loaded
+ * into the context with Brotli, so OpenSSL doesn't have to compress it for
+ * every handshake. The chain is sent uncompressed when this fails.
+ */
+static void
+compressCertificate(SSL_CTX *context, const char *fileName) {
+	STACK_OF(X509) *chain = NULL;
+	unsigned char *message;
+	unsigned char *compressed;
+	unsigned char *decompressed;
+	size_t size;
+	size_t compressedSize;
+	size_t decompressedSize;
+
+	SSL_CTX_get0_chain_certs(context, &chain);
+	message = encodeCertificateMessage(SSL_CTX_get0_certificate(context),
+									   chain, &size);
+	if (!message) {
+		fprintf(stderr, ANSI_COLOR_RED"[Security::compressCertificate] Failed "
+				"to encode certificate '%s'"ANSI_COLOR_RESETLN, fileName);
+		return;
+	}
+
+	compressedSize = BrotliEncoderMaxCompressedSize(size);
+	decompressedSize = size;
+	compressed = compressedSize ? malloc(compressedSize) : NULL;
+	decompressed = malloc(size);
+
+	if (!compressed || !decompressed ||
+		!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+							   BROTLI_MODE_GENERIC, size, message,
+							   &compressedSize, compressed)) {
+		fprintf(stderr, ANSI_COLOR_RED"[Security::compressCertificate] Failed "
+				"to compress certificate '%s'"ANSI_COLOR_RESETLN, fileName);
+	/* A client aborts the handshake when the chain can't be decompressed, so
+	 * the output of the encoder is verified once. */
+	} else if (BrotliDecoderDecompress(compressedSize, compressed,
+									   &decompressedSize, decompressed) !=
+				   BROTLI_DECODER_RESULT_SUCCESS ||
+			   decompressedSize != size ||
+			   memcmp(decompressed, message, size) != 0) {
+		fprintf(stderr, ANSI_COLOR_RED"[Security::compressCertificate] "
+				"Compressed certificate '%s' doesn't match the original"
+				ANSI_COLOR_RESETLN, fileName);
+	} else if (compressedSize < size) {
+		if (SSL_CTX_set1_compressed_cert(context, TLSEXT_comp_cert_brotli,
+										 compressed, compressedSize,
+										 size) != 1)
+			ERR_print_errors_fp(stderr);
+		else
+			printf("Security (certificate '%s' compressed from %zu to %zu "
+				   "octets)\n", fileName, size, compressedSize);
+	}
+
+	free(decompressed);
+	free(compressed);
+	free(message);
+}
+#endif
+
+/**
+ * Loads the certificate, its chain and its private key into the context.
+ * OpenSSL keeps a certificate per key type, and selects the one to use for
+ * every handshake based on the signature algorithms the client supports.
+ * Returns 1 on success, or a negative error code.
+ */
+static int
+loadKeyPair(SSL_CTX *context, const struct OMSKeyPair *files, X509 **leaf) {
+	X509 *cert;
+	BIO *bio;
+	EVP_PKEY *key;
+	EVP_PKEY *wrapped;
+	int ret;
+
+	/* Set certificate file. */
+	if (SSL_CTX_use_certificate_file(context, files->certificateFile,
+		SSL_FILETYPE_PEM) <= 0) {
+		ERR_print_errors_fp(stderr);
+		return -2;
+	}
+
+	/* The chain is set for the certificate that was just loaded, so every
+	 * certificate can have its own chain. */
+	bio = BIO_new_file(files->chainFile, "r");
+	if (!bio) {
+		ERR_print_errors_fp(stderr);
+		return -3;
+	}
+
+	while ((cert = PEM_read_bio_X509(bio, NULL, 0, NULL)) != NULL) {
+		if (!SSL_CTX_add0_chain_cert(context, cert)) {
+			X509_free(cert);
+			BIO_free(bio);
+			return -8;
+		}
+	}
+
+	/* The end of the file is reported as an error as well. */
+	ERR_clear_error();
+	BIO_free(bio);
+
+	bio = BIO_new_file(files->privateKeyFile, "r");
+	key = bio ? PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL) : NULL;
+	BIO_free(bio);
+	if (!key) {
+		ERR_print_errors_fp(stderr);
+		return -4;
+	}
+
+	/* Signatures are computed by the crypto pool during handshakes. */
+	if (CPIsEnabled()) {
+		wrapped = CPWrapPrivateKey(key);
+		if (wrapped) {
+			EVP_PKEY_free(key);
+			key = wrapped;
+		}
+	}
+
+	ret = SSL_CTX_use_PrivateKey(context, key);
+	EVP_PKEY_free(key);
+	if (ret <= 0) {
+		ERR_print_errors_fp(stderr);
+		return -4;
+	}
+
+#ifdef CSS_CERTIFICATE_COMPRESSION
+	/* The OCSP response is an extension of the certificate message in
+	 * TLS 1.3, which a message compressed in advance can't contain. */
+	if (OMSCertificateCompression && files->ocspResponseFile == NULL)
+		compressCertificate(context, files->certificateFile);
+#endif
+
+	*leaf = SSL_CTX_get0_certificate(context);
+	X509_up_ref(*leaf);
+	return 1;
+}
+
+/**
+ * Creates a context using the current certificate files of the site and the
+ * options. The leaf certificates are stored in the array, which must have
+ * room for every key pair of the site. Returns 1 on success, or a negative
+ * error code.
+ */
+static int
+createContext(struct CSSSite *site, SSL_CTX **out, X509 **leaves) {
+	SSL_CTX *context;
+	size_t i;
+	int ret;
+
+	context = SSL_CTX_new(SSLMethod);
+	if (!context) {
+		return -1;
+	}
+
+	SSL_CTX_set_ecdh_auto(context, 1);
+	SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+
+	/* Free the read and write buffers of idle connections, which are about
+	 * 34 KiB per connection, and allocate them again when data arrives. */
+	SSL_CTX_set_mode(context, SSL_MODE_RELEASE_BUFFERS);
+
+#ifdef CSS_KTLS
+	/* The kernel is configured by OpenSSL as soon as the handshake has
+	 * established the traffic keys. OpenSSL silently falls back to user-space
+	 * encryption when the kernel or the cipher doesn't support it. */
+	if (OMSKernelTLS)
+		SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS);
+#endif
+
+#ifdef CSS_CERTIFICATE_COMPRESSION
+	/* Only Brotli is offered, since only Brotli chains are compressed in
+	 * advance (in loadKeyPair). */
+	if (OMSCertificateCompression) {
+		int algorithms[] = { TLSEXT_comp_cert_brotli };
+
+		SSL_CTX_set1_cert_comp_preference(context, algorithms, 1);
+	}
+#endif
+
+	/* The order of the server is used, except that ChaCha20 is chosen when
+	 * it is the first preference of the client, which indicates a client
+	 * without AES acceleration. */
+	SSL_CTX_set_options(context, SSL_OP_CIPHER_SERVER_PREFERENCE |
+						SSL_OP_PRIORITIZE_CHACHA);
+
+	if (SSL_CTX_set_cipher_list(context, CSSCipherList) == 0) {
+		puts(ANSI_COLOR_RED"E: Failed to set cipher list."ANSI_COLOR_RESETLN);
+		ERR_print_errors_fp(stderr);
+		SSL_CTX_free(context);
+		return -2;
+	}
+
+/* LibreSSL doesn't have the 'SSL_CTX_set_ciphersuites' function */
+#if defined(TLS_MAX_VERSION) && TLS_MAX_VERSION == TLS1_3_VERSION
+	if (SSL_CTX_set_ciphersuites(context, CSSCipherSuites) == 0) {
+		puts(ANSI_COLOR_RED"E: Failed to set ciphersuites."ANSI_COLOR_RESETLN);
+		ERR_print_errors_fp(stderr);
+		SSL_CTX_free(context);
+		return -2;
+	}
+#endif
+
+	SSL_CTX_set_alpn_select_cb(context, alpnHandler, NULL);
+	SSL_CTX_set_tlsext_servername_callback(context, serverNameCallback);
+
+	/* Without a response, the callback doesn't staple anything. */
+	SSL_CTX_set_tlsext_status_cb(context, statusCallback);
+
+	if (!SSL_CTX_set_ex_data(context, CSSSiteIndex, site)) {
+		SSL_CTX_free(context);
+		return -11;
+	}
+
+	if (OMSMaxEarlyData != 0 &&
+		(!SSL_CTX_set_max_early_data(context, OMSMaxEarlyData) ||
+		 !SSL_CTX_set_recv_max_early_data(context, OMSMaxEarlyData))) {
+		ERR_print_errors_fp(stderr);
+		SSL_CTX_free(context);
+		return -9;
+	}
+
+	if (!SRConfigureContext(context)) {
+		SSL_CTX_free(context);
+		return -10;
+	}
+
+	for (i = 0; i < site->keyPairCount; i++) {
+		ret = loadKeyPair(context, site->keyPairs[i].files, &leaves[i]);
+		if (ret <= 0) {
+			while (i-- > 0)
+				X509_free(leaves[i]);
+			SSL_CTX_free(context);
+			return ret;
+		}
+	}
+
+	*out = context;
+	return 1;
+}
+
+/* Returns the latest modification time of the files of the key pair. */
+static time_t
+getKeyPairModified(const struct OMSKeyPair *files) {
+	time_t modified;
+	time_t other;
+
+	modified = getModified(files->certificateFile);
+
+	other = getModified(files->chainFile);
+	if (other > modified)
+		modified = other;
+
+	other = getModified(files->privateKeyFile);
+	if (other > modified)
+		modified = other;
+
+	return modified;
+}
+
+/* Returns the latest modification time of the certificate files. */
+static time_t
+getCertificatesModified(const struct CSSSite *site) {
+	time_t modified;
+	size_t i;
+
+	modified = 0;
+	for (i = 0; i < site->keyPairCount; i++) {
+		time_t other;
+
+		other = getKeyPairModified(site->keyPairs[i].files);
+		if (other > modified)
+			modified = other;
+	}
+
+	return modified;
+}
+
+/**
+ * Reads the OCSP response file. Returns NULL if it can't be read or is
+ * larger than CSS_OCSP_MAX_SIZE.
+ */
+static unsigned char *
+readOCSPResponseFile(const char *path, size_t *size) {
+	unsigned char *data;
+	FILE *file;
+
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		perror(ANSI_COLOR_RED"[Security::readOCSPResponseFile] Failed to "
+			   "open the OCSP response file"ANSI_COLOR_RESET);
+		return NULL;
+	}
+
+	data = OPENSSL_malloc(CSS_OCSP_MAX_SIZE);
+	if (data != NULL) {
+		*size = fread(data, 1, CSS_OCSP_MAX_SIZE, file);
+		if (*size == 0 || *size == CSS_OCSP_MAX_SIZE || ferror(file)) {
+			OPENSSL_free(data);
+			data = NULL;
+		}
+	}
+
+	fclose(file);
+	return data;
+}
+
+static bool
+reloadOCSPResponse(struct CSSKeyPair *keyPair) {
+	unsigned char *data;
+	unsigned char *oldData;
+	time_t expiry;
+	size_t size;
+
+	/* As with the certificates, a failed load is retried only after the file
+	 * is modified again. */
+	keyPair->ocspResponseModified =
+		getModified(keyPair->files->ocspResponseFile);
+
+	data = NULL;
+	size = 0;
+	expiry = 0;
+
+	/* A response that is older than the certificate belongs to the previous
+	 * certificate, so nothing is stapled until the fetcher has replaced it. */
+	if (keyPair->ocspResponseModified >= getKeyPairModified(keyPair->files)) {
+		data = readOCSPResponseFile(keyPair->files->ocspResponseFile, &size);
+		if (data != NULL && !parseOCSPResponse(data, size,
+				keyPair->certificate, keyPair->files->chainFile, &expiry)) {
+			fprintf(stderr, ANSI_COLOR_RED"[Security::reloadOCSPResponse] "
+					"The OCSP response %s is invalid, unsuccessful or not "
+					"for the certificate."ANSI_COLOR_RESETLN,
+					keyPair->files->ocspResponseFile);
+			OPENSSL_free(data);
+			data = NULL;
+		}
+	}
+
+	pthread_mutex_lock(&keyPair->ocspMutex);
+	{
+		oldData = keyPair->ocspResponse;
+		keyPair->ocspResponse = data;
+		keyPair->ocspResponseSize = size;
+		keyPair->ocspResponseExpiry = expiry;
+	}
+	pthread_mutex_unlock(&keyPair->ocspMutex);
+
+	OPENSSL_free(oldData);
+	return data != NULL;
+}
+
+/* Reloads the OCSP responses of the site that have a file. */
+static bool
+reloadOCSPResponses(struct CSSSite *site) {
+	bool hasSucceeded;
+	size_t i;
+
+	hasSucceeded = true;
+	for (i = 0; i < site->keyPairCount; i++)
+		if (site->keyPairs[i].files->ocspResponseFile != NULL &&
+			!reloadOCSPResponse(&site->keyPairs[i]))
+			hasSucceeded = false;
+
+	return hasSucceeded;
+}
 
-#include "misc/default.h"
-#include "misc/io.h"
-#include "misc/options.h"
+/**
+ * Makes the context the current one of the site. The references to the leaf
+ * certificates are taken over.
+ */
+static void
+installContext(struct CSSSite *site, SSL_CTX *context, X509 **leaves) {
+	SSL_CTX *oldContext;
+	unsigned char *oldResponse;
+	size_t i;
 
-/* 300 ms = 300000 μs */
-#define CSS_POLL_TIMEOUT 300000
+	/* The responses only match the key type, so those of the old
+	 * certificates are dropped before the new ones can be selected. Nothing
+	 * is stapled until reloadOCSPResponses() has loaded the new ones. */
+	for (i = 0; i < site->keyPairCount; i++) {
+		struct CSSKeyPair *keyPair;
 
-const SSL_METHOD *SSLMethod;
-SSL_CTX *SSLContext;
+		keyPair = &site->keyPairs[i];
+		pthread_mutex_lock(&keyPair->ocspMutex);
+		{
+			oldResponse = keyPair->ocspResponse;
+			keyPair->ocspResponse = NULL;
+			keyPair->ocspResponseSize = 0;
+			keyPair->ocspResponseExpiry = 0;
+		}
+		pthread_mutex_unlock(&keyPair->ocspMutex);
 
-static const unsigned char ALPN_HTTP1[] = {
-	/* "http/1.1" */
-	0x68, 0x74, 0x74, 0x70, 0x2f, 0x31, 0x2e, 0x31
-};
-static const unsigned char ALPN_HTTP2[] = {
-	/* "http/2" */
-	0x68, 0x32
-};
+		OPENSSL_free(oldResponse);
+	}
 
-#define ALPN_HTTP1_LEN 8
-#define ALPN_HTTP2_LEN 2
+	pthread_mutex_lock(&CSSContextMutex);
+	{
+		oldContext = site->context;
+		site->context = context;
+	}
+	pthread_mutex_unlock(&CSSContextMutex);
 
-static int
-alpnHandler(SSL *ssl,
-			const unsigned char **out,
-			unsigned char *outlen,
-			const unsigned char *in,
-			unsigned int inlen,
-			void *arg);
+	/* Existing connections have their own reference to the old context, so it
+	 * is freed when the last of them is destroyed. */
+	SSL_CTX_free(oldContext);
+
+	for (i = 0; i < site->keyPairCount; i++) {
+		struct CSSKeyPair *keyPair;
+
+		keyPair = &site->keyPairs[i];
+		X509_free(keyPair->certificate);
+		keyPair->certificate = leaves[i];
+
+		pthread_mutex_lock(&keyPair->ocspMutex);
+		{
+			keyPair->keyType = getKeyType(leaves[i]);
+		}
+		pthread_mutex_unlock(&keyPair->ocspMutex);
+	}
+}
 
 int
 CSSetupSecurityManager(void) {
-	X509 *cert;
+	X509 *leaves[OMS_MAX_KEY_PAIRS];
+	SSL_CTX *context;
+	bool hasAES;
+	size_t i;
+	size_t j;
+	int ret;
 
 	SSLMethod = TLS_server_method();
 	if (!SSLMethod)
 		return 0;
 
-	SSLContext = SSL_CTX_new(SSLMethod);
-	if (!SSLContext) {
-		return -1;
-	}
+	CSSClientStateIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+	CSSSiteIndex = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+	if (CSSClientStateIndex == -1 || CSSSiteIndex == -1)
+		return -9;
 
-	SSL_CTX_set_ecdh_auto(SSLContext, 1);
-	SSL_CTX_set_min_proto_version(SSLContext, TLS1_2_VERSION);
+	if (!SRSetup())
+		return -10;
 
-	if (SSL_CTX_set_cipher_list(SSLContext, OMSCipherList) == 0) {
-		puts(ANSI_COLOR_RED"E: Failed to set cipher list."ANSI_COLOR_RESETLN);
-		ERR_print_errors_fp(stderr);
-		CSDestroySecurityManager();
-		return -2;
+	if (!CPSetup()) {
+		SRDestroy();
+		return -13;
 	}
 
-/* LibreSSL doesn't have the 'SSL_CTX_set_ciphersuites' function */
-#if defined(TLS_MAX_VERSION) && TLS_MAX_VERSION == TLS1_3_VERSION
-	if (SSL_CTX_set_ciphersuites(SSLContext, OMSCipherSuites) == 0) {
-		puts(ANSI_COLOR_RED"E: Failed to set ciphersuites."ANSI_COLOR_RESETLN);
-		ERR_print_errors_fp(stderr);
+	hasAES = hasAESAcceleration();
+	printf("Security (AES acceleration: %s)\n", hasAES ? "yes" : "no");
+	CSSCipherList = orderCiphers(OMSCipherList, hasAES);
+	CSSCipherSuites = orderCiphers(OMSCipherSuites, hasAES);
+	if (CSSCipherList == NULL || CSSCipherSuites == NULL) {
 		CSDestroySecurityManager();
-		return -2;
+		return -1;
 	}
-#endif
 
-	/* Set certificate file. */
-	if (SSL_CTX_use_certificate_file(SSLContext, OMSCertificateFile,
-		SSL_FILETYPE_PEM) <= 0) {
-		ERR_print_errors_fp(stderr);
+	CSSSites = calloc(OMSCertificateCount, sizeof(struct CSSSite));
+	if (CSSSites == NULL) {
 		CSDestroySecurityManager();
-		return -2;
+		return -1;
 	}
 
-	/* Set chain file. */
-	FILE *file = fopen(OMSCertificateChainFile, "r");
-	cert = PEM_read_X509(file, NULL, 0, NULL);
-	fclose(file);
-	if (!SSL_CTX_add_extra_chain_cert(SSLContext, cert)) {
-		ERR_print_errors_fp(stderr);
-		CSDestroySecurityManager();
-		return -3;
-	}
+	for (i = 0; i < OMSCertificateCount; i++) {
+		struct CSSSite *site;
 
-	if (SSL_CTX_use_PrivateKey_file(SSLContext, OMSCertificatePrivateKeyFile,
-		SSL_FILETYPE_PEM) <= 0) {
-		ERR_print_errors_fp(stderr);
-		CSDestroySecurityManager();
-		return -4;
-	}
+		site = &CSSSites[i];
+		site->certificate = &OMSCertificates[i];
+		site->keyPairCount = site->certificate->keyPairCount;
+		for (j = 0; j < site->keyPairCount; j++) {
+			site->keyPairs[j].files = &site->certificate->keyPairs[j];
+			pthread_mutex_init(&site->keyPairs[j].ocspMutex, NULL);
+		}
+		CSSSiteCount += 1;
 
-	BIO *bio = BIO_new(BIO_s_file());
-	if (!bio) {
-		CSDestroySecurityManager();
-		return -5;
-	}
-	if (!BIO_read_filename(bio, OMSCertificateChainFile)) {
-		BIO_free(bio);
-		CSDestroySecurityManager();
-		return -6;
-	}
+		site->certificatesModified = getCertificatesModified(site);
+		ret = createContext(site, &context, leaves);
+		if (ret <= 0) {
+			fprintf(stderr, ANSI_COLOR_RED"[Security::CSSetupSecurityManager]"
+					" Failed to load the certificate %s (%i)."
+					ANSI_COLOR_RESETLN, site->certificate->name, ret);
+			CSDestroySecurityManager();
+			return ret;
+		}
 
-	cert = X509_new();
-	if (!cert) {
-		BIO_free(bio);
-		CSDestroySecurityManager();
-		return -7;
-	}
+		installContext(site, context, leaves);
 
-	/* TODO Check this return value ! */
-	PEM_read_bio_X509(bio, &cert, 0, NULL);
+		/* The server can run without a stapled response. */
+		reloadOCSPResponses(site);
+	}
 
-	if (!SSL_CTX_add1_chain_cert(SSLContext, cert)) {
-		BIO_free(bio);
-		X509_free(cert);
+	if (!buildHostTable(&CSSHosts)) {
 		CSDestroySecurityManager();
-		return -8;
+		return -12;
 	}
-	BIO_free(bio);
-	X509_free(cert);
-
-	SSL_CTX_set_alpn_select_cb(SSLContext, alpnHandler, NULL);
 
 	return 1;
 }
 
 void
 CSDestroySecurityManager(void) {
+	size_t i;
+	size_t j;
+
 	/* Clean our objects */
-	SSL_CTX_free(SSLContext);
+	for (i = 0; i < CSSSiteCount; i++) {
+		SSL_CTX_free(CSSSites[i].context);
+
+		for (j = 0; j < CSSSites[i].keyPairCount; j++) {
+			X509_free(CSSSites[i].keyPairs[j].certificate);
+			OPENSSL_free(CSSSites[i].keyPairs[j].ocspResponse);
+			pthread_mutex_destroy(&CSSSites[i].keyPairs[j].ocspMutex);
+		}
+	}
+
+	free(CSSSites);
+	CSSSites = NULL;
+	CSSSiteCount = 0;
+	destroyHostTable(&CSSHosts);
+	SRDestroy();
+	CPDestroy();
+
+	free(CSSCipherList);
+	CSSCipherList = NULL;
+	free(CSSCipherSuites);
+	CSSCipherSuites = NULL;
 
 	/* Clean internal state */
 	/*FIPS_mode_set(0); */
@@ -185,54 +1300,464 @@ CSDestroySecurityManager(void) {
 	CRYPTO_cleanup_all_ex_data();
 }
 
+bool
+CSSHaveCertificatesChanged(void) {
+	size_t i;
+
+	for (i = 0; i < CSSSiteCount; i++)
+		if (getCertificatesModified(&CSSSites[i]) !=
+			CSSSites[i].certificatesModified)
+			return true;
+
+	return false;
+}
+
+/* Returns false, keeping the old context, if the new one can't be built. */
+static bool
+reloadSite(struct CSSSite *site) {
+	X509 *leaves[OMS_MAX_KEY_PAIRS];
+	SSL_CTX *context;
+	int ret;
+
+	/* Even if loading fails, e.g. because the files are being replaced, the
+	 * reload is retried only after the files are modified again. */
+	site->certificatesModified = getCertificatesModified(site);
+
+	ret = createContext(site, &context, leaves);
+	if (ret <= 0) {
+		fprintf(stderr, ANSI_COLOR_RED"[Security::reloadSite] Failed to load "
+				"the certificate %s (%i), still using the old one."
+				ANSI_COLOR_RESETLN, site->certificate->name, ret);
+		return false;
+	}
+
+	installContext(site, context, leaves);
+	SMAddCounter(SMC_TLS_CONTEXT_RELOADS, 1);
+
+	/* The responses for the previous certificates must be replaced. */
+	reloadOCSPResponses(site);
+	return true;
+}
+
+bool
+CSSReloadSecurityManager(void) {
+	struct CSSHostTable hosts;
+	struct CSSHostTable oldHosts;
+	bool hasSucceeded;
+	size_t i;
+
+	hasSucceeded = true;
+	for (i = 0; i < CSSSiteCount; i++)
+		if (!reloadSite(&CSSSites[i]))
+			hasSucceeded = false;
+
+	/* The hostnames of the new certificates might have changed. */
+	if (!buildHostTable(&hosts)) {
+		fputs(ANSI_COLOR_RED"[Security::CSSReloadSecurityManager] Failed to "
+			  "rebuild the hostname table."ANSI_COLOR_RESETLN, stderr);
+		return false;
+	}
+
+	pthread_mutex_lock(&CSSContextMutex);
+	{
+		oldHosts = CSSHosts;
+		CSSHosts = hosts;
+	}
+	pthread_mutex_unlock(&CSSContextMutex);
+
+	destroyHostTable(&oldHosts);
+	return hasSucceeded;
+}
+
+bool
+CSSHasOCSPResponseChanged(void) {
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < CSSSiteCount; i++) {
+		for (j = 0; j < CSSSites[i].keyPairCount; j++) {
+			const struct CSSKeyPair *keyPair;
+
+			keyPair = &CSSSites[i].keyPairs[j];
+			if (keyPair->files->ocspResponseFile != NULL &&
+				getModified(keyPair->files->ocspResponseFile) !=
+				keyPair->ocspResponseModified)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+bool
+CSSReloadOCSPResponse(void) {
+	bool hasSucceeded;
+	size_t i;
+
+	hasSucceeded = true;
+	for (i = 0; i < CSSSiteCount; i++)
+		if (!reloadOCSPResponses(&CSSSites[i]))
+			hasSucceeded = false;
+
+	return hasSucceeded;
+}
+
+/* Updates the handshake counters after a successful handshake. */
+static void
+notifyHandshake(CSSClient client) {
+	SRNotifyHandshake(client);
+
+	/* Only full handshakes use the certificate to sign. */
+	if (SSL_session_reused(client))
+		return;
+
+	switch (getKeyType(SSL_get_certificate(client))) {
+		case EVP_PKEY_EC:
+			SMAddCounter(SMC_TLS_HANDSHAKES_ECDSA, 1);
+			break;
+		case EVP_PKEY_RSA:
+		case EVP_PKEY_RSA_PSS:
+			SMAddCounter(SMC_TLS_HANDSHAKES_RSA, 1);
+			break;
+		default:
+			break;
+	}
+}
+
+static struct CSSClientState *
+getClientState(CSSClient client) {
+	return SSL_get_ex_data(client, CSSClientStateIndex);
+}
+
+/* Checks if the early data contains the complete head of an HTTP request. */
+static bool
+hasRequestHead(const struct CSSClientState *state) {
+	size_t i;
+
+	for (i = 3; i < state->earlyDataSize; i++)
+		if (memcmp(state->earlyData + i - 3, "\r\n\r\n", 4) == 0)
+			return true;
+
+	return false;
+}
+
+/**
+ * Reads early data into the state. Stops when the head of a request was
+ * received, unless 'untilFinished' is set. On a non-blocking socket, the
+ * status might also ask to retry when the socket is ready.
+ */
+static enum EarlyDataStatus
+readEarlyData(CSSClient client, struct CSSClientState *state,
+			  bool untilFinished) {
+	char buf[CSS_EARLY_DATA_CHUNK];
+
+	while (true) {
+		char *newData;
+		size_t readBytes;
+		int ret;
+
+		readBytes = 0;
+		ret = SSL_read_early_data(client, buf, sizeof(buf), &readBytes);
+		if (ret == SSL_READ_EARLY_DATA_ERROR) {
+			switch (SSL_get_error(client, ret)) {
+				case SSL_ERROR_WANT_ASYNC:
+					return EDS_WANT_ASYNC;
+				case SSL_ERROR_WANT_READ:
+					return EDS_WANT_READ;
+				case SSL_ERROR_WANT_WRITE:
+					return EDS_WANT_WRITE;
+				default:
+					return EDS_ERROR;
+			}
+		}
+
+		if (ret == SSL_READ_EARLY_DATA_FINISH) {
+			state->hasReadEarlyData = true;
+			return EDS_FINISHED;
+		}
+
+		if (readBytes == 0)
+			continue;
+
+		newData = realloc(state->earlyData, state->earlyDataSize + readBytes);
+		if (newData == NULL)
+			return EDS_ERROR;
+
+		memcpy(newData + state->earlyDataSize, buf, readBytes);
+		state->earlyData = newData;
+		state->earlyDataSize += readBytes;
+
+		if (!untilFinished && hasRequestHead(state))
+			return EDS_REQUEST_HEAD;
+	}
+}
+
 void
 CSSDestroyClient(CSSClient client) {
+	struct CSSClientState *clientState;
+	bool isHandshakePending;
 	int state;
 	char unused[1];
 
+	clientState = getClientState(client);
+	isHandshakePending = false;
+	if (clientState != NULL) {
+		isHandshakePending = clientState->isHandshakePending;
+		SSL_set_ex_data(client, CSSClientStateIndex, NULL);
+		free(clientState->earlyData);
+		free(clientState);
+	}
+
+	/* A shutdown can't be performed if the handshake hasn't completed. */
+	if (isHandshakePending) {
+		SSL_free(client);
+		return;
+	}
+
 	/* Check if we can still read, so we can perform a proper shutdown. */
 	state = SSL_read(client, unused, 1);
-	if (SSL_get_error(client, state) == SSL_ERROR_NONE)
-		SSL_shutdown(client);
+	switch (SSL_get_error(client, state)) {
+		case SSL_ERROR_NONE:
+		case SSL_ERROR_ZERO_RETURN:
+			SSL_shutdown(client);
+			break;
+		case SSL_ERROR_SYSCALL:
+			/* Before OpenSSL 3, a missing close_notify is reported this way.
+			 * That doesn't make the session unsafe to resume, but OpenSSL
+			 * would remove it from the session cache. */
+			SSL_set_shutdown(client, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+			break;
+		default:
+			break;
+	}
 
 	SSL_free(client);
 }
 
-int
-CSSSetupClient(int sockfd, CSSClient *client) {
+enum CSSHandshakeStatus
+CSSContinueHandshake(CSSClient client) {
+	struct CSSClientState *state;
 	int ret;
+
+	state = getClientState(client);
+
+	if (OMSMaxEarlyData != 0 && !state->hasReadEarlyData) {
+		switch (readEarlyData(client, state, state->mustFinishEarlyData)) {
+			case EDS_ERROR:
+				return CSSHS_ERROR;
+			case EDS_WANT_ASYNC:
+				return CSSHS_WANT_ASYNC;
+			case EDS_WANT_READ:
+				return CSSHS_WANT_READ;
+			case EDS_WANT_WRITE:
+				return CSSHS_WANT_WRITE;
+			case EDS_REQUEST_HEAD:
+				/* The request can be handled before the client's Finished
+				 * arrives, saving a round trip. HTTP/2 frames can't be
+				 * recognized this easily, so these connections always
+				 * complete the handshake first. */
+				if (CSSGetProtocol(client) == CSPROT_HTTP1 ||
+					CSSGetProtocol(client) == CSPROT_NONE) {
+					state->isHandshakePending = true;
+					SSL_clear_mode(client, SSL_MODE_ASYNC);
+					return CSSHS_DONE;
+				}
+
+				state->mustFinishEarlyData = true;
+				return CSSContinueHandshake(client);
+			case EDS_FINISHED:
+				break;
+		}
+	}
+
+	ret = SSL_accept(client);
+	if (ret == 1) {
+		/* Reads and writes don't need async jobs. */
+		SSL_clear_mode(client, SSL_MODE_ASYNC);
+		notifyHandshake(client);
+		return CSSHS_DONE;
+	}
+
+	switch (SSL_get_error(client, ret)) {
+		case SSL_ERROR_WANT_ASYNC:
+			return CSSHS_WANT_ASYNC;
+		case SSL_ERROR_WANT_READ:
+			return CSSHS_WANT_READ;
+		case SSL_ERROR_WANT_WRITE:
+			return CSSHS_WANT_WRITE;
+		default:
+			return CSSHS_ERROR;
+	}
+}
+
+int
+CSSGetAsyncFD(CSSClient client) {
+	OSSL_ASYNC_FD fd;
+	size_t count;
+
+	if (!SSL_get_all_async_fds(client, NULL, &count) || count != 1 ||
+		!SSL_get_all_async_fds(client, &fd, &count))
+		return -1;
+
+	return fd;
+}
+
+CSSClient
+CSSCreateClient(int sockfd) {
 	SSL *ssl;
+	struct CSSClientState *state;
 
-	if (!IOTimeoutAvailableData(sockfd, CSS_POLL_TIMEOUT))
-		return 0;
+	/* The context is switched if the client requests another site. */
+	pthread_mutex_lock(&CSSContextMutex);
+	{
+		ssl = SSL_new(CSSSites[0].context);
+	}
+	pthread_mutex_unlock(&CSSContextMutex);
 
-	ssl = SSL_new(SSLContext);
 	if (!ssl)
-		return -1;
+		return NULL;
+
+	state = calloc(1, sizeof(struct CSSClientState));
+	if (state == NULL) {
+		SSL_free(ssl);
+		return NULL;
+	}
+	SSL_set_ex_data(ssl, CSSClientStateIndex, state);
 
 	/* attach socket */
 	if (!SSL_set_fd(ssl, sockfd)) {
 		CSSDestroyClient(ssl);
-		return -2;
+		return NULL;
 	}
 
-	ret = SSL_accept(ssl);
-	if (ret <= 0) {
-		CSSDestroyClient(ssl);
-		return -3;
+	/* The handshake runs in an async job, which is paused while the crypto
+	 * pool computes the signature. */
+	if (CPIsEnabled())
+		SSL_set_mode(ssl, SSL_MODE_ASYNC);
+
+	/* Small records are only useful if they are sent right away, instead of
+	 * being held back by Nagle's algorithm until the previous one is
+	 * acknowledged. */
+	if (OMSRecordSmallCount != 0) {
+		int flag;
+
+		flag = 1;
+		setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
 	}
 
-	*client = ssl;
-	return 1;
+	return ssl;
+}
+
+bool
+CSSCompleteHandshake(CSSClient client) {
+	struct CSSClientState *state;
+
+	state = getClientState(client);
+	if (state == NULL || !state->isHandshakePending)
+		return true;
+
+	state->isHandshakePending = false;
+	if (readEarlyData(client, state, true) != EDS_FINISHED ||
+		SSL_do_handshake(client) <= 0)
+		return false;
+
+	notifyHandshake(client);
+	return true;
+}
+
+bool
+CSSIsHandshakePending(CSSClient client) {
+	struct CSSClientState *state;
+
+	state = getClientState(client);
+	return state != NULL && state->isHandshakePending;
+}
+
+bool
+CSSWaitClient(CSSClient client, size_t microTimeout) {
+	struct CSSClientState *state;
+
+	state = getClientState(client);
+	if (state != NULL && state->earlyData != NULL)
+		return true;
+
+	/* Completing the handshake might read more early data. */
+	if (!CSSCompleteHandshake(client))
+		return false;
+
+	if (state != NULL && state->earlyData != NULL)
+		return true;
+
+	/* Data may already be decrypted and buffered by OpenSSL, in which case
+	 * the socket itself won't be readable. */
+	if (SSL_has_pending(client))
+		return true;
+
+	return IOTimeoutAvailableData(SSL_get_fd(client), microTimeout);
+}
+
+/**
+ * Starts over with small records if the connection has been idle for
+ * OMSRecordIdleTimeout milliseconds, since the congestion window might have
+ * been reset. Returns the amount of octets that should still be sent using
+ * small records.
+ */
+static size_t
+beginWrite(struct CSSClientState *state) {
+	struct timespec now;
+	int64_t elapsed;
+
+	if (state == NULL || OMSRecordSmallCount == 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (int64_t) (now.tv_sec - state->lastWrite.tv_sec) * 1000 +
+			  (now.tv_nsec - state->lastWrite.tv_nsec) / 1000000;
+	if (elapsed >= (int64_t) OMSRecordIdleTimeout)
+		state->smallRecords = 0;
+	state->lastWrite = now;
+
+	if (state->smallRecords >= OMSRecordSmallCount)
+		return 0;
+	return (OMSRecordSmallCount - state->smallRecords) * OMSRecordSmallSize;
 }
 
 /* TODO this implementation is blocking */
 bool
 CSSWriteClient(CSSClient client, const char *buf, size_t len) {
+	struct CSSClientState *state;
+	bool isEarly;
+
+	state = getClientState(client);
+	beginWrite(state);
+
+	isEarly = CSSIsHandshakePending(client);
 	do {
 		ssize_t ret;
+		size_t size;
+
+		/* Every write of at most 16 KB becomes a single record. A small
+		 * record fits in one TCP segment, so the client can decrypt and
+		 * parse it as soon as it arrives, instead of waiting for all
+		 * segments of a full record. After OMSRecordSmallCount records, the
+		 * connection is busy and full records have less overhead. */
+		size = len;
+		if (state != NULL && state->smallRecords < OMSRecordSmallCount) {
+			if (size > OMSRecordSmallSize)
+				size = OMSRecordSmallSize;
+			state->smallRecords += 1;
+		}
+
+		/* Before the handshake completes, the response is sent as 0.5-RTT
+		 * data. */
+		if (isEarly) {
+			size_t written;
 
-		ret = SSL_write(client, buf, len);
+			ret = SSL_write_early_data(client, buf, size, &written) == 1
+				? (ssize_t) written : -1;
+		} else {
+			ret = SSL_write(client, buf, size);
+		}
 
 		if (ret <= 0) {
 #ifdef CORE_SECURITY_FLAG_FIX_WRITE_ERRORS
@@ -250,6 +1775,7 @@ CSSWriteClient(CSSClient client, const char *buf, size_t len) {
 			return false;
 		}
 
+		countEncrypted(client, (size_t) ret);
 		buf += ret;
 		len -= ret;
 	} while (len > 0);
@@ -257,8 +1783,81 @@ CSSWriteClient(CSSClient client, const char *buf, size_t len) {
 	return true;
 }
 
+bool
+CSSSendFile(CSSClient client, int fd, const char *buf, size_t len) {
+#ifdef CSS_KTLS
+	off_t offset;
+	size_t small;
+
+	if (fd == -1 || !BIO_get_ktls_send(SSL_get_wbio(client)))
+		return CSSWriteClient(client, buf, len);
+
+	/* The kernel always uses full records, so the beginning is written from
+	 * the buffer instead. */
+	small = beginWrite(getClientState(client));
+	if (small >= len)
+		return CSSWriteClient(client, buf, len);
+
+	if (small != 0 && !CSSWriteClient(client, buf, small))
+		return false;
+
+	offset = small;
+	len -= small;
+	do {
+		ossl_ssize_t ret;
+
+		ret = SSL_sendfile(client, fd, offset, len, 0);
+		if (ret <= 0)
+			return false;
+
+		countEncrypted(client, (size_t) ret);
+		offset += ret;
+		len -= ret;
+	} while (len > 0);
+
+	return true;
+#else
+	UNUSED(fd);
+	return CSSWriteClient(client, buf, len);
+#endif
+}
+
 bool
 CSSReadClient(CSSClient client, char *buf, size_t len) {
+	struct CSSClientState *state;
+
+	/* Early data is consumed first. */
+	state = getClientState(client);
+	if (state != NULL && state->earlyData != NULL) {
+		size_t size;
+
+		size = state->earlyDataSize - state->earlyDataOffset;
+		if (size > len)
+			size = len;
+
+		memcpy(buf, state->earlyData + state->earlyDataOffset, size);
+		state->earlyDataOffset += size;
+		buf += size;
+		len -= size;
+
+		if (state->earlyDataOffset == state->earlyDataSize) {
+			free(state->earlyData);
+			state->earlyData = NULL;
+			state->earlyDataOffset = 0;
+			state->earlyDataSize = 0;
+		}
+
+		if (len == 0)
+			return true;
+	}
+
+	if (!CSSCompleteHandshake(client))
+		return false;
+
+	/* Completing the handshake might have read more early data. */
+	if (state != NULL && state->earlyData != NULL)
+		return CSSReadClient(client, buf, len);
+
 	do {
 		ssize_t ret;
 
@@ -274,6 +1873,30 @@ CSSReadClient(CSSClient client, char *buf, size_t len) {
 	return true;
 }
 
+size_t
+CSSReadClientAvailable(CSSClient client, char *buf, size_t len) {
+	struct CSSClientState *state;
+	size_t size;
+	int ret;
+
+	/* Early data is consumed first, see CSSReadClient(). Completing the
+	 * handshake might read more of it. */
+	state = getClientState(client);
+	if ((state == NULL || state->earlyData == NULL) &&
+		!CSSCompleteHandshake(client))
+		return 0;
+
+	if (state != NULL && state->earlyData != NULL) {
+		size = state->earlyDataSize - state->earlyDataOffset;
+		if (size > len)
+			size = len;
+		return CSSReadClient(client, buf, size) ? size : 0;
+	}
+
+	ret = SSL_read(client, buf, len > INT_MAX ? INT_MAX : (int) len);
+	return ret > 0 ? (size_t) ret : 0;
+}
+
 static int
 compareALPN(const unsigned char *a,
 			const unsigned char *b,
@@ -46,23 +46,126 @@ enum CSProtocol {
 	CSPROT_NONE,
 };
 
+enum CSSHandshakeStatus {
+	CSSHS_DONE,
+	CSSHS_ERROR,
+	/* The handshake should be continued when the socket is readable. */
+	CSSHS_WANT_READ,
+	/* The handshake should be continued when the socket is writable. */
+	CSSHS_WANT_WRITE,
+	/* The handshake should be continued when the file descriptor returned by
+	 * CSSGetAsyncFD() is readable. */
+	CSSHS_WANT_ASYNC,
+};
+
 void
 CSDestroySecurityManager(void);
 
+/**
+ * Checks if the certificate files were modified since they were (last
+ * attempted to be) loaded.
+ */
+bool
+CSSHaveCertificatesChanged(void);
+
+/* Checks if an OCSP response file was modified since it was loaded. */
+bool
+CSSHasOCSPResponseChanged(void);
+
+/**
+ * Loads the OCSP response files, which are kept up to date by an external
+ * fetcher, and staples them from now on. Returns false if a file doesn't
+ * contain a usable response, in which case nothing is stapled for that
+ * certificate.
+ */
+bool
+CSSReloadOCSPResponse(void);
+
+/**
+ * Loads the certificates into new contexts, which are used for new
+ * connections. Existing connections keep using the old contexts until they
+ * are closed. If a certificate fails to load, its old context stays in use.
+ */
+bool
+CSSReloadSecurityManager(void);
+
 int
 CSSetupSecurityManager(void);
 
+/**
+ * Performs the next steps of the handshake. The socket may be non-blocking,
+ * in which case this function should be called again when the socket is
+ * ready, as indicated by the return value.
+ *
+ * If the client sent the head of an HTTP/1 request as early data, CSSHS_DONE
+ * is returned while the handshake is still pending; see
+ * CSSIsHandshakePending().
+ */
+enum CSSHandshakeStatus
+CSSContinueHandshake(CSSClient);
+
+/**
+ * Creates a client for the socket. The handshake is performed by
+ * CSSContinueHandshake(). Returns NULL on failure.
+ */
+CSSClient
+CSSCreateClient(int);
+
+/**
+ * Returns the file descriptor that becomes readable when the crypto pool has
+ * finished the work of a handshake that returned CSSHS_WANT_ASYNC, or -1.
+ */
+int
+CSSGetAsyncFD(CSSClient);
+
 void
 CSSDestroyClient(CSSClient);
 
 enum CSProtocol
 CSSGetProtocol(CSSClient);
 
+/**
+ * Completes the handshake if the client sent its first request as early
+ * (0-RTT) data, which is still pending. Returns false on failure.
+ */
+bool
+CSSCompleteHandshake(CSSClient);
+
+/**
+ * Checks if the handshake hasn't completed yet, which means the current
+ * request was sent as early data. Early data can be replayed by an attacker,
+ * so only safe requests should be answered before the handshake completes;
+ * others should call CSSCompleteHandshake() first.
+ */
+bool
+CSSIsHandshakePending(CSSClient);
+
 bool
 CSSReadClient(CSSClient, char *, size_t);
 
-int
-CSSSetupClient(int, CSSClient *);
+/**
+ * Reads at least one octet and at most the given amount, so a buffer can be
+ * filled with what has arrived without waiting for the rest. Returns the
+ * amount of octets that were read, or 0 on failure.
+ */
+size_t
+CSSReadClientAvailable(CSSClient, char *, size_t);
+
+/**
+ * Waits until data is available to be read from the client, or until the
+ * timeout (in microseconds) has expired. Returns false on timeout.
+ */
+bool
+CSSWaitClient(CSSClient, size_t);
+
+/**
+ * Sends the contents of the file descriptor (the first octets given by the
+ * last parameter) with sendfile(2), when kernel TLS is active for the
+ * connection. Otherwise, or if the file descriptor is -1, the buffer, which
+ * should contain the same data, is written using CSSWriteClient().
+ */
+bool
+CSSSendFile(CSSClient, int, const char *, size_t);
 
 bool
 CSSWriteClient(CSSClient, const char *, size_t);
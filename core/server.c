@@ -32,88 +32,171 @@
 #include <sys/socket.h>
 
 #include <errno.h>
+#include <poll.h>
 #include <pthread.h>
-#include <sched.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "base/global_state.h"
 #include "core/h1.h"
 #include "core/h2.h"
+#include "core/handshake.h"
+#include "core/load_shedding.h"
 #include "core/security.h"
 #include "misc/default.h"
+#include "misc/io.h"
+#include "misc/options.h"
+#include "misc/rate_limiter.h"
+#include "misc/statistics.h"
 
 void *
 CSChildEntrypoint(void *threadParameter) {
 	struct GSThread *thread = threadParameter;
-	CSSClient client = NULL;
-	int ret;
-
-	ret = CSSSetupClient(thread->sockfd, &client);
-
-	if (ret <= 0) {
-		printf("Failed to setup client: %i\n", ret);
-	} else if (client == NULL) {
-		printf("Client was NULL: %i\n", ret);
-	} else {
-		switch (CSSGetProtocol(client)) {
-			case CSPROT_ERROR:
-				break;
-			case CSPROT_HTTP2:
-				CSHandleHTTP2(client);
-				break;
-			case CSPROT_HTTP1:
-			case CSPROT_NONE:
-				CSHandleHTTP1(client);
-				break;
-		}
+	CSSClient client = thread->data;
+
+	LSNotifyQueueWait(&thread->scheduleTime);
 
-		CSSDestroyClient(client);
+	switch (CSSGetProtocol(client)) {
+		case CSPROT_ERROR:
+			break;
+		case CSPROT_HTTP2:
+			CSHandleHTTP2(client);
+			break;
+		case CSPROT_HTTP1:
+		case CSPROT_NONE:
+			CSHandleHTTP1(client);
+			break;
 	}
 
+	CSSDestroyClient(client);
 	GSChildThreadRelease(thread);
 	return NULL;
 }
 
-void *
-CSEntrypoint(void *threadParameter) {
-	UNUSED(threadParameter);
-
-	while (GSMainLoop) {
-		int sockfd;
+static void
+handshakeCompleted(CSSClient client, int sockfd) {
+	/* The handlers use blocking I/O. */
+	if (IOSetNonBlocking(sockfd, false) &&
+		GSScheduleChildThread(GSTP_CORE, CSChildEntrypoint, sockfd, client))
+		return;
+
+	/* When no thread is available, the connection is shed instead of
+	 * stopping the service. The socket must be non-blocking again, so the
+	 * destruction of the client doesn't wait for the peer. */
+	IOSetNonBlocking(sockfd, true);
+	CSSDestroyClient(client);
+	close(sockfd);
+	SMAddCounter(SMC_LOAD_SHED_CONNECTIONS, 1);
+}
 
-		sockfd = accept(GSCoreSocket, NULL, 0);
+/**
+ * Accepts the connections that are waiting in the backlog, as many as the
+ * handshake queue has room for, so a burst doesn't cost a scan of the queue
+ * per connection. Returns false when the listening socket failed.
+ */
+static bool
+acceptConnections(struct HSQueue *handshakes) {
+	struct sockaddr_storage address;
+	socklen_t addressLength;
+	size_t remaining;
+	int sockfd;
+
+	/* A full queue still takes a connection, which is shed, so clients
+	 * aren't left waiting in the backlog. */
+	remaining = handshakes->capacity - handshakes->count;
+	if (remaining == 0)
+		remaining = 1;
+
+	while (remaining-- > 0) {
+		addressLength = sizeof(address);
+		sockfd = accept(GSCoreSocket, (struct sockaddr *) &address,
+						&addressLength);
 
 		if (sockfd == -1) {
-			if (errno == EAGAIN ||
-				errno == EWOULDBLOCK ||
-				errno == ECONNABORTED
-			) {
-				if (sched_yield() == -1) {
-					perror(ANSI_COLOR_RED
-						   "[CoreService] sched_yield() failed"
-						   ANSI_COLOR_RESET);
-				}
+			if (errno == ECONNABORTED || errno == EINTR)
 				continue;
-			}
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
 
 			perror(ANSI_COLOR_RED
 				   "[CoreService] [CRITICAL] Socket I/O error occurred"
 				   ANSI_COLOR_RESET);
-			break;
+			return false;
 		}
 
-		if (!GSScheduleChildThread(GSTP_REDIR, CSChildEntrypoint, sockfd)) {
-			fputs(
-				ANSI_COLOR_RED
-				"[CoreService] [CRITICAL] Failed to schedule child thread."
-				ANSI_COLOR_RESETLN,
-				stderr
-			);
+		if (!RLAdmit((struct sockaddr *) &address)) {
+			close(sockfd);
+			continue;
+		}
+
+		/* Too many handshakes are in progress: */
+		if (!HSSubmit(handshakes, sockfd)) {
+			close(sockfd);
+			SMAddCounter(SMC_LOAD_SHED_CONNECTIONS, 1);
+		}
+	}
+
+	return true;
+}
+
+void *
+CSEntrypoint(void *threadParameter) {
+	UNUSED(threadParameter);
+
+	struct HSQueue handshakes;
+	struct pollfd *pollInfo;
+
+	/* The first entry is the listening socket, the others are the sockets of
+	 * the pending handshakes. */
+	pollInfo = calloc(OMSMaxPendingHandshakes + 1, sizeof(struct pollfd));
+	if (pollInfo == NULL ||
+		!HSInit(&handshakes, OMSMaxPendingHandshakes, handshakeCompleted)) {
+		fputs(ANSI_COLOR_RED"[CoreService] Failed to allocate the handshake "
+			  "queue"ANSI_COLOR_RESETLN, stderr);
+		free(pollInfo);
+		GSCoreThreadState = 0;
+		pthread_exit(NULL);
+		return NULL;
+	}
+
+	pollInfo[0].fd = GSCoreSocket;
+
+	while (GSMainLoop) {
+		size_t count;
+		int ret;
+
+		pollInfo[0].events = POLLIN;
+		pollInfo[0].revents = 0;
+		count = HSPreparePoll(&handshakes, pollInfo + 1);
+
+		/* Wake up once in a while to check GSMainLoop and to abort handshakes
+		 * that have timed out */
+		ret = poll(pollInfo, count + 1, 1000);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror(ANSI_COLOR_RED"[CoreService] poll failed"ANSI_COLOR_RESET);
 			break;
 		}
+
+		HSProcess(&handshakes, pollInfo + 1);
+
+		/* The socket was closed: */
+		if (pollInfo[0].revents & POLLNVAL)
+			break;
+
+		if ((pollInfo[0].revents & POLLIN) &&
+			!acceptConnections(&handshakes))
+			break;
 	}
 
+	HSDestroy(&handshakes);
+	free(pollInfo);
+
 	GSCoreThreadState = 0;
 	pthread_exit(NULL);
 	return NULL;
@@ -0,0 +1,162 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "path.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HTTP_PATH_ONES	0x0101010101010101ULL
+#define HTTP_PATH_HIGHS	0x8080808080808080ULL
+
+/**
+ * Checks if one of the bytes of the word is equal to 'c'. This is the classic
+ * "has zero byte" bit trick, which lets us scan 8 bytes at once.
+ */
+static inline uint64_t
+matchByte(uint64_t word, unsigned char c) {
+	uint64_t x;
+
+	x = word ^ (HTTP_PATH_ONES * c);
+	return (x - HTTP_PATH_ONES) & ~x & HTTP_PATH_HIGHS;
+}
+
+static int
+decodeHexDigit(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Removes the segment between 'segment' and 'out' if it is a dot segment.
+ * Returns the new end of the output.
+ */
+static char *
+removeDotSegment(const char *output, char *segment, char *out) {
+	size_t length;
+
+	length = out - segment;
+	if (length == 1 && segment[0] == '.')
+		return segment;
+
+	if (length != 2 || segment[0] != '.' || segment[1] != '.')
+		return out;
+
+	/* The root can't be left, so '/..' is the same as '/'. */
+	if (segment - 1 == output)
+		return segment;
+
+	out = segment - 1;
+	while (out[-1] != '/')
+		out--;
+	return out;
+}
+
+bool
+HTTPCanonicalizePath(const char *path, size_t length, char *output,
+					 size_t *outputLength) {
+	const char *end;
+	char *out;
+	char *segment;
+
+	if (length == 0 || path[0] != '/')
+		return false;
+
+	end = path + length;
+	out = output;
+	*out++ = '/';
+	segment = out;
+	path++;
+
+	while (path < end) {
+		int high;
+		int low;
+
+		/* Most segments are plain characters, so copy those 8 at a time. */
+		while (end - path >= 8) {
+			uint64_t word;
+
+			memcpy(&word, path, 8);
+			if (matchByte(word, '/') | matchByte(word, '%') |
+				matchByte(word, '?') | matchByte(word, '#'))
+				break;
+
+			memcpy(out, path, 8);
+			out += 8;
+			path += 8;
+		}
+
+		if (path == end)
+			break;
+
+		switch (*path) {
+			case '?':
+			case '#':
+				end = path;
+				break;
+			case '/':
+				out = removeDotSegment(output, segment, out);
+				if (out[-1] != '/')
+					*out++ = '/';
+				segment = out;
+				path++;
+				break;
+			case '%':
+				if (end - path < 3)
+					return false;
+
+				high = decodeHexDigit(path[1]);
+				low = decodeHexDigit(path[2]);
+				if (high == -1 || low == -1)
+					return false;
+
+				/* An encoded slash would make the segments ambiguous. */
+				if ((high == 0 && low == 0) || (high == 2 && low == 0xF))
+					return false;
+
+				*out++ = (char) (high << 4 | low);
+				path += 3;
+				break;
+			default:
+				*out++ = *path++;
+				break;
+		}
+	}
+
+	out = removeDotSegment(output, segment, out);
+	*out = '\0';
+	*outputLength = out - output;
+	return true;
+}
@@ -0,0 +1,53 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HTTP_PATH_H
+#define HTTP_PATH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Canonicalizes the path of a request target in a single pass: the query and
+ * fragment are stripped, percent-encoded octets are decoded, dot segments are
+ * removed and consecutive slashes are collapsed. For example,
+ * '/a//./b/../%63.css?v=2' becomes '/a/c.css'.
+ *
+ * The output buffer must be at least one octet larger than the input, since
+ * the canonical path is never longer. The length of the canonical path is
+ * stored in the last parameter, and the output is NUL-terminated.
+ *
+ * Returns false if the path is invalid, i.e. it doesn't start with a slash,
+ * has a malformed percent-encoding, or encodes a NUL or a slash ('%00' and
+ * '%2F').
+ */
+bool
+HTTPCanonicalizePath(const char *, size_t, char *, size_t *);
+
+#endif /* HTTP_PATH_H */
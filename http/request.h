@@ -0,0 +1,67 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define METHOD_SIZE			64
+#define PATH_SIZE			2048
+#define VERSION_SIZE		8
+#define HEADER_NAME_SIZE	64
+#define HEADER_VALUE_SIZE	256
+#define HEADER_STEP_SIZE 	8
+
+struct HTTPHeader {
+	/* Even though a perfect-sized-buffer is better memory wise, doing a lot of
+	 * allocations is worse CPU wise. */
+	char name[HEADER_NAME_SIZE];
+	char value[HEADER_VALUE_SIZE];
+};
+
+/**
+ * The request as parsed by both the HTTP/1.x parser and the HTTP/2 header
+ * block decoder, so the rest of the pipeline doesn't have to know which
+ * version the client speaks.
+ */
+struct HTTPRequest {
+	char	buffer[2];
+	/* Whether or not the connection should be closed after this request. */
+	bool	closeConnection;
+	struct HTTPHeader	*headers;
+	uint8_t headersSize;
+	uint8_t headerCount;
+	char	method[METHOD_SIZE];
+	char	path[PATH_SIZE];
+	char	version[VERSION_SIZE];
+};
+
+#endif /* HTTP_REQUEST_H */
@@ -48,5 +48,6 @@ const char *HTTPStatus304NotModified = "304 Not Modified";
 const char *HTTPStatus400BadRequest = "400 Bad Request";
 const char *HTTPStatus404NotFound = "404 Not Found";
 const char *HTTPStatus500NotImplemented = "500 Not Implemented";
+const char *HTTPStatus503ServiceUnavailable = "503 Service Unavailable";
 const char *HTTPStatus505HTTPVersionNotSupported =
 				"505 HTTP Version Not Supported";
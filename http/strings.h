@@ -53,6 +53,7 @@ extern const char *HTTPStatus304NotModified;
 extern const char *HTTPStatus400BadRequest;
 extern const char *HTTPStatus404NotFound;
 extern const char *HTTPStatus500NotImplemented;
+extern const char *HTTPStatus503ServiceUnavailable;
 extern const char *HTTPStatus505HTTPVersionNotSupported;
 
 
@@ -44,5 +44,9 @@ const char *H2DFrameTypeNames[] = {
 	"CONTINUATION",
 	"ALTSVC",
 	NULL,
-	"ORIGIN"
+	"ORIGIN",
+	NULL,
+	NULL,
+	NULL,
+	"PRIORITY_UPDATE"
 };
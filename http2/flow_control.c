@@ -0,0 +1,131 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "flow_control.h"
+
+#include <string.h>
+
+#include "http2/frame.h"
+#include "http2/frames/ping.h"
+#include "http2/frames/settings.h"
+#include "http2/frames/window_update.h"
+#include "http2/session.h"
+#include "http2/settings.h"
+#include "http2/stream.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+/**
+ * Grows the receive windows to the given size. The initial window size of the
+ * streams is changed with SETTINGS, which applies to the open streams as well
+ * (RFC 7540 § 6.9.2), and the window of the connection with WINDOW_UPDATE.
+ */
+static bool
+growWindows(struct H2Session *session, uint32_t size) {
+	uint32_t delta = size - session->receiveWindowSize;
+	size_t i;
+	struct H2Setting setting = { H2_SETTING_INITIAL_WINDOW_SIZE, size };
+
+	SMAddCounter(SMC_HTTP2_WINDOWS_GROWN, 1);
+
+	if (!H2SendSettings(session, &setting, 1)
+		|| !H2SendWindowUpdate(session, 0, delta))
+		return false;
+
+	for (i = 0; i < session->streamCount; i++)
+		session->streams[i].receiveWindow += delta;
+	session->receiveWindow += delta;
+	session->receiveWindowSize = size;
+	return true;
+}
+
+bool
+H2ConsumeReceiveWindow(struct H2Session *session, size_t size) {
+	uint32_t increment;
+
+	if (size > (size_t) session->receiveWindow) {
+		session->error = H2_ERROR_FLOW_CONTROL_ERROR;
+		return false;
+	}
+	session->receiveWindow -= size;
+
+	/* Only one sample is taken at a time, and none once the window can't
+	 * grow anymore. */
+	if (session->isBandwidthSampling) {
+		session->bandwidthSample += size;
+	} else if (size != 0
+			   && session->receiveWindowSize < OMHTTP2MaxReceiveWindow) {
+		if (!H2SendPing(session, (const uint8_t *) H2_BDP_PING_DATA, false))
+			return false;
+		session->isBandwidthSampling = true;
+		session->bandwidthSample = size;
+	}
+
+	if (session->receiveWindow > session->receiveWindowSize / 2)
+		return true;
+
+	increment = session->receiveWindowSize - session->receiveWindow;
+	session->receiveWindow += increment;
+	return H2SendWindowUpdate(session, 0, increment);
+}
+
+bool
+H2FinishBandwidthSample(struct H2Session *session, const uint8_t *data) {
+	uint64_t size;
+
+	if (!session->isBandwidthSampling
+		|| memcmp(data, H2_BDP_PING_DATA, 8) != 0)
+		return true;
+	session->isBandwidthSampling = false;
+
+	if (session->bandwidthSample < session->receiveWindowSize / 3 * 2)
+		return true;
+
+	size = (uint64_t) session->bandwidthSample * 2;
+	if (size > OMHTTP2MaxReceiveWindow)
+		size = OMHTTP2MaxReceiveWindow;
+	if (size > H2_MAX_WINDOW_SIZE)
+		size = H2_MAX_WINDOW_SIZE;
+
+	if (size <= session->receiveWindowSize)
+		return true;
+	return growWindows(session, size);
+}
+
+bool
+H2ReplenishStreamWindow(struct H2Session *session, struct H2Stream *stream) {
+	uint32_t increment;
+
+	if (stream->receiveWindow > (int64_t) session->receiveWindowSize / 2)
+		return true;
+
+	increment = session->receiveWindowSize - stream->receiveWindow;
+	stream->receiveWindow += increment;
+	return H2SendWindowUpdate(session, stream->id, increment);
+}
@@ -0,0 +1,67 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Receive-side flow control of HTTP/2 (RFC 7540 § 5.2). Request bodies are
+ * discarded as they arrive, so the windows are replenished right away: they
+ * only serve to pace the client. Their size is tuned to the bandwidth-delay
+ * product, which is sampled by counting the octets that arrive during the
+ * round trip of a PING frame. When a sample nearly fills the window, the
+ * window is what limits the client, so it is grown to twice the sample.
+ */
+
+#ifndef HTTP2_FLOW_CONTROL_H
+#define HTTP2_FLOW_CONTROL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The opaque data of the PING frames that sample the bandwidth-delay
+ * product */
+#define H2_BDP_PING_DATA "BDPprobe"
+
+struct H2Session;
+struct H2Stream;
+
+/**
+ * Accounts a DATA frame (including its padding) against the receive window
+ * of the connection, and replenishes it when half of it is used. Returns
+ * false on a connection error.
+ */
+bool
+H2ConsumeReceiveWindow(struct H2Session *, size_t);
+
+/* Ends the bandwidth-delay product sample of an acknowledged PING frame. */
+bool
+H2FinishBandwidthSample(struct H2Session *, const uint8_t *);
+
+/* Replenishes the receive window of a stream when half of it is used. */
+bool
+H2ReplenishStreamWindow(struct H2Session *, struct H2Stream *);
+
+#endif /* HTTP2_FLOW_CONTROL_H */
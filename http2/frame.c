@@ -29,70 +29,67 @@
 
 #include "frame.h"
 
-#ifdef __FreeBSD__
-	#include <sys/endian.h>
-#else
-	#include <endian.h>
-#endif
-
-#include <netinet/in.h>
-
-#include <stdio.h>
-#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "core/security.h"
 #include "http2/session.h"
 
-/* If this functions returns 0, the contents of frame are undefined (can be any
- * value) */
-bool
-H2ReadFrame(struct H2Session *session, struct H2Frame *frame) {
-	uint8_t buf[4];
+static size_t
+getBufferedLength(const struct H2Session *session) {
+	return session->inputEnd - session->inputStart;
+}
 
-	/* Length */
-	if (!CSSReadClient(session->client, (char *)buf, 3))
+static bool
+queueReference(struct H2Session *session, const uint8_t *data, size_t size) {
+	if (session->outputSliceCount == H2_MAX_OUTPUT_SLICES
+		&& !H2FlushOutput(session))
 		return false;
 
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-	frame->length = (buf[0] << 16) + (buf[1] << 8) + buf[2];
-#endif
-
-	/* Type */
-	if (!CSSReadClient(session->client, (char *) &frame->type, 1))
-		return false;
+	session->outputSlices[session->outputSliceCount].data = data;
+	session->outputSlices[session->outputSliceCount].size = size;
+	session->outputSliceCount += 1;
+	session->outputQueued += size;
+	return true;
+}
 
-	/* Flags */
-	if (!CSSReadClient(session->client, (char *) &frame->flags, 1))
-		return false;
+static bool
+queueCopy(struct H2Session *session, const uint8_t *data, size_t size) {
+	struct H2OutputSlice *last;
 
-	/* R + Stream Identifier */
-	if (!CSSReadClient(session->client, (char *) buf, 4))
+	if ((size > sizeof(session->output) - session->outputSize
+		 || session->outputSliceCount == H2_MAX_OUTPUT_SLICES)
+		&& !H2FlushOutput(session))
 		return false;
-	frame->stream = ntohs((uint32_t) *buf);
 
-// 	puts("Frame information");
-// 	printf("\t length = %x\n", frame->length);
-// 	printf("\t type = %s\n", H2DFrameTypeNames[frame->type]);
-// 	printf("\t flags = %x\n", frame->flags);
-// 	printf("\t stream = %x\n", frame->stream);
+	/* What doesn't fit the buffer is written before the caller can reuse
+	 * its memory. */
+	if (size > sizeof(session->output))
+		return queueReference(session, data, size) && H2FlushOutput(session);
 
-	/* Payload */
-	frame->payload = malloc(frame->length);
-	if (frame->payload == NULL)
-		return false;
+	memcpy(session->output + session->outputSize, data, size);
 
-	if (!CSSReadClient(session->client, (char *)frame->payload,
-			frame->length)) {
-		free(frame->payload);
-		return false;
+	/* Consecutive copies share a slice */
+	last = session->outputSliceCount == 0 ? NULL
+		: &session->outputSlices[session->outputSliceCount - 1];
+	if (last != NULL
+		&& last->data + last->size == session->output + session->outputSize) {
+		last->size += size;
+	} else {
+		session->outputSlices[session->outputSliceCount].data =
+			session->output + session->outputSize;
+		session->outputSlices[session->outputSliceCount].size = size;
+		session->outputSliceCount += 1;
 	}
 
+	session->outputSize += size;
+	session->outputQueued += size;
 	return true;
 }
 
-bool
-H2SendFrame(struct H2Session *session, struct H2Frame *frame) {
-	char buf[9] = {
+static bool
+queueFrame(struct H2Session *session, struct H2Frame *frame, bool isCopied) {
+	uint8_t header[H2_FRAME_HEADER_SIZE] = {
 		frame->length >> 16,
 		frame->length >> 8,
 		frame->length & 0x0000FF,
@@ -104,13 +101,161 @@ H2SendFrame(struct H2Session *session, struct H2Frame *frame) {
 		frame->stream & 0x000000FF
 	};
 
-	if (!CSSWriteClient(session->client, buf, sizeof(buf)))
+	if (!queueCopy(session, header, sizeof(header)))
+		return false;
+
+	if (frame->length != 0 && frame->payload != NULL
+		&& !(isCopied ? queueCopy(session, frame->payload, frame->length)
+			 : queueReference(session, frame->payload, frame->length)))
+		return false;
+
+	if (session->outputQueued >= H2_OUTPUT_FLUSH_SIZE)
+		return H2FlushOutput(session);
+	return true;
+}
+
+static uint32_t
+parseLength(const uint8_t *header) {
+	return ((uint32_t) header[0] << 16) | (header[1] << 8) | header[2];
+}
+
+/* Makes sure the given amount of octets is in the input buffer. */
+static bool
+fillInput(struct H2Session *session, size_t size) {
+	size_t ret;
+
+	if (getBufferedLength(session) >= size)
+		return true;
+
+	/* The rest of a partially received frame is moved to the front when it
+	 * wouldn't fit anymore. This only copies less than a frame, and rarely,
+	 * since the buffer holds two. */
+	if (session->inputStart + size > sizeof(session->input)) {
+		memmove(session->input, session->input + session->inputStart,
+				getBufferedLength(session));
+		session->inputEnd -= session->inputStart;
+		session->inputStart = 0;
+	}
+
+	/* Queued frames are sent before waiting for the client, which might be
+	 * waiting for them in turn. */
+	if (!H2FlushOutput(session))
+		return false;
+
+	do {
+		ret = CSSReadClientAvailable(session->client,
+						(char *) session->input + session->inputEnd,
+						sizeof(session->input) - session->inputEnd);
+		if (ret == 0)
+			return false;
+		session->inputEnd += ret;
+	} while (getBufferedLength(session) < size);
+
+	return true;
+}
+
+bool
+H2FlushOutput(struct H2Session *session) {
+	size_t count = session->outputSliceCount;
+	const uint8_t *data;
+	size_t i;
+	size_t length;
+	size_t recordSize = 0;
+	size_t size;
+
+	/* The queue is emptied up front, since a failed write ends the
+	 * connection anyway. */
+	session->outputSliceCount = 0;
+	session->outputQueued = 0;
+	session->outputSize = 0;
+
+	for (i = 0; i < count; i++) {
+		data = session->outputSlices[i].data;
+		size = session->outputSlices[i].size;
+
+		while (size != 0) {
+			if (recordSize == 0 && size >= H2_RECORD_SIZE) {
+				length = size - size % H2_RECORD_SIZE;
+				if (!CSSWriteClient(session->client, (const char *) data,
+									length))
+					return false;
+			} else {
+				length = H2_RECORD_SIZE - recordSize;
+				if (length > size)
+					length = size;
+
+				memcpy(session->record + recordSize, data, length);
+				recordSize += length;
+				if (recordSize == H2_RECORD_SIZE) {
+					if (!CSSWriteClient(session->client,
+										(const char *) session->record,
+										recordSize))
+						return false;
+					recordSize = 0;
+				}
+			}
+
+			data += length;
+			size -= length;
+		}
+	}
+
+	return recordSize == 0 || CSSWriteClient(session->client,
+								(const char *) session->record, recordSize);
+}
+
+bool
+H2IsFrameBuffered(struct H2Session *session) {
+	const uint8_t *header = session->input + session->inputStart;
+
+	return getBufferedLength(session) >= H2_FRAME_HEADER_SIZE
+		&& getBufferedLength(session) >= H2_FRAME_HEADER_SIZE
+			+ parseLength(header);
+}
+
+bool
+H2ReadFrame(struct H2Session *session, struct H2Frame *frame) {
+	const uint8_t *header;
+
+	if (!fillInput(session, H2_FRAME_HEADER_SIZE))
+		return false;
+
+	header = session->input + session->inputStart;
+	frame->length = parseLength(header);
+	frame->type = header[3];
+	frame->flags = header[4];
+	frame->stream = ((uint32_t) (header[5] & 0x7F) << 24) | (header[6] << 16)
+		| (header[7] << 8) | header[8];
+
+	/* We never advertise a larger SETTINGS_MAX_FRAME_SIZE (RFC 7540
+	 * § 4.2) */
+	if (frame->length > H2_DEFAULT_MAX_FRAME_SIZE) {
+		session->error = H2_ERROR_FRAME_SIZE_ERROR;
 		return false;
+	}
 
-	if (frame->length != 0 &&
-		frame->payload != NULL &&
-		!CSSWriteClient(session->client, frame->payload, frame->length))
+	if (!fillInput(session, H2_FRAME_HEADER_SIZE + frame->length))
 		return false;
 
+	frame->payload = session->input + session->inputStart
+		+ H2_FRAME_HEADER_SIZE;
+	session->inputStart += H2_FRAME_HEADER_SIZE + frame->length;
+
+	/* Starting at the front again saves moving data around later */
+	if (session->inputStart == session->inputEnd) {
+		session->inputStart = 0;
+		session->inputEnd = 0;
+	}
+
 	return true;
 }
+
+bool
+H2SendFrame(struct H2Session *session, struct H2Frame *frame) {
+	return queueFrame(session, frame, true);
+}
+
+bool
+H2SendFrameInPlace(struct H2Session *session, struct H2Frame *frame) {
+	return queueFrame(session, frame, false);
+}
@@ -42,8 +42,60 @@
 #define H2_FRAME_CONTINUATION 0x9
 #define H2_FRAME_ALTSVC 0xA
 #define H2_FRAME_ORIGIN 0xC
+#define H2_FRAME_PRIORITY_UPDATE 0x10
+
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+
+/* RFC 7540 § 7 */
+#define H2_ERROR_NO_ERROR 0x0
+#define H2_ERROR_PROTOCOL_ERROR 0x1
+#define H2_ERROR_INTERNAL_ERROR 0x2
+#define H2_ERROR_FLOW_CONTROL_ERROR 0x3
+#define H2_ERROR_SETTINGS_TIMEOUT 0x4
+#define H2_ERROR_STREAM_CLOSED 0x5
+#define H2_ERROR_FRAME_SIZE_ERROR 0x6
+#define H2_ERROR_REFUSED_STREAM 0x7
+#define H2_ERROR_CANCEL 0x8
+#define H2_ERROR_COMPRESSION_ERROR 0x9
+#define H2_ERROR_CONNECT_ERROR 0xA
+#define H2_ERROR_ENHANCE_YOUR_CALM 0xB
+#define H2_ERROR_INADEQUATE_SECURITY 0xC
+#define H2_ERROR_HTTP_1_1_REQUIRED 0xD
+
+/* RFC 7540 § 6.5.2: the initial SETTINGS_MAX_FRAME_SIZE */
+#define H2_DEFAULT_MAX_FRAME_SIZE 16384
+#define H2_MAX_MAX_FRAME_SIZE 16777215
+
+#define H2_FRAME_HEADER_SIZE 9
+
+/* The input buffer of a connection holds at least one frame of the largest
+ * size we accept, and reads ahead as much again. */
+#define H2_INPUT_BUFFER_SIZE (2 * (H2_FRAME_HEADER_SIZE \
+							  + H2_DEFAULT_MAX_FRAME_SIZE))
+
+/**
+ * The output queue of a connection. Copied frames (headers, and the payloads
+ * of frames that are built on the stack) are kept in a buffer of
+ * H2_OUTPUT_BUFFER_SIZE octets, DATA payloads are referenced where they are.
+ * The queue is flushed when it holds H2_OUTPUT_FLUSH_SIZE octets.
+ */
+#define H2_OUTPUT_BUFFER_SIZE 16384
+#define H2_OUTPUT_FLUSH_SIZE 65536
+#define H2_MAX_OUTPUT_SLICES 64
+
+/* RFC 8446 § 5.1: the largest plaintext of a TLS record */
+#define H2_RECORD_SIZE 16384
+
+/* RFC 7540 § 6.9: flow-control windows */
+#define H2_DEFAULT_WINDOW_SIZE 65535
+#define H2_MAX_WINDOW_SIZE 2147483647
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* RFC 7540 § 4.1 */
@@ -55,12 +107,47 @@ struct H2Frame {
 	void		 *payload;
 };
 
+/* A part of the output queue of a connection */
+struct H2OutputSlice {
+	const uint8_t *data;
+	size_t size;
+};
+
 struct H2Session;
 
+/**
+ * Writes the output queue to the client. The slices are gathered into full
+ * TLS records: whole records are written straight out of a slice, and only
+ * the octets around the boundaries of the slices are copied together.
+ */
+bool
+H2FlushOutput(struct H2Session *);
+
+/* Whether or not a complete frame can be read without waiting for input. */
+bool
+H2IsFrameBuffered(struct H2Session *);
+
+/**
+ * Parses the next frame out of the input buffer of the connection, which is
+ * filled from the client as needed. The payload is a view into the buffer,
+ * which is only valid until the next call. Returns false on a read failure,
+ * or on a connection error (in H2Session.error).
+ */
 bool
 H2ReadFrame(struct H2Session *, struct H2Frame *);
 
+/**
+ * Queues a frame for sending, copying its payload. Returns false when the
+ * queue had to be flushed, and that failed.
+ */
 bool
 H2SendFrame(struct H2Session *, struct H2Frame *);
 
+/**
+ * Queues a frame for sending without copying its payload, which has to stay
+ * valid until the queue is flushed, such as the data of the file cache.
+ */
+bool
+H2SendFrameInPlace(struct H2Session *, struct H2Frame *);
+
 #endif /* HTTP2_FRAME_H */
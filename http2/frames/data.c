@@ -0,0 +1,106 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "data.h"
+
+#include "http2/flow_control.h"
+#include "http2/frame.h"
+#include "http2/frames/rst_stream.h"
+#include "http2/session.h"
+#include "http2/stream.h"
+
+bool
+H2HandleData(struct H2Session *session, struct H2Frame *frame) {
+	const uint8_t *payload = frame->payload;
+	struct H2Stream *stream;
+
+	if (frame->stream == 0) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+
+	/* The padding can't be longer than the rest of the payload */
+	if ((frame->flags & H2_FLAG_PADDED)
+		&& (frame->length == 0 || payload[0] >= frame->length)) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+
+	/* Frames on closed streams count against the connection window too */
+	if (!H2ConsumeReceiveWindow(session, frame->length))
+		return false;
+
+	stream = H2FindStream(session, frame->stream);
+	if (stream == NULL) {
+		if (frame->stream > session->lastStream) {
+			session->error = H2_ERROR_PROTOCOL_ERROR;
+			return false;
+		}
+
+		/* The stream might have been reset by us while the client was still
+		 * sending, in which case the frame has to be ignored (RFC 7540
+		 * § 5.1). */
+		return true;
+	}
+
+	if (stream->state == H2_STREAM_HALF_CLOSED_REMOTE) {
+		H2TransitionStream(session, stream, H2_STREAM_EVENT_RESET);
+		return H2SendRstStream(session, frame->stream,
+							   H2_ERROR_STREAM_CLOSED);
+	}
+
+	if (frame->length > (size_t) stream->receiveWindow) {
+		H2TransitionStream(session, stream, H2_STREAM_EVENT_RESET);
+		return H2SendRstStream(session, frame->stream,
+							   H2_ERROR_FLOW_CONTROL_ERROR);
+	}
+	stream->receiveWindow -= frame->length;
+
+	/* Request bodies aren't used, so they are discarded */
+	if (frame->flags & H2_FLAG_END_STREAM) {
+		H2TransitionStream(session, stream, H2_STREAM_EVENT_RECEIVE_END);
+		return true;
+	}
+
+	return H2ReplenishStreamWindow(session, stream);
+}
+
+bool
+H2SendData(struct H2Session *session, uint32_t stream, const char *data,
+		   size_t size, bool isEndStream) {
+	struct H2Frame frame = {
+		.length = size,
+		.type = H2_FRAME_DATA,
+		.flags = isEndStream ? H2_FLAG_END_STREAM : 0,
+		.stream = stream,
+		.payload = (void *) data
+	};
+
+	return H2SendFrameInPlace(session, &frame);
+}
@@ -0,0 +1,75 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "goaway.h"
+
+#include "http2/frame.h"
+#include "http2/session.h"
+
+bool
+H2HandleGoAway(struct H2Session *session, struct H2Frame *frame) {
+	if (frame->stream != 0) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+
+	/* The last stream identifier and the error code, followed by optional
+	 * debug data */
+	if (frame->length < 8) {
+		session->error = H2_ERROR_FRAME_SIZE_ERROR;
+		return false;
+	}
+
+	session->isGoingAway = true;
+	return true;
+}
+
+bool
+H2SendGoAway(struct H2Session *session, uint32_t error) {
+	uint8_t payload[8] = {
+		(session->lastStream >> 24) & 0x7F,
+		session->lastStream >> 16,
+		session->lastStream >> 8,
+		session->lastStream & 0xFF,
+		error >> 24,
+		error >> 16,
+		error >> 8,
+		error & 0xFF
+	};
+
+	struct H2Frame frame = {
+		.length = sizeof(payload),
+		.type = H2_FRAME_GOAWAY,
+		.flags = 0,
+		.stream = 0,
+		.payload = payload
+	};
+
+	return H2SendFrame(session, &frame);
+}
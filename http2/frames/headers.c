@@ -0,0 +1,429 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "headers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http/request.h"
+#include "http/syntax.h"
+#include "http2/frame.h"
+#include "http2/frames/rst_stream.h"
+#include "http2/hpack.h"
+#include "http2/scheduler.h"
+#include "http2/session.h"
+#include "http2/stream.h"
+#include "misc/default.h"
+#include "misc/options.h"
+
+struct RequestState {
+	struct HTTPRequest *request;
+	/* Set instead of aborting, since the rest of the block still has to go
+	 * through the decoder to keep the dynamic table in sync. */
+	bool isMalformed;
+	bool isRegularFieldSeen;
+	bool hasAuthority;
+	bool hasScheme;
+	/* The size of the header list, as defined in RFC 7540 § 6.5.2 */
+	size_t headerListSize;
+};
+
+static bool
+appendFragment(struct H2Session *session, const uint8_t *fragment,
+			   size_t size) {
+	uint8_t *block;
+	size_t capacity;
+
+	if (session->headerBlockSize + size > H2_MAX_HEADER_BLOCK_SIZE) {
+		session->error = H2_ERROR_ENHANCE_YOUR_CALM;
+		return false;
+	}
+
+	if (session->headerBlockSize + size > session->headerBlockCapacity) {
+		capacity = session->headerBlockCapacity == 0
+			? H2_DEFAULT_MAX_FRAME_SIZE : session->headerBlockCapacity;
+		while (capacity < session->headerBlockSize + size)
+			capacity *= 2;
+
+		block = realloc(session->headerBlock, capacity);
+		if (block == NULL) {
+			session->error = H2_ERROR_INTERNAL_ERROR;
+			return false;
+		}
+
+		session->headerBlock = block;
+		session->headerBlockCapacity = capacity;
+	}
+
+	memcpy(session->headerBlock + session->headerBlockSize, fragment, size);
+	session->headerBlockSize += size;
+	return true;
+}
+
+/* Copies a pseudo-header value into a field of the request. */
+static bool
+copyPseudoHeader(char *destination, size_t destinationSize,
+				 const char *value, size_t valueLength) {
+	/* Each pseudo-header field can only occur once */
+	if (destination[0] != '\0' || valueLength == 0
+		|| valueLength >= destinationSize)
+		return false;
+
+	memcpy(destination, value, valueLength);
+	destination[valueLength] = '\0';
+	return true;
+}
+
+static bool
+addHeader(struct HTTPRequest *request, const char *name, size_t nameLength,
+		  const char *value, size_t valueLength) {
+	struct HTTPHeader *headers;
+
+	if (nameLength >= HEADER_NAME_SIZE || valueLength >= HEADER_VALUE_SIZE)
+		return false;
+
+	if (request->headerCount == request->headersSize) {
+		if (request->headersSize > UINT8_MAX - HEADER_STEP_SIZE)
+			return false;
+
+		headers = realloc(request->headers, (request->headersSize
+							+ HEADER_STEP_SIZE) * sizeof(struct HTTPHeader));
+		if (headers == NULL)
+			return false;
+
+		request->headers = headers;
+		request->headersSize += HEADER_STEP_SIZE;
+	}
+
+	memcpy(request->headers[request->headerCount].name, name, nameLength);
+	request->headers[request->headerCount].name[nameLength] = '\0';
+	memcpy(request->headers[request->headerCount].value, value, valueLength);
+	request->headers[request->headerCount].value[valueLength] = '\0';
+	request->headerCount += 1;
+	return true;
+}
+
+static bool
+handlePseudoHeader(struct RequestState *state, const char *name,
+				   size_t nameLength, const char *value, size_t valueLength) {
+	struct HTTPRequest *request = state->request;
+
+	/* RFC 7540 § 8.1.2.1: pseudo-header fields precede regular fields */
+	if (state->isRegularFieldSeen)
+		return false;
+
+	if (nameLength == 7 && memcmp(name, ":method", 7) == 0)
+		return copyPseudoHeader(request->method, METHOD_SIZE, value,
+								valueLength);
+
+	if (nameLength == 5 && memcmp(name, ":path", 5) == 0)
+		return copyPseudoHeader(request->path, PATH_SIZE, value,
+								valueLength);
+
+	if (nameLength == 7 && memcmp(name, ":scheme", 7) == 0) {
+		if (state->hasScheme)
+			return false;
+		state->hasScheme = true;
+		return true;
+	}
+
+	/* :authority is the equivalent of the Host header */
+	if (nameLength == 10 && memcmp(name, ":authority", 10) == 0) {
+		if (state->hasAuthority)
+			return false;
+		state->hasAuthority = true;
+		return addHeader(request, "host", 4, value, valueLength);
+	}
+
+	return false;
+}
+
+/* Connection-specific header fields aren't allowed (RFC 7540 § 8.1.2.2) */
+static bool
+isConnectionSpecific(const char *name, size_t nameLength, const char *value,
+					 size_t valueLength) {
+	static const char *names[] = {
+		"connection", "keep-alive", "proxy-connection", "transfer-encoding",
+		"upgrade"
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (strlen(names[i]) == nameLength
+			&& memcmp(names[i], name, nameLength) == 0)
+			return true;
+
+	return nameLength == 2 && memcmp(name, "te", 2) == 0
+		&& !(valueLength == 8 && memcmp(value, "trailers", 8) == 0);
+}
+
+static bool
+handleField(void *userData, const char *name, size_t nameLength,
+			const char *value, size_t valueLength) {
+	struct RequestState *state = userData;
+	size_t i;
+
+	if (state->isMalformed)
+		return true;
+
+	/* A header list larger than advertised is refused like a malformed one */
+	state->headerListSize += nameLength + valueLength + HP_ENTRY_OVERHEAD;
+	if (state->headerListSize > OMHTTP2MaxHeaderListSize) {
+		state->isMalformed = true;
+		return true;
+	}
+
+	/* Uppercase field names are malformed (RFC 7540 § 8.1.2) */
+	for (i = (nameLength != 0 && name[0] == ':') ? 1 : 0; i < nameLength; i++)
+		if ((name[i] >= 'A' && name[i] <= 'Z')
+			|| !HTTPIsTokenCharacter(name[i])) {
+			state->isMalformed = true;
+			return true;
+		}
+
+	/* The same characters are allowed as by the HTTP/1.1 parser */
+	for (i = 0; i < valueLength; i++)
+		if (value[i] != '\t' && value[i] != ' '
+			&& (value[i] < 0x21 || value[i] > 0x7E)) {
+			state->isMalformed = true;
+			return true;
+		}
+
+	if (nameLength == 0) {
+		state->isMalformed = true;
+	} else if (name[0] == ':') {
+		if (!handlePseudoHeader(state, name, nameLength, value, valueLength))
+			state->isMalformed = true;
+	} else {
+		state->isRegularFieldSeen = true;
+		if (isConnectionSpecific(name, nameLength, value, valueLength)
+			|| !addHeader(state->request, name, nameLength, value,
+						  valueLength))
+			state->isMalformed = true;
+	}
+
+	return true;
+}
+
+/**
+ * Decodes the reassembled header block into a request and passes it on. A
+ * decoding error ends the connection, a malformed request only the stream.
+ */
+static bool
+finishHeaderBlock(struct H2Session *session) {
+	struct HTTPRequest request;
+	struct RequestState state = { &request, false, false, false, false, 0 };
+	struct H2Stream *stream;
+	uint32_t id = session->headerStream;
+	bool ret = true;
+
+	request.closeConnection = false;
+	request.headers = NULL;
+	request.headersSize = 0;
+	request.headerCount = 0;
+	request.method[0] = '\0';
+	request.path[0] = '\0';
+	strcpy(request.version, "HTTP/2");
+
+	session->headerStream = 0;
+
+	if (!HPDecode(&session->decoder, session->headerBlock,
+				  session->headerBlockSize, handleField, &state)) {
+		free(request.headers);
+		session->error = H2_ERROR_COMPRESSION_ERROR;
+		return false;
+	}
+
+	/* Trailers aren't used, they only end the stream. A stream the client
+	 * has already ended can't receive them (RFC 7540 § 5.1). */
+	if (session->isHeaderTrailers) {
+		stream = H2FindStream(session, id);
+		if (stream != NULL && session->isHeaderSelfDependent) {
+			H2TransitionStream(session, stream, H2_STREAM_EVENT_RESET);
+			ret = H2SendRstStream(session, id, H2_ERROR_PROTOCOL_ERROR);
+		} else if (stream != NULL
+				   && stream->state == H2_STREAM_HALF_CLOSED_REMOTE) {
+			H2TransitionStream(session, stream, H2_STREAM_EVENT_RESET);
+			ret = H2SendRstStream(session, id, H2_ERROR_STREAM_CLOSED);
+		} else if (stream != NULL) {
+			H2TransitionStream(session, stream, H2_STREAM_EVENT_RECEIVE_END);
+		}
+		free(request.headers);
+		return ret;
+	}
+
+	/* RFC 7540 § 8.1.2.3: all requests need these, except CONNECT which we
+	 * don't support anyway. */
+	if (state.isMalformed || session->isHeaderSelfDependent
+		|| request.method[0] == '\0'
+		|| request.path[0] == '\0' || !state.hasScheme) {
+		ret = H2SendRstStream(session, id, H2_ERROR_PROTOCOL_ERROR);
+	} else if (session->isGoingAway
+			   || (stream = H2OpenStream(session, id,
+										 session->isHeaderEndStream)) == NULL) {
+		ret = H2SendRstStream(session, id, H2_ERROR_REFUSED_STREAM);
+	} else {
+		H2InitPriority(session, stream, &request);
+		ret = session->requestHandler(session, stream, &request);
+	}
+
+	free(request.headers);
+	return ret;
+}
+
+bool
+H2HandleContinuation(struct H2Session *session, struct H2Frame *frame) {
+	/* H2Session.headerStream is checked before a CONTINUATION frame is
+	 * dispatched. */
+	if (!appendFragment(session, frame->payload, frame->length))
+		return false;
+
+	if (frame->flags & H2_FLAG_END_HEADERS)
+		return finishHeaderBlock(session);
+
+	return true;
+}
+
+bool
+H2HandleHeaders(struct H2Session *session, struct H2Frame *frame) {
+	const uint8_t *fragment = frame->payload;
+	size_t size = frame->length;
+	size_t padding = 0;
+	struct H2Stream *stream;
+
+	/* Client-initiated streams are odd, and new ones have to be higher than
+	 * the ones before (RFC 7540 § 5.1.1). The only header block an existing
+	 * stream can receive are trailers, which have to end it. Whether its
+	 * state allows them is checked once the block has been decoded, since
+	 * the decoder has to see every block. */
+	stream = H2FindStream(session, frame->stream);
+	session->isHeaderTrailers = stream != NULL;
+	if (stream != NULL) {
+		if (!(frame->flags & H2_FLAG_END_STREAM)) {
+			session->error = H2_ERROR_PROTOCOL_ERROR;
+			return false;
+		}
+	} else if (frame->stream % 2 == 0
+			   || frame->stream <= session->lastStream) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	} else {
+		session->lastStream = frame->stream;
+	}
+
+	if (frame->flags & H2_FLAG_PADDED) {
+		if (size == 0) {
+			session->error = H2_ERROR_FRAME_SIZE_ERROR;
+			return false;
+		}
+
+		padding = fragment[0];
+		fragment += 1;
+		size -= 1;
+	}
+
+	/* RFC 7540 § 6.2: the exclusive flag, the stream dependency and the
+	 * weight. Priorities of trailers are ignored. */
+	session->hasHeaderPriority = false;
+	session->isHeaderSelfDependent = false;
+	if (frame->flags & H2_FLAG_PRIORITY) {
+		if (size < 5) {
+			session->error = H2_ERROR_FRAME_SIZE_ERROR;
+			return false;
+		}
+
+		session->hasHeaderPriority = stream == NULL;
+		session->isHeaderExclusive = fragment[0] & 0x80;
+		session->headerDependency = ((uint32_t) (fragment[0] & 0x7F) << 24)
+			| ((uint32_t) fragment[1] << 16) | ((uint32_t) fragment[2] << 8)
+			| fragment[3];
+		session->headerWeight = (uint16_t) fragment[4] + 1;
+		fragment += 5;
+		size -= 5;
+
+		/* RFC 7540 § 5.3.1: the stream is reset like for a PRIORITY frame,
+		 * but only after the block has been decoded, which the decoder
+		 * needs to stay in sync with the client. */
+		if (session->headerDependency == frame->stream) {
+			session->hasHeaderPriority = false;
+			session->isHeaderSelfDependent = true;
+		}
+	}
+
+	if (padding > size) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+	size -= padding;
+
+	session->headerBlockSize = 0;
+	session->headerStream = frame->stream;
+	session->isHeaderEndStream = frame->flags & H2_FLAG_END_STREAM;
+
+	if (!appendFragment(session, fragment, size))
+		return false;
+
+	if (frame->flags & H2_FLAG_END_HEADERS)
+		return finishHeaderBlock(session);
+
+	return true;
+}
+
+bool
+H2SendHeaders(struct H2Session *session, uint32_t stream,
+			  const uint8_t *block, size_t size, bool isEndStream) {
+	struct H2Frame frame;
+	size_t length;
+
+	frame.type = H2_FRAME_HEADERS;
+	frame.flags = isEndStream ? H2_FLAG_END_STREAM : 0;
+	frame.stream = stream;
+
+	do {
+		length = size > session->remoteSettings.maxFrameSize
+			? session->remoteSettings.maxFrameSize : size;
+
+		frame.length = length;
+		frame.payload = (void *) block;
+		if (length == size)
+			frame.flags |= H2_FLAG_END_HEADERS;
+
+		if (!H2SendFrame(session, &frame))
+			return false;
+
+		block += length;
+		size -= length;
+		frame.type = H2_FRAME_CONTINUATION;
+		frame.flags = 0;
+	} while (size != 0);
+
+	return true;
+}
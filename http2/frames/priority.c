@@ -0,0 +1,73 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "priority.h"
+
+#include <stdint.h>
+
+#include "http2/frame.h"
+#include "http2/frames/rst_stream.h"
+#include "http2/scheduler.h"
+#include "http2/session.h"
+#include "http2/stream.h"
+
+bool
+H2HandlePriority(struct H2Session *session, struct H2Frame *frame) {
+	const uint8_t *payload = frame->payload;
+	uint32_t dependency;
+	struct H2Stream *stream;
+
+	if (frame->stream == 0) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+
+	if (frame->length != 5)
+		return H2SendRstStream(session, frame->stream,
+							   H2_ERROR_FRAME_SIZE_ERROR);
+
+	dependency = ((uint32_t) (payload[0] & 0x7F) << 24)
+		| ((uint32_t) payload[1] << 16) | ((uint32_t) payload[2] << 8)
+		| payload[3];
+
+	/* RFC 7540 § 5.3.1 */
+	if (dependency == frame->stream)
+		return H2SendRstStream(session, frame->stream,
+							   H2_ERROR_PROTOCOL_ERROR);
+
+	/* Idle and closed streams aren't kept, so their priority is dropped */
+	stream = H2FindStream(session, frame->stream);
+	if (stream != NULL)
+		H2SetStreamDependency(session, stream, dependency,
+							  (uint16_t) payload[4] + 1, payload[0] & 0x80);
+	else if (dependency != 0)
+		session->isRFC7540Priority = true;
+
+	return true;
+}
@@ -0,0 +1,100 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "priority_update.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "http2/frame.h"
+#include "http2/scheduler.h"
+#include "http2/session.h"
+#include "http2/stream.h"
+
+bool
+H2HandlePriorityUpdate(struct H2Session *session, struct H2Frame *frame) {
+	const uint8_t *payload = frame->payload;
+	size_t i;
+	uint32_t id;
+	struct H2Priority priority;
+	struct H2Stream *stream;
+
+	/* RFC 9218 § 7.1 */
+	if (frame->stream != 0) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+
+	if (frame->length < 4) {
+		session->error = H2_ERROR_FRAME_SIZE_ERROR;
+		return false;
+	}
+
+	id = ((uint32_t) (payload[0] & 0x7F) << 24)
+		| ((uint32_t) payload[1] << 16) | ((uint32_t) payload[2] << 8)
+		| payload[3];
+	if (id == 0 || id % 2 == 0) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+
+	session->isRFC9218Priority = true;
+
+	/* A field value that can't be parsed is ignored (RFC 9218 § 7) */
+	priority.urgency = H2_DEFAULT_URGENCY;
+	priority.isIncremental = false;
+	if (!H2ParsePriority((const char *) payload + 4, frame->length - 4,
+						 &priority))
+		return true;
+
+	stream = H2FindStream(session, id);
+	if (stream != NULL) {
+		stream->priority = priority;
+		stream->isPriorityExplicit = true;
+		return true;
+	}
+
+	/* The frame can precede the request of an idle stream. When more of
+	 * those arrive than are kept, one is dropped. */
+	if (id <= session->lastStream)
+		return true;
+
+	for (i = 0; i < session->pendingPriorityCount; i++)
+		if (session->pendingPriorities[i].stream == id)
+			break;
+
+	if (i == H2_MAX_PENDING_PRIORITIES)
+		i = 0;
+	else if (i == session->pendingPriorityCount)
+		session->pendingPriorityCount += 1;
+
+	session->pendingPriorities[i].stream = id;
+	session->pendingPriorities[i].priority = priority;
+	return true;
+}
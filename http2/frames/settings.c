@@ -29,26 +29,140 @@
 
 #include "settings.h"
 
-#include "http2/session.h"
+#include <stdint.h>
+
 #include "http2/frame.h"
+#include "http2/hpack.h"
+#include "http2/session.h"
+#include "http2/settings.h"
+#include "http2/stream.h"
+
+/* The most settings that are sent in a single frame */
+#define MAX_SENT_SETTINGS 8
+
+static bool
+applySetting(struct H2Session *session, uint16_t id, uint32_t value) {
+	struct H2SettingState *settings = &session->remoteSettings;
 
-struct H2Setting;
+	switch (id) {
+		case H2_SETTING_HEADER_TABLE_SIZE:
+			settings->headerTableSize = value;
+			HPSetEncoderTableSize(&session->encoder, value);
+			break;
+		case H2_SETTING_ENABLE_PUSH:
+			if (value > 1) {
+				session->error = H2_ERROR_PROTOCOL_ERROR;
+				return false;
+			}
+			settings->enablePush = value;
+			break;
+		case H2_SETTING_MAX_CONCURRENT_STREAMS:
+			settings->maxConcurrentStreams = value;
+			break;
+		case H2_SETTING_INITIAL_WINDOW_SIZE:
+			/* The change applies to the windows of all open streams too
+			 * (RFC 7540 § 6.9.2). */
+			if (value > H2_MAX_WINDOW_SIZE
+				|| !H2AdjustStreamWindows(session, (int64_t) value
+										  - settings->initialWindowSize)) {
+				session->error = H2_ERROR_FLOW_CONTROL_ERROR;
+				return false;
+			}
+			settings->initialWindowSize = value;
+			break;
+		case H2_SETTING_MAX_FRAME_SIZE:
+			if (value < H2_DEFAULT_MAX_FRAME_SIZE
+				|| value > H2_MAX_MAX_FRAME_SIZE) {
+				session->error = H2_ERROR_PROTOCOL_ERROR;
+				return false;
+			}
+			settings->maxFrameSize = value;
+			break;
+		case H2_SETTING_MAX_HEADER_LIST_SIZE:
+			settings->maxHeaderListSize = value;
+			break;
+		case H2_SETTING_NO_RFC7540_PRIORITIES:
+			/* RFC 9218 § 2.1 */
+			if (value > 1) {
+				session->error = H2_ERROR_PROTOCOL_ERROR;
+				return false;
+			}
+			if (value == 1)
+				session->isRFC9218Priority = true;
+			break;
+		default:
+			/* Unknown settings must be ignored (RFC 7540 § 6.5.2) */
+			break;
+	}
+
+	return true;
+}
 
 bool
 H2SendSettings(struct H2Session *session, struct H2Setting *settings,
 			   size_t count) {
-	session->frameBuffer.length = count * 6;
-	session->frameBuffer.type = H2_FRAME_SETTINGS;
-	session->frameBuffer.flags = 0;
-	session->frameBuffer.stream = 0;
-	session->frameBuffer.payload = settings;
+	uint8_t payload[MAX_SENT_SETTINGS * 6];
+	size_t i;
+
+	struct H2Frame frame = {
+		.length = count * 6,
+		.type = H2_FRAME_SETTINGS,
+		.flags = 0,
+		.stream = 0,
+		.payload = payload
+	};
 
-	return H2SendFrame(session, &session->frameBuffer);
+	if (count > MAX_SENT_SETTINGS)
+		return false;
+
+	for (i = 0; i < count; i++) {
+		payload[i * 6] = settings[i].id >> 8;
+		payload[i * 6 + 1] = settings[i].id & 0xFF;
+		payload[i * 6 + 2] = settings[i].value >> 24;
+		payload[i * 6 + 3] = settings[i].value >> 16;
+		payload[i * 6 + 4] = settings[i].value >> 8;
+		payload[i * 6 + 5] = settings[i].value & 0xFF;
+	}
+
+	return H2SendFrame(session, &frame);
 }
 
 bool
 H2HandleSettings(struct H2Session *session, struct H2Frame *frame) {
-	(void) session;
-	(void) frame;
-	return true;
+	const uint8_t *payload = frame->payload;
+	size_t i;
+
+	struct H2Frame acknowledgement = {
+		.length = 0,
+		.type = H2_FRAME_SETTINGS,
+		.flags = H2_FLAG_ACK,
+		.stream = 0,
+		.payload = NULL
+	};
+
+	if (frame->stream != 0) {
+		session->error = H2_ERROR_PROTOCOL_ERROR;
+		return false;
+	}
+
+	if (frame->flags & H2_FLAG_ACK) {
+		if (frame->length == 0)
+			return true;
+		session->error = H2_ERROR_FRAME_SIZE_ERROR;
+		return false;
+	}
+
+	if (frame->length % 6 != 0) {
+		session->error = H2_ERROR_FRAME_SIZE_ERROR;
+		return false;
+	}
+
+	for (i = 0; i < frame->length; i += 6)
+		if (!applySetting(session, (payload[i] << 8) | payload[i + 1],
+						  ((uint32_t) payload[i + 2] << 24)
+						  | (payload[i + 3] << 16) | (payload[i + 4] << 8)
+						  | payload[i + 5]))
+			return false;
+
+	return H2SendFrame(session, &acknowledgement);
 }
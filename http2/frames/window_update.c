@@ -0,0 +1,110 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "window_update.h"
+
+#include "http2/frame.h"
+#include "http2/frames/rst_stream.h"
+#include "http2/session.h"
+#include "http2/stream.h"
+
+bool
+H2HandleWindowUpdate(struct H2Session *session, struct H2Frame *frame) {
+	const uint8_t *payload = frame->payload;
+	uint32_t error;
+	uint32_t increment;
+	struct H2Stream *stream;
+
+	if (frame->length != 4) {
+		session->error = H2_ERROR_FRAME_SIZE_ERROR;
+		return false;
+	}
+
+	increment = ((uint32_t) (payload[0] & 0x7F) << 24) | (payload[1] << 16)
+		| (payload[2] << 8) | payload[3];
+
+	if (frame->stream == 0) {
+		if (increment == 0) {
+			session->error = H2_ERROR_PROTOCOL_ERROR;
+			return false;
+		}
+
+		if ((int64_t) session->sendWindow + increment > H2_MAX_WINDOW_SIZE) {
+			session->error = H2_ERROR_FLOW_CONTROL_ERROR;
+			return false;
+		}
+
+		session->sendWindow += increment;
+		return true;
+	}
+
+	stream = H2FindStream(session, frame->stream);
+	if (stream == NULL) {
+		if (frame->stream > session->lastStream) {
+			session->error = H2_ERROR_PROTOCOL_ERROR;
+			return false;
+		}
+
+		/* Updates can arrive shortly after a stream was closed */
+		return true;
+	}
+
+	/* These are stream errors when they concern a stream (RFC 7540 § 6.9) */
+	if (increment == 0
+		|| (int64_t) stream->sendWindow + increment > H2_MAX_WINDOW_SIZE) {
+		error = increment == 0 ? H2_ERROR_PROTOCOL_ERROR
+							   : H2_ERROR_FLOW_CONTROL_ERROR;
+		H2TransitionStream(session, stream, H2_STREAM_EVENT_RESET);
+		return H2SendRstStream(session, frame->stream, error);
+	}
+
+	stream->sendWindow += increment;
+	return true;
+}
+
+bool
+H2SendWindowUpdate(struct H2Session *session, uint32_t stream,
+				   uint32_t increment) {
+	uint8_t payload[4] = {
+		increment >> 24,
+		increment >> 16,
+		increment >> 8,
+		increment & 0xFF
+	};
+
+	struct H2Frame frame = {
+		.length = sizeof(payload),
+		.type = H2_FRAME_WINDOW_UPDATE,
+		.flags = 0,
+		.stream = stream,
+		.payload = payload
+	};
+
+	return H2SendFrame(session, &frame);
+}
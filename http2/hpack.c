@@ -0,0 +1,821 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hpack.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Integers larger than this are never valid, since they either index a table
+ * or describe a length within a header block. */
+#define HP_MAX_INTEGER (UINT32_C(1) << 28)
+
+#define HP_HUFFMAN_EOS 256
+
+/* The Huffman tree has 257 leaves, so exactly 256 internal nodes. */
+#define HP_HUFFMAN_STATES 256
+
+#define HP_HUFFMAN_ACCEPT 0x1
+#define HP_HUFFMAN_SYMBOL 0x2
+#define HP_HUFFMAN_FAIL 0x4
+
+#define HP_STATIC_ENTRY(name, value) \
+	{ name, sizeof(name) - 1, value, sizeof(value) - 1 }
+
+struct HPStaticEntry {
+	const char *name;
+	size_t nameLength;
+	const char *value;
+	size_t valueLength;
+};
+
+struct HPHuffmanCode {
+	uint32_t code;
+	uint8_t length;
+};
+
+/**
+ * The decoder consumes a nibble at a time. Since the shortest code is 5 bits,
+ * a single nibble can complete at most one symbol.
+ */
+struct HPHuffmanTransition {
+	uint8_t state;
+	uint8_t flags;
+	uint8_t symbol;
+};
+
+/* RFC 7541 Appendix A */
+static const struct HPStaticEntry HPStaticTable[HP_STATIC_TABLE_SIZE] = {
+	HP_STATIC_ENTRY(":authority", ""),
+	HP_STATIC_ENTRY(":method", "GET"),
+	HP_STATIC_ENTRY(":method", "POST"),
+	HP_STATIC_ENTRY(":path", "/"),
+	HP_STATIC_ENTRY(":path", "/index.html"),
+	HP_STATIC_ENTRY(":scheme", "http"),
+	HP_STATIC_ENTRY(":scheme", "https"),
+	HP_STATIC_ENTRY(":status", "200"),
+	HP_STATIC_ENTRY(":status", "204"),
+	HP_STATIC_ENTRY(":status", "206"),
+	HP_STATIC_ENTRY(":status", "304"),
+	HP_STATIC_ENTRY(":status", "400"),
+	HP_STATIC_ENTRY(":status", "404"),
+	HP_STATIC_ENTRY(":status", "500"),
+	HP_STATIC_ENTRY("accept-charset", ""),
+	HP_STATIC_ENTRY("accept-encoding", "gzip, deflate"),
+	HP_STATIC_ENTRY("accept-language", ""),
+	HP_STATIC_ENTRY("accept-ranges", ""),
+	HP_STATIC_ENTRY("accept", ""),
+	HP_STATIC_ENTRY("access-control-allow-origin", ""),
+	HP_STATIC_ENTRY("age", ""),
+	HP_STATIC_ENTRY("allow", ""),
+	HP_STATIC_ENTRY("authorization", ""),
+	HP_STATIC_ENTRY("cache-control", ""),
+	HP_STATIC_ENTRY("content-disposition", ""),
+	HP_STATIC_ENTRY("content-encoding", ""),
+	HP_STATIC_ENTRY("content-language", ""),
+	HP_STATIC_ENTRY("content-length", ""),
+	HP_STATIC_ENTRY("content-location", ""),
+	HP_STATIC_ENTRY("content-range", ""),
+	HP_STATIC_ENTRY("content-type", ""),
+	HP_STATIC_ENTRY("cookie", ""),
+	HP_STATIC_ENTRY("date", ""),
+	HP_STATIC_ENTRY("etag", ""),
+	HP_STATIC_ENTRY("expect", ""),
+	HP_STATIC_ENTRY("expires", ""),
+	HP_STATIC_ENTRY("from", ""),
+	HP_STATIC_ENTRY("host", ""),
+	HP_STATIC_ENTRY("if-match", ""),
+	HP_STATIC_ENTRY("if-modified-since", ""),
+	HP_STATIC_ENTRY("if-none-match", ""),
+	HP_STATIC_ENTRY("if-range", ""),
+	HP_STATIC_ENTRY("if-unmodified-since", ""),
+	HP_STATIC_ENTRY("last-modified", ""),
+	HP_STATIC_ENTRY("link", ""),
+	HP_STATIC_ENTRY("location", ""),
+	HP_STATIC_ENTRY("max-forwards", ""),
+	HP_STATIC_ENTRY("proxy-authenticate", ""),
+	HP_STATIC_ENTRY("proxy-authorization", ""),
+	HP_STATIC_ENTRY("range", ""),
+	HP_STATIC_ENTRY("referer", ""),
+	HP_STATIC_ENTRY("refresh", ""),
+	HP_STATIC_ENTRY("retry-after", ""),
+	HP_STATIC_ENTRY("server", ""),
+	HP_STATIC_ENTRY("set-cookie", ""),
+	HP_STATIC_ENTRY("strict-transport-security", ""),
+	HP_STATIC_ENTRY("transfer-encoding", ""),
+	HP_STATIC_ENTRY("user-agent", ""),
+	HP_STATIC_ENTRY("vary", ""),
+	HP_STATIC_ENTRY("via", ""),
+	HP_STATIC_ENTRY("www-authenticate", ""),
+};
+
+/* RFC 7541 Appendix B, indexed by symbol; the last entry is EOS */
+static const struct HPHuffmanCode HPHuffmanCodes[257] = {
+	{ 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+	{ 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+	{ 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+	{ 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+	{ 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+	{ 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+	{ 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+	{ 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+	{ 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+	{ 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+	{ 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+	{ 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+	{ 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+	{ 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+	{ 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+	{ 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+	{ 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+	{ 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+	{ 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+	{ 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+	{ 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+	{ 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+	{ 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+	{ 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+	{ 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+	{ 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+	{ 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+	{ 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+	{ 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+	{ 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+	{ 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+	{ 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+	{ 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+	{ 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+	{ 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+	{ 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+	{ 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+	{ 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+	{ 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+	{ 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+	{ 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+	{ 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+	{ 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+	{ 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+	{ 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+	{ 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+	{ 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+	{ 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+	{ 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+	{ 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+	{ 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+	{ 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+	{ 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+	{ 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+	{ 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+	{ 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+	{ 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+	{ 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+	{ 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+	{ 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+	{ 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+	{ 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+	{ 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+	{ 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+	{ 0x3fffffff, 30 },
+};
+
+static struct HPHuffmanTransition
+	HPHuffmanTransitions[HP_HUFFMAN_STATES][16];
+static pthread_once_t HPHuffmanOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Builds the state machine for the Huffman decoder out of the code table. A
+ * state is an internal node of the Huffman tree, and a state is accepting when
+ * the bits consumed since the last symbol can be padding, i.e. at most 7 bits
+ * that are all ones (RFC 7541 § 5.2).
+ */
+static void
+buildHuffmanTransitions(void) {
+	/* Children of the internal nodes; leaves are stored as ~symbol */
+	static int16_t tree[HP_HUFFMAN_STATES][2];
+	bool accepting[HP_HUFFMAN_STATES] = { true };
+	size_t nodeCount = 1;
+	size_t symbol;
+	size_t node;
+	size_t nibble;
+	int bit;
+	int16_t current;
+	int16_t next;
+	struct HPHuffmanTransition *transition;
+
+	memset(tree, 0, sizeof(tree));
+
+	for (symbol = 0; symbol <= HP_HUFFMAN_EOS; symbol++) {
+		current = 0;
+		for (bit = HPHuffmanCodes[symbol].length - 1; bit > 0; bit--) {
+			next = tree[current][(HPHuffmanCodes[symbol].code >> bit) & 1];
+			if (next == 0) {
+				next = (int16_t) nodeCount++;
+				tree[current][(HPHuffmanCodes[symbol].code >> bit) & 1] = next;
+
+				/* The node is on the all-ones path from the root */
+				accepting[next] = accepting[current]
+					&& ((HPHuffmanCodes[symbol].code >> bit) & 1)
+					&& HPHuffmanCodes[symbol].length - bit <= 7;
+			}
+			current = next;
+		}
+		tree[current][HPHuffmanCodes[symbol].code & 1] = (int16_t) ~symbol;
+	}
+
+	for (node = 0; node < HP_HUFFMAN_STATES; node++) {
+		for (nibble = 0; nibble < 16; nibble++) {
+			transition = &HPHuffmanTransitions[node][nibble];
+			current = (int16_t) node;
+
+			for (bit = 3; bit >= 0; bit--) {
+				next = tree[current][(nibble >> bit) & 1];
+				if (next >= 0) {
+					current = next;
+					continue;
+				}
+
+				if (~next == HP_HUFFMAN_EOS) {
+					/* RFC 7541 § 5.2: EOS in a string is a decoding error */
+					transition->flags = HP_HUFFMAN_FAIL;
+					break;
+				}
+
+				transition->flags |= HP_HUFFMAN_SYMBOL;
+				transition->symbol = (uint8_t) ~next;
+				current = 0;
+			}
+
+			if (transition->flags & HP_HUFFMAN_FAIL)
+				continue;
+
+			transition->state = (uint8_t) current;
+			if (accepting[current])
+				transition->flags |= HP_HUFFMAN_ACCEPT;
+		}
+	}
+}
+
+/* Returns the length of the decoded string, or -1 on a decoding error. */
+static long
+huffmanDecode(const uint8_t *input, size_t length, char *output) {
+	const struct HPHuffmanTransition *transition;
+	size_t i;
+	size_t written = 0;
+	uint8_t state = 0;
+	bool accept = true;
+
+	for (i = 0; i < length; i++) {
+		transition = &HPHuffmanTransitions[state][input[i] >> 4];
+		if (transition->flags & HP_HUFFMAN_FAIL)
+			return -1;
+		if (transition->flags & HP_HUFFMAN_SYMBOL) {
+			if (written == HP_STRING_BUFFER_SIZE)
+				return -1;
+			output[written++] = (char) transition->symbol;
+		}
+
+		transition = &HPHuffmanTransitions[transition->state][input[i] & 0xF];
+		if (transition->flags & HP_HUFFMAN_FAIL)
+			return -1;
+		if (transition->flags & HP_HUFFMAN_SYMBOL) {
+			if (written == HP_STRING_BUFFER_SIZE)
+				return -1;
+			output[written++] = (char) transition->symbol;
+		}
+
+		state = transition->state;
+		accept = transition->flags & HP_HUFFMAN_ACCEPT;
+	}
+
+	if (!accept)
+		return -1;
+
+	return (long) written;
+}
+
+static size_t
+huffmanEncodedLength(const char *string, size_t length) {
+	size_t bits = 0;
+	size_t i;
+
+	for (i = 0; i < length; i++)
+		bits += HPHuffmanCodes[(uint8_t) string[i]].length;
+
+	return (bits + 7) / 8;
+}
+
+/* The output has to be at least huffmanEncodedLength() octets long. */
+static void
+huffmanEncode(const char *string, size_t length, uint8_t *output) {
+	const struct HPHuffmanCode *code;
+	uint64_t bits = 0;
+	unsigned int count = 0;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		code = &HPHuffmanCodes[(uint8_t) string[i]];
+		bits = (bits << code->length) | code->code;
+		count += code->length;
+
+		while (count >= 8) {
+			count -= 8;
+			*output++ = (uint8_t) (bits >> count);
+		}
+	}
+
+	/* Pad with the most significant bits of EOS */
+	if (count > 0)
+		*output = (uint8_t) ((bits << (8 - count)) | (0xFF >> count));
+}
+
+static bool
+decodeInteger(const uint8_t **position, const uint8_t *end,
+			  unsigned int prefix, uint32_t *outValue) {
+	uint32_t mask = (UINT32_C(1) << prefix) - 1;
+	uint64_t value = **position & mask;
+	unsigned int shift = 0;
+	uint8_t octet;
+
+	++*position;
+	if (value < mask) {
+		*outValue = (uint32_t) value;
+		return true;
+	}
+
+	do {
+		if (*position == end || shift > 28)
+			return false;
+
+		octet = *(*position)++;
+		value += (uint64_t) (octet & 0x7F) << shift;
+		shift += 7;
+
+		if (value > HP_MAX_INTEGER)
+			return false;
+	} while (octet & 0x80);
+
+	*outValue = (uint32_t) value;
+	return true;
+}
+
+/**
+ * The first octet of the output already contains the bits in front of the
+ * prefix. Returns the number of octets written, or 0 if there isn't enough
+ * space.
+ */
+static size_t
+encodeInteger(uint8_t *output, size_t size, unsigned int prefix,
+			  uint8_t flags, size_t value) {
+	size_t mask = (1u << prefix) - 1;
+	size_t written = 1;
+
+	if (size == 0)
+		return 0;
+
+	if (value < mask) {
+		output[0] = flags | (uint8_t) value;
+		return 1;
+	}
+
+	output[0] = flags | (uint8_t) mask;
+	value -= mask;
+
+	while (value >= 0x80) {
+		if (written == size)
+			return 0;
+		output[written++] = (uint8_t) (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+
+	if (written == size)
+		return 0;
+	output[written++] = (uint8_t) value;
+	return written;
+}
+
+/**
+ * Strings which aren't Huffman-encoded aren't copied; the output will point
+ * into the header block instead.
+ */
+static bool
+decodeString(const uint8_t **position, const uint8_t *end, char *buffer,
+			 const char **outString, size_t *outLength) {
+	bool isHuffman;
+	uint32_t length;
+	long decoded;
+
+	if (*position == end)
+		return false;
+
+	isHuffman = **position & 0x80;
+	if (!decodeInteger(position, end, 7, &length))
+		return false;
+
+	if (length > (size_t) (end - *position))
+		return false;
+
+	if (isHuffman) {
+		decoded = huffmanDecode(*position, length, buffer);
+		if (decoded < 0)
+			return false;
+
+		*outString = buffer;
+		*outLength = (size_t) decoded;
+	} else {
+		*outString = (const char *) *position;
+		*outLength = length;
+	}
+
+	*position += length;
+	return true;
+}
+
+static size_t
+encodeString(uint8_t *output, size_t size, const char *string,
+			 size_t length) {
+	size_t huffmanLength = huffmanEncodedLength(string, length);
+	size_t written;
+
+	if (huffmanLength < length) {
+		written = encodeInteger(output, size, 7, 0x80, huffmanLength);
+		if (written == 0 || size - written < huffmanLength)
+			return 0;
+
+		huffmanEncode(string, length, output + written);
+		return written + huffmanLength;
+	}
+
+	written = encodeInteger(output, size, 7, 0x00, length);
+	if (written == 0 || size - written < length)
+		return 0;
+
+	memcpy(output + written, string, length);
+	return written + length;
+}
+
+/* The index is zero-based and counts from the newest entry. */
+static struct HPEntry *
+getTableEntry(const struct HPTable *table, size_t index) {
+	return table->entries[(table->first + index) % HP_MAX_ENTRIES];
+}
+
+static void
+evictTableEntries(struct HPTable *table, size_t maxSize) {
+	struct HPEntry *entry;
+
+	while (table->size > maxSize) {
+		entry = getTableEntry(table, --table->count);
+		table->size -= entry->nameLength + entry->valueLength
+			+ HP_ENTRY_OVERHEAD;
+		free(entry);
+	}
+}
+
+/**
+ * RFC 7541 § 4.4: an entry larger than the table empties the table and isn't
+ * inserted, which isn't an error. Returns false if memory couldn't be
+ * allocated.
+ */
+static bool
+insertTableEntry(struct HPTable *table, const char *name, size_t nameLength,
+				 const char *value, size_t valueLength) {
+	size_t size = nameLength + valueLength + HP_ENTRY_OVERHEAD;
+	struct HPEntry *entry;
+
+	if (size > table->maxSize) {
+		evictTableEntries(table, 0);
+		return true;
+	}
+
+	/* The name can reference an entry that is about to be evicted, so copy
+	 * it first. */
+	entry = malloc(sizeof(struct HPEntry) + nameLength + valueLength);
+	if (entry == NULL)
+		return false;
+
+	entry->nameLength = (uint16_t) nameLength;
+	entry->valueLength = (uint16_t) valueLength;
+	memcpy(entry->data, name, nameLength);
+	memcpy(entry->data + nameLength, value, valueLength);
+
+	evictTableEntries(table, table->maxSize - size);
+
+	table->first = (table->first + HP_MAX_ENTRIES - 1) % HP_MAX_ENTRIES;
+	table->entries[table->first] = entry;
+	table->count += 1;
+	table->size += size;
+	return true;
+}
+
+/* Looks up an index of the combined index address space (RFC 7541 § 2.3.3) */
+static bool
+lookupIndex(const struct HPTable *table, uint32_t index, const char **name,
+			size_t *nameLength, const char **value, size_t *valueLength) {
+	const struct HPEntry *entry;
+
+	if (index == 0)
+		return false;
+
+	if (index <= HP_STATIC_TABLE_SIZE) {
+		*name = HPStaticTable[index - 1].name;
+		*nameLength = HPStaticTable[index - 1].nameLength;
+		*value = HPStaticTable[index - 1].value;
+		*valueLength = HPStaticTable[index - 1].valueLength;
+		return true;
+	}
+
+	index -= HP_STATIC_TABLE_SIZE + 1;
+	if (index >= table->count)
+		return false;
+
+	entry = getTableEntry(table, index);
+	*name = entry->data;
+	*nameLength = entry->nameLength;
+	*value = entry->data + entry->nameLength;
+	*valueLength = entry->valueLength;
+	return true;
+}
+
+/**
+ * Finds the best index for a header field. Returns 0 if nothing matches, and
+ * sets isFullMatch when the value matches as well.
+ */
+static size_t
+findIndex(const struct HPTable *table, const char *name, size_t nameLength,
+		  const char *value, size_t valueLength, bool *isFullMatch) {
+	const struct HPStaticEntry *staticEntry;
+	const struct HPEntry *entry;
+	size_t nameIndex = 0;
+	size_t i;
+
+	*isFullMatch = false;
+
+	for (i = 0; i < HP_STATIC_TABLE_SIZE; i++) {
+		staticEntry = &HPStaticTable[i];
+		if (staticEntry->nameLength != nameLength
+			|| memcmp(staticEntry->name, name, nameLength) != 0)
+			continue;
+
+		if (staticEntry->valueLength == valueLength
+			&& memcmp(staticEntry->value, value, valueLength) == 0) {
+			*isFullMatch = true;
+			return i + 1;
+		}
+
+		if (nameIndex == 0)
+			nameIndex = i + 1;
+	}
+
+	for (i = 0; i < table->count; i++) {
+		entry = getTableEntry(table, i);
+		if (entry->nameLength != nameLength
+			|| memcmp(entry->data, name, nameLength) != 0)
+			continue;
+
+		if (entry->valueLength == valueLength
+			&& memcmp(entry->data + nameLength, value, valueLength) == 0) {
+			*isFullMatch = true;
+			return HP_STATIC_TABLE_SIZE + 1 + i;
+		}
+
+		if (nameIndex == 0)
+			nameIndex = HP_STATIC_TABLE_SIZE + 1 + i;
+	}
+
+	return nameIndex;
+}
+
+bool
+HPDecode(struct HPDecoder *decoder, const uint8_t *block, size_t length,
+		 HPHeaderCallback callback, void *userData) {
+	const uint8_t *position = block;
+	const uint8_t *end = block + length;
+	const char *name;
+	const char *value;
+	size_t nameLength;
+	size_t valueLength;
+	uint32_t index;
+	uint8_t octet;
+	bool isFieldSeen = false;
+	bool isIndexed;
+
+	while (position != end) {
+		octet = *position;
+
+		/* Indexed Header Field Representation (RFC 7541 § 6.1) */
+		if (octet & 0x80) {
+			if (!decodeInteger(&position, end, 7, &index)
+				|| !lookupIndex(&decoder->table, index, &name, &nameLength,
+								&value, &valueLength))
+				return false;
+
+			if (!callback(userData, name, nameLength, value, valueLength))
+				return false;
+
+			isFieldSeen = true;
+			continue;
+		}
+
+		/* Dynamic Table Size Update (RFC 7541 § 6.3), which is only allowed
+		 * at the beginning of a header block (§ 4.2). */
+		if ((octet & 0xE0) == 0x20) {
+			if (isFieldSeen || !decodeInteger(&position, end, 5, &index)
+				|| index > HP_DEFAULT_TABLE_SIZE)
+				return false;
+
+			decoder->table.maxSize = index;
+			evictTableEntries(&decoder->table, index);
+			continue;
+		}
+
+		/* Literal Header Field Representations (RFC 7541 § 6.2) */
+		isIndexed = octet & 0x40;
+		if (!decodeInteger(&position, end, isIndexed ? 6 : 4, &index))
+			return false;
+
+		if (index == 0) {
+			if (!decodeString(&position, end, decoder->names, &name,
+							  &nameLength))
+				return false;
+		} else if (!lookupIndex(&decoder->table, index, &name, &nameLength,
+								&value, &valueLength))
+			return false;
+
+		if (!decodeString(&position, end, decoder->values, &value,
+						  &valueLength))
+			return false;
+
+		/* The callback comes first, since inserting can evict the entry the
+		 * name points to. */
+		if (!callback(userData, name, nameLength, value, valueLength))
+			return false;
+
+		if (isIndexed && !insertTableEntry(&decoder->table, name, nameLength,
+										   value, valueLength))
+			return false;
+
+		isFieldSeen = true;
+	}
+
+	return true;
+}
+
+static void
+destroyTable(struct HPTable *table) {
+	evictTableEntries(table, 0);
+}
+
+void
+HPDestroyDecoder(struct HPDecoder *decoder) {
+	destroyTable(&decoder->table);
+}
+
+void
+HPDestroyEncoder(struct HPEncoder *encoder) {
+	destroyTable(&encoder->table);
+}
+
+size_t
+HPEncode(struct HPEncoder *encoder, uint8_t *output, size_t size,
+		 const char *name, size_t nameLength, const char *value,
+		 size_t valueLength, enum HPIndexing indexing) {
+	size_t written = 0;
+	size_t length;
+	size_t index;
+	bool isFullMatch;
+
+	if (encoder->sizeUpdatePending) {
+		/* RFC 7541 § 4.2: signal the smallest size first, so the decoder
+		 * evicts the same entries as we did. */
+		if (encoder->smallestSize < encoder->table.maxSize) {
+			written = encodeInteger(output, size, 5, 0x20,
+									encoder->smallestSize);
+			if (written == 0)
+				return 0;
+		}
+
+		length = encodeInteger(output + written, size - written, 5, 0x20,
+							   encoder->table.maxSize);
+		if (length == 0)
+			return 0;
+
+		written += length;
+	}
+
+	index = findIndex(&encoder->table, name, nameLength, value, valueLength,
+					  &isFullMatch);
+
+	if (isFullMatch && indexing != HP_INDEXING_NEVER) {
+		length = encodeInteger(output + written, size - written, 7, 0x80,
+							   index);
+		if (length == 0)
+			return 0;
+
+		encoder->sizeUpdatePending = false;
+		return written + length;
+	}
+
+	/* Inserting an entry that doesn't fit would only empty the table */
+	if (indexing == HP_INDEXING_INCREMENTAL && nameLength + valueLength
+			+ HP_ENTRY_OVERHEAD > encoder->table.maxSize)
+		indexing = HP_INDEXING_NONE;
+
+	if (indexing == HP_INDEXING_INCREMENTAL)
+		length = encodeInteger(output + written, size - written, 6, 0x40,
+							   index);
+	else
+		length = encodeInteger(output + written, size - written, 4,
+							   indexing == HP_INDEXING_NEVER ? 0x10 : 0x00,
+							   index);
+	if (length == 0)
+		return 0;
+	written += length;
+
+	if (index == 0) {
+		length = encodeString(output + written, size - written, name,
+							  nameLength);
+		if (length == 0)
+			return 0;
+		written += length;
+	}
+
+	length = encodeString(output + written, size - written, value,
+						  valueLength);
+	if (length == 0)
+		return 0;
+	written += length;
+
+	if (indexing == HP_INDEXING_INCREMENTAL
+		&& !insertTableEntry(&encoder->table, name, nameLength, value,
+							 valueLength))
+		return 0;
+
+	encoder->sizeUpdatePending = false;
+	return written;
+}
+
+static void
+initTable(struct HPTable *table) {
+	table->first = 0;
+	table->count = 0;
+	table->size = 0;
+	table->maxSize = HP_DEFAULT_TABLE_SIZE;
+}
+
+void
+HPInitDecoder(struct HPDecoder *decoder) {
+	pthread_once(&HPHuffmanOnce, buildHuffmanTransitions);
+	initTable(&decoder->table);
+}
+
+void
+HPInitEncoder(struct HPEncoder *encoder) {
+	initTable(&encoder->table);
+	encoder->sizeUpdatePending = false;
+	encoder->smallestSize = HP_DEFAULT_TABLE_SIZE;
+}
+
+void
+HPSetEncoderTableSize(struct HPEncoder *encoder, size_t size) {
+	/* A larger table of the peer still has to be signaled, since its decoder
+	 * wouldn't evict the entries we evict otherwise. */
+	if (size == encoder->table.maxSize)
+		return;
+
+	if (size > HP_DEFAULT_TABLE_SIZE)
+		size = HP_DEFAULT_TABLE_SIZE;
+
+	if (!encoder->sizeUpdatePending || size < encoder->smallestSize)
+		encoder->smallestSize = size;
+
+	encoder->sizeUpdatePending = true;
+	encoder->table.maxSize = size;
+	evictTableEntries(&encoder->table, size);
+}
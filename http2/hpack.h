@@ -0,0 +1,151 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * HP is an abbreviation for HPACK, the header compression format of HTTP/2
+ * (RFC 7541). Both directions keep a dynamic table which is bounded by
+ * HP_DEFAULT_TABLE_SIZE; we never advertise a larger SETTINGS_HEADER_TABLE_SIZE
+ * and never use more than that of what the peer allows, so the tables can be
+ * fixed-size rings.
+ */
+
+#ifndef HTTP2_HPACK_H
+#define HTTP2_HPACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* RFC 7541 § 6.5.2: the initial SETTINGS_HEADER_TABLE_SIZE */
+#define HP_DEFAULT_TABLE_SIZE 4096
+
+/* RFC 7541 § 4.1: the size of an entry is name + value + 32 */
+#define HP_ENTRY_OVERHEAD 32
+#define HP_MAX_ENTRIES (HP_DEFAULT_TABLE_SIZE / HP_ENTRY_OVERHEAD)
+
+/* The number of entries in the static table (RFC 7541 Appendix A) */
+#define HP_STATIC_TABLE_SIZE 61
+
+/**
+ * The maximum length of a single Huffman-decoded string. Strings that aren't
+ * Huffman-encoded are passed as views into the header block and aren't bound
+ * by this.
+ */
+#define HP_STRING_BUFFER_SIZE 8192
+
+struct HPEntry {
+	uint16_t nameLength;
+	uint16_t valueLength;
+	/* The name, immediately followed by the value */
+	char data[];
+};
+
+struct HPTable {
+	struct HPEntry *entries[HP_MAX_ENTRIES];
+	/* The ring position of the newest entry */
+	size_t first;
+	size_t count;
+	/* The sum of the sizes of the entries, as defined in RFC 7541 § 4.1 */
+	size_t size;
+	size_t maxSize;
+};
+
+enum HPIndexing {
+	/* Literal Header Field with Incremental Indexing (RFC 7541 § 6.2.1) */
+	HP_INDEXING_INCREMENTAL,
+	/* Literal Header Field without Indexing (RFC 7541 § 6.2.2) */
+	HP_INDEXING_NONE,
+	/* Literal Header Field Never Indexed (RFC 7541 § 6.2.3), for values that
+	 * should never end up in a compression context, like credentials. */
+	HP_INDEXING_NEVER
+};
+
+/**
+ * Called for every decoded header field. The strings aren't NUL-terminated and
+ * are only valid during the call. Returning false aborts decoding.
+ */
+typedef bool (*HPHeaderCallback)(void *, const char *, size_t, const char *,
+								 size_t);
+
+struct HPDecoder {
+	struct HPTable table;
+	/* Scratch space for Huffman-decoded names and values */
+	char names[HP_STRING_BUFFER_SIZE];
+	char values[HP_STRING_BUFFER_SIZE];
+};
+
+struct HPEncoder {
+	struct HPTable table;
+	/* Whether or not the next header block has to start with dynamic table
+	 * size updates, and the smallest size that was set in the meantime. */
+	bool sizeUpdatePending;
+	size_t smallestSize;
+};
+
+/**
+ * Decodes a complete header block (i.e. the concatenated fragments of a
+ * HEADERS frame and its CONTINUATION frames). Returns false on a decoding
+ * error, which is a connection error of type COMPRESSION_ERROR, since the
+ * dynamic table can't be trusted anymore.
+ */
+bool
+HPDecode(struct HPDecoder *, const uint8_t *, size_t, HPHeaderCallback,
+		 void *);
+
+void
+HPDestroyDecoder(struct HPDecoder *);
+
+void
+HPDestroyEncoder(struct HPEncoder *);
+
+/**
+ * Appends the representation of a header field to the output buffer. Returns
+ * the number of octets written, or 0 if the buffer is too small or memory
+ * couldn't be allocated. The name must be lowercase.
+ *
+ * Fields that were encoded before a failure may have been inserted into the
+ * dynamic table already, so the whole header block (and with it the
+ * connection) has to be given up in that case.
+ */
+size_t
+HPEncode(struct HPEncoder *, uint8_t *, size_t, const char *, size_t,
+		 const char *, size_t, enum HPIndexing);
+
+void
+HPInitDecoder(struct HPDecoder *);
+
+void
+HPInitEncoder(struct HPEncoder *);
+
+/**
+ * Applies the SETTINGS_HEADER_TABLE_SIZE of the peer. The size is clamped to
+ * HP_DEFAULT_TABLE_SIZE and signaled at the start of the next header block.
+ */
+void
+HPSetEncoderTableSize(struct HPEncoder *, size_t);
+
+#endif /* HTTP2_HPACK_H */
@@ -0,0 +1,508 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scheduler.h"
+
+#include <string.h>
+
+#include "http/request.h"
+#include "http2/session.h"
+#include "http2/stream.h"
+
+/* The scale of the virtual time, so a weight of 256 still advances it */
+#define VIRTUAL_TIME_SHIFT 8
+
+/* The kinds of bare items of a structured field (RFC 8941 § 3.3) that the
+ * priority parameters can have. Other items are skipped. */
+enum ItemType {
+	ITEM_BOOLEAN,
+	ITEM_INTEGER,
+	ITEM_OTHER
+};
+
+struct FieldParser {
+	const char *data;
+	size_t size;
+	size_t position;
+};
+
+struct Item {
+	enum ItemType type;
+	long integer;
+};
+
+static bool
+isKeyCharacter(char character) {
+	return (character >= 'a' && character <= 'z')
+		|| (character >= '0' && character <= '9') || character == '_'
+		|| character == '-' || character == '.' || character == '*';
+}
+
+static bool
+isTokenCharacter(char character) {
+	return character > 0x20 && character < 0x7F && character != '"'
+		&& character != '(' && character != ')' && character != ','
+		&& character != ';' && character != '=' && character != '<'
+		&& character != '>' && character != '@' && character != '['
+		&& character != ']' && character != '\\' && character != '{'
+		&& character != '}';
+}
+
+static char
+peek(const struct FieldParser *parser) {
+	return parser->position < parser->size
+		? parser->data[parser->position] : '\0';
+}
+
+static void
+skipWhitespace(struct FieldParser *parser) {
+	while (peek(parser) == ' ' || peek(parser) == '\t')
+		parser->position += 1;
+}
+
+static bool
+parseKey(struct FieldParser *parser, const char **key, size_t *length) {
+	size_t start = parser->position;
+	char character = peek(parser);
+
+	if (!(character >= 'a' && character <= 'z') && character != '*')
+		return false;
+
+	while (parser->position < parser->size && isKeyCharacter(peek(parser)))
+		parser->position += 1;
+
+	*key = parser->data + start;
+	*length = parser->position - start;
+	return true;
+}
+
+static bool
+parseBareItem(struct FieldParser *parser, struct Item *item) {
+	char character = peek(parser);
+	bool isNegative = false;
+	size_t digits = 0;
+
+	item->type = ITEM_OTHER;
+
+	if (character == '?') {
+		parser->position += 1;
+		character = peek(parser);
+		if (character != '0' && character != '1')
+			return false;
+
+		parser->position += 1;
+		item->type = ITEM_BOOLEAN;
+		item->integer = character == '1';
+		return true;
+	}
+
+	if (character == '-' || (character >= '0' && character <= '9')) {
+		if (character == '-') {
+			isNegative = true;
+			parser->position += 1;
+		}
+
+		item->integer = 0;
+		while ((character = peek(parser)) >= '0' && character <= '9') {
+			if (++digits > 15)
+				return false;
+			item->integer = item->integer * 10 + (character - '0');
+			parser->position += 1;
+		}
+
+		if (digits == 0)
+			return false;
+
+		/* Decimals are valid, but never a valid urgency */
+		if (character == '.') {
+			parser->position += 1;
+			while ((character = peek(parser)) >= '0' && character <= '9')
+				parser->position += 1;
+			return true;
+		}
+
+		item->type = ITEM_INTEGER;
+		if (isNegative)
+			item->integer = -item->integer;
+		return true;
+	}
+
+	if (character == '"') {
+		for (parser->position += 1; parser->position < parser->size;
+			 parser->position++) {
+			character = peek(parser);
+			if (character == '\\')
+				parser->position += 1;
+			else if (character == '"')
+				break;
+		}
+
+		if (parser->position >= parser->size)
+			return false;
+
+		parser->position += 1;
+		return true;
+	}
+
+	if (character == ':') {
+		parser->position += 1;
+		while (parser->position < parser->size && peek(parser) != ':')
+			parser->position += 1;
+
+		if (parser->position >= parser->size)
+			return false;
+
+		parser->position += 1;
+		return true;
+	}
+
+	if ((character >= 'a' && character <= 'z')
+		|| (character >= 'A' && character <= 'Z') || character == '*') {
+		while (parser->position < parser->size
+			   && (isTokenCharacter(peek(parser)) || peek(parser) == ':'
+				   || peek(parser) == '/'))
+			parser->position += 1;
+		return true;
+	}
+
+	return false;
+}
+
+static bool
+skipParameters(struct FieldParser *parser) {
+	const char *key;
+	size_t length;
+	struct Item item;
+
+	while (peek(parser) == ';') {
+		parser->position += 1;
+		while (peek(parser) == ' ')
+			parser->position += 1;
+
+		if (!parseKey(parser, &key, &length))
+			return false;
+
+		if (peek(parser) == '=') {
+			parser->position += 1;
+			if (!parseBareItem(parser, &item))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* Parses the value of a dictionary member, with its parameters. */
+static bool
+parseMemberValue(struct FieldParser *parser, struct Item *item) {
+	if (peek(parser) != '(')
+		return parseBareItem(parser, item) && skipParameters(parser);
+
+	/* Inner lists aren't used by priorities, so they're only skipped */
+	parser->position += 1;
+	while (true) {
+		while (peek(parser) == ' ')
+			parser->position += 1;
+
+		if (peek(parser) == ')')
+			break;
+
+		if (!parseBareItem(parser, item) || !skipParameters(parser))
+			return false;
+
+		if (peek(parser) != ' ' && peek(parser) != ')')
+			return false;
+	}
+
+	parser->position += 1;
+	item->type = ITEM_OTHER;
+	return skipParameters(parser);
+}
+
+bool
+H2ParsePriority(const char *data, size_t size, struct H2Priority *priority) {
+	struct FieldParser parser = { data, size, 0 };
+	struct H2Priority result = { H2_DEFAULT_URGENCY, false };
+	const char *key;
+	size_t length;
+	struct Item item;
+
+	skipWhitespace(&parser);
+	while (parser.position < parser.size) {
+		if (!parseKey(&parser, &key, &length))
+			return false;
+
+		if (peek(&parser) == '=') {
+			parser.position += 1;
+			if (!parseMemberValue(&parser, &item))
+				return false;
+		} else {
+			/* A member without a value is a boolean that is true */
+			item.type = ITEM_BOOLEAN;
+			item.integer = 1;
+			if (!skipParameters(&parser))
+				return false;
+		}
+
+		/* RFC 9218 § 4: values that are out of range or of the wrong type
+		 * are ignored. A later member of the same name overrides. */
+		if (length == 1 && key[0] == 'u' && item.type == ITEM_INTEGER
+			&& item.integer >= 0 && item.integer <= H2_LOWEST_URGENCY)
+			result.urgency = (uint8_t) item.integer;
+		else if (length == 1 && key[0] == 'i' && item.type == ITEM_BOOLEAN)
+			result.isIncremental = item.integer;
+
+		skipWhitespace(&parser);
+		if (parser.position == parser.size)
+			break;
+
+		if (peek(&parser) != ',')
+			return false;
+
+		parser.position += 1;
+		skipWhitespace(&parser);
+		if (parser.position == parser.size)
+			return false;
+	}
+
+	*priority = result;
+	return true;
+}
+
+/**
+ * Whether or not a stream can't send because one of the streams it depends
+ * on can (RFC 7540 § 5.3.1). The walk is bounded, in case of a cycle.
+ */
+static bool
+isBlockedByAncestor(struct H2Session *session, const struct H2Stream *stream) {
+	const struct H2Stream *ancestor = stream;
+	size_t depth;
+
+	for (depth = 0; depth < session->streamCount; depth++) {
+		if (ancestor->dependency == 0)
+			return false;
+
+		ancestor = H2FindStream(session, ancestor->dependency);
+		if (ancestor == NULL)
+			return false;
+
+		if (H2IsStreamSendable(session, ancestor))
+			return true;
+	}
+
+	return false;
+}
+
+/* Whether or not a stream depends on another, directly or indirectly. */
+static bool
+isDescendant(struct H2Session *session, const struct H2Stream *stream,
+			 uint32_t ancestor) {
+	size_t depth;
+
+	for (depth = 0; depth < session->streamCount && stream != NULL;
+		 depth++) {
+		if (stream->dependency == ancestor)
+			return true;
+
+		stream = H2FindStream(session, stream->dependency);
+	}
+
+	return false;
+}
+
+/**
+ * Whether or not a stream goes before another by RFC 9218 priority. Within an
+ * urgency, non-incremental streams go first.
+ */
+static bool
+precedes(const struct H2Stream *stream, const struct H2Stream *other) {
+	if (stream->priority.urgency != other->priority.urgency)
+		return stream->priority.urgency < other->priority.urgency;
+
+	if (stream->priority.isIncremental != other->priority.isIncremental)
+		return !stream->priority.isIncremental;
+
+	return stream->id < other->id;
+}
+
+void
+H2ChargeStream(struct H2Session *session, struct H2Stream *stream,
+			   size_t size) {
+	stream->virtualTime += ((uint64_t) size << VIRTUAL_TIME_SHIFT)
+		/ stream->weight;
+	session->nextStream = (size_t) (stream - session->streams) + 1;
+}
+
+void
+H2InitPriority(struct H2Session *session, struct H2Stream *stream,
+			   const struct HTTPRequest *request) {
+	size_t i;
+
+	if (session->hasHeaderPriority)
+		H2SetStreamDependency(session, stream, session->headerDependency,
+							  session->headerWeight,
+							  session->isHeaderExclusive);
+
+	for (i = 0; i < request->headerCount; i++)
+		if (strcmp(request->headers[i].name, "priority") == 0
+			&& H2ParsePriority(request->headers[i].value,
+							   strlen(request->headers[i].value),
+							   &stream->priority)) {
+			stream->isPriorityExplicit = true;
+			session->isRFC9218Priority = true;
+		}
+
+	/* RFC 9218 § 7: a PRIORITY_UPDATE frame overrides the header */
+	for (i = 0; i < session->pendingPriorityCount; i++)
+		if (session->pendingPriorities[i].stream == stream->id) {
+			stream->priority = session->pendingPriorities[i].priority;
+			stream->isPriorityExplicit = true;
+			session->pendingPriorityCount -= 1;
+			session->pendingPriorities[i] =
+				session->pendingPriorities[session->pendingPriorityCount];
+			break;
+		}
+}
+
+void
+H2RemoveDependencies(struct H2Session *session,
+					 const struct H2Stream *stream) {
+	size_t i;
+
+	/* RFC 7540 § 5.3.4: the streams that depended on a closed stream now
+	 * depend on its parent. */
+	for (i = 0; i < session->streamCount; i++)
+		if (session->streams[i].dependency == stream->id)
+			session->streams[i].dependency = stream->dependency;
+}
+
+struct H2Stream *
+H2ScheduleStream(struct H2Session *session) {
+	struct H2Stream *best = NULL;
+	struct H2Stream *stream;
+	size_t i;
+
+	if (session->isRFC7540Priority && !session->isRFC9218Priority) {
+		/* Siblings share the connection by weight, by sending the one that
+		 * has used the least of its share first. */
+		for (i = 0; i < session->streamCount; i++) {
+			stream = &session->streams[i];
+			if (!H2IsStreamSendable(session, stream)
+				|| isBlockedByAncestor(session, stream))
+				continue;
+
+			if (best == NULL || stream->virtualTime < best->virtualTime
+				|| (stream->virtualTime == best->virtualTime
+					&& stream->id < best->id))
+				best = stream;
+		}
+
+		if (best != NULL)
+			session->virtualTime = best->virtualTime;
+		return best;
+	}
+
+	/* RFC 9218 § 10: the most urgent streams go first. Non-incremental ones
+	 * are sent one after another in the order they were requested. */
+	for (i = 0; i < session->streamCount; i++) {
+		stream = &session->streams[i];
+		if (!H2IsStreamSendable(session, stream))
+			continue;
+
+		if (best == NULL || precedes(stream, best))
+			best = stream;
+	}
+
+	if (best == NULL || !best->priority.isIncremental)
+		return best;
+
+	/* Incremental streams of the same urgency take turns */
+	for (i = 0; i < session->streamCount; i++) {
+		stream = &session->streams[(session->nextStream + i)
+								   % session->streamCount];
+		if (stream->priority.isIncremental
+			&& stream->priority.urgency == best->priority.urgency
+			&& H2IsStreamSendable(session, stream))
+			return stream;
+	}
+
+	return best;
+}
+
+void
+H2SetDefaultPriority(struct H2Stream *stream, const char *mediaType) {
+	if (stream->isPriorityExplicit)
+		return;
+
+	/* Documents, stylesheets and scripts block rendering, while images are
+	 * rendered progressively, so they can share the connection. */
+	if (strcmp(mediaType, "text/html") == 0
+		|| strcmp(mediaType, "text/css") == 0) {
+		stream->priority.urgency = 0;
+	} else if (strcmp(mediaType, "application/javascript") == 0) {
+		stream->priority.urgency = 1;
+	} else if (strncmp(mediaType, "font/", 5) == 0) {
+		stream->priority.urgency = 2;
+	} else if (strncmp(mediaType, "image/", 6) == 0) {
+		stream->priority.urgency = 4;
+		stream->priority.isIncremental = true;
+	}
+}
+
+void
+H2SetStreamDependency(struct H2Session *session, struct H2Stream *stream,
+					  uint32_t dependency, uint16_t weight, bool isExclusive) {
+	struct H2Stream *parent;
+	size_t i;
+
+	/* RFC 7540 § 5.3.1: the frame handlers reset a stream that depends on
+	 * itself, which would otherwise be blocked by itself forever. */
+	if (dependency == stream->id)
+		return;
+
+	/* RFC 7540 § 5.3.3: a stream that is made to depend on one of its own
+	 * dependents takes the place of the dependent first. */
+	parent = H2FindStream(session, dependency);
+	if (parent != NULL && isDescendant(session, parent, stream->id))
+		parent->dependency = stream->dependency;
+
+	if (isExclusive)
+		for (i = 0; i < session->streamCount; i++)
+			if (session->streams[i].dependency == dependency
+				&& &session->streams[i] != stream)
+				session->streams[i].dependency = stream->id;
+
+	stream->dependency = dependency;
+	stream->weight = weight;
+
+	/* The default priority of RFC 7540 isn't a signal of its own, so the
+	 * media type still decides for clients that only send that. */
+	if (dependency != 0 || weight != H2_DEFAULT_WEIGHT || isExclusive)
+		session->isRFC7540Priority = true;
+}
@@ -0,0 +1,123 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The write scheduler of HTTP/2, which decides which stream sends the next
+ * DATA frame. Streams are prioritized with the extensible priorities of RFC
+ * 9218: the most urgent responses go first, non-incremental ones one after
+ * another and incremental ones taking turns. Without a priority signal, the
+ * urgency follows from the media type, so render-blocking stylesheets and
+ * scripts go out before images.
+ *
+ * Clients that only use the priority tree of RFC 7540 § 5.3 are scheduled by
+ * that instead: a stream waits for its ancestors, and siblings share the
+ * connection by weight. Idle streams aren't part of the table, so streams
+ * that depend on one are treated as depending on the root.
+ */
+
+#ifndef HTTP2_SCHEDULER_H
+#define HTTP2_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* RFC 9218 § 4 */
+#define H2_DEFAULT_URGENCY 3
+#define H2_LOWEST_URGENCY 7
+
+/* RFC 7540 § 5.3.5 */
+#define H2_DEFAULT_WEIGHT 16
+
+/* The PRIORITY_UPDATE frames for idle streams that are kept */
+#define H2_MAX_PENDING_PRIORITIES 4
+
+struct HTTPRequest;
+struct H2Session;
+struct H2Stream;
+
+struct H2Priority {
+	uint8_t urgency;
+	bool isIncremental;
+};
+
+/* A PRIORITY_UPDATE frame that arrived before its stream was opened */
+struct H2PendingPriority {
+	uint32_t stream;
+	struct H2Priority priority;
+};
+
+/* Accounts the octets that were sent for a stream by the scheduler. */
+void
+H2ChargeStream(struct H2Session *, struct H2Stream *, size_t);
+
+/**
+ * Sets the priority of a stream that was just opened, from the priority
+ * header of the request, the RFC 7540 priority of the HEADERS frame, and
+ * PRIORITY_UPDATE frames that came before.
+ */
+void
+H2InitPriority(struct H2Session *, struct H2Stream *,
+			   const struct HTTPRequest *);
+
+/**
+ * Parses a Priority Field Value (RFC 9218 § 4), which is a structured field
+ * dictionary. Parameters that are absent take their default, and unknown or
+ * invalid members are ignored. Returns false, leaving the priority as it is,
+ * when the field isn't a dictionary at all.
+ */
+bool
+H2ParsePriority(const char *, size_t, struct H2Priority *);
+
+/**
+ * Lets the streams that depend on a stream that is about to be closed depend
+ * on its parent instead.
+ */
+void
+H2RemoveDependencies(struct H2Session *, const struct H2Stream *);
+
+/* Returns the stream that should send the next DATA frame, or NULL. */
+struct H2Stream *
+H2ScheduleStream(struct H2Session *);
+
+/**
+ * Derives the priority of a stream from the media type of its response,
+ * unless the client signaled one.
+ */
+void
+H2SetDefaultPriority(struct H2Stream *, const char *);
+
+/**
+ * Sets the RFC 7540 priority of a stream. An exclusive dependency makes the
+ * stream the sole dependency of its parent, adopting the other ones. A
+ * dependency of a stream on itself is ignored.
+ */
+void
+H2SetStreamDependency(struct H2Session *, struct H2Stream *, uint32_t,
+					  uint16_t, bool);
+
+#endif /* HTTP2_SCHEDULER_H */
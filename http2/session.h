@@ -32,12 +32,101 @@
 
 struct H2Session;
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "core/security.h"
+#include "http/request.h"
 #include "http2/frame.h"
+#include "http2/hpack.h"
+#include "http2/scheduler.h"
+#include "http2/settings.h"
+#include "http2/stream.h"
+
+/**
+ * Called for every request of which the header block was decoded, after its
+ * stream was opened. The request is only valid during the call. Returning
+ * false ends the connection with the error code in H2Session.error.
+ */
+typedef bool (*H2RequestHandler)(struct H2Session *, struct H2Stream *,
+								 struct HTTPRequest *);
 
 struct H2Session {
 	CSSClient client;
 	struct H2Frame frameBuffer;
+
+	/* The octets in [inputStart, inputEnd) are received but not parsed */
+	uint8_t input[H2_INPUT_BUFFER_SIZE];
+	size_t inputStart;
+	size_t inputEnd;
+
+	/* The output queue, see H2FlushOutput(). Slices either reference
+	 * DATA payloads or the copies in output. The record buffer gathers the
+	 * octets around slice boundaries into full TLS records. */
+	struct H2OutputSlice outputSlices[H2_MAX_OUTPUT_SLICES];
+	size_t outputSliceCount;
+	size_t outputQueued;
+	uint8_t output[H2_OUTPUT_BUFFER_SIZE];
+	size_t outputSize;
+	uint8_t record[H2_RECORD_SIZE];
+
+	/* The error code for GOAWAY when a frame handler fails */
+	uint32_t error;
+	/* The highest stream identifier the client has opened */
+	uint32_t lastStream;
+	/* Set when the client sent GOAWAY: new streams are refused, and the
+	 * connection is closed once the open ones are done. */
+	bool isGoingAway;
+
+	struct HPDecoder decoder;
+	struct HPEncoder encoder;
+
+	/* The header block being reassembled out of a HEADERS frame and its
+	 * CONTINUATION frames. headerStream is 0 when there is none. Trailers
+	 * are the header block of an open stream, rather than of a new one. */
+	uint8_t *headerBlock;
+	size_t headerBlockSize;
+	size_t headerBlockCapacity;
+	uint32_t headerStream;
+	bool isHeaderEndStream;
+	bool isHeaderTrailers;
+	/* The RFC 7540 priority of the HEADERS frame, if it had one */
+	bool hasHeaderPriority;
+	bool isHeaderExclusive;
+	uint32_t headerDependency;
+	uint16_t headerWeight;
+	/* Set when the HEADERS frame made its stream depend on itself */
+	bool isHeaderSelfDependent;
+
+	/* See http2/stream.h. nextStream is where incremental streams of the
+	 * same urgency continue taking turns. */
+	struct H2Stream *streams;
+	size_t streamCount;
+	size_t streamCapacity;
+	size_t nextStream;
+
+	/* See http2/scheduler.h. The virtual time is the lowest one of the
+	 * streams, which new streams start at. The kind of priority signals
+	 * decides how streams are scheduled. */
+	uint64_t virtualTime;
+	bool isRFC7540Priority;
+	bool isRFC9218Priority;
+	struct H2PendingPriority pendingPriorities[H2_MAX_PENDING_PRIORITIES];
+	size_t pendingPriorityCount;
+
+	/* The flow-control window of the connection for sending */
+	int32_t sendWindow;
+
+	/* Receive-side flow control, see http2/flow_control.h. The window size
+	 * applies to the connection and to every stream. */
+	int64_t receiveWindow;
+	uint32_t receiveWindowSize;
+	bool isBandwidthSampling;
+	size_t bandwidthSample;
+	struct H2SettingState remoteSettings;
+
+	H2RequestHandler requestHandler;
 };
 
 #endif /* HTTP2_SESSION_H */
@@ -30,6 +30,8 @@
 #ifndef HTTP2_SETTINGS_H
 #define HTTP2_SETTINGS_H
 
+#include <stdint.h>
+
 #define H2_SETTING_HEADER_TABLE_SIZE 0x1
 #define H2_SETTING_ENABLE_PUSH 0x2
 #define H2_SETTING_MAX_CONCURRENT_STREAMS 0x3
@@ -37,6 +39,7 @@
 #define H2_SETTING_MAX_FRAME_SIZE 0x5
 #define H2_SETTING_MAX_HEADER_LIST_SIZE 0x6
 #define H2_SETTING_ENABLE_CONNECT_PROTOCOL 0x8
+#define H2_SETTING_NO_RFC7540_PRIORITIES 0x9
 
 struct H2Setting {
 	uint16_t id;
@@ -47,7 +50,7 @@ struct H2SettingState {
 	uint32_t	 headerTableSize;
 	int			 enablePush;
 	uint32_t	 maxConcurrentStreams;
-	uint32_t	 intialWindowSize;
+	uint32_t	 initialWindowSize;
 	unsigned int maxFrameSize : 24;
 	uint32_t	 maxHeaderListSize;
 };
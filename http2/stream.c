@@ -0,0 +1,186 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stream.h"
+
+#include <stdlib.h>
+
+#include "http2/frame.h"
+#include "http2/frames/data.h"
+#include "http2/scheduler.h"
+#include "http2/session.h"
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+static void
+closeStream(struct H2Session *session, struct H2Stream *stream) {
+	H2RemoveDependencies(session, stream);
+	session->streamCount -= 1;
+	*stream = session->streams[session->streamCount];
+}
+
+bool
+H2AdjustStreamWindows(struct H2Session *session, int64_t delta) {
+	size_t i;
+
+	for (i = 0; i < session->streamCount; i++) {
+		if (session->streams[i].sendWindow + delta > H2_MAX_WINDOW_SIZE)
+			return false;
+		session->streams[i].sendWindow += delta;
+	}
+
+	return true;
+}
+
+void
+H2DestroyStreams(struct H2Session *session) {
+	free(session->streams);
+	session->streams = NULL;
+	session->streamCount = 0;
+}
+
+struct H2Stream *
+H2FindStream(struct H2Session *session, uint32_t id) {
+	size_t i;
+
+	for (i = 0; i < session->streamCount; i++)
+		if (session->streams[i].id == id)
+			return &session->streams[i];
+
+	return NULL;
+}
+
+bool
+H2HasStreamData(struct H2Session *session) {
+	/* A sendable stream can still be blocked by its ancestors, in which case
+	 * H2SendStreamData() wouldn't send anything. */
+	return H2ScheduleStream(session) != NULL;
+}
+
+bool
+H2InitStreams(struct H2Session *session, size_t capacity) {
+	session->streams = calloc(capacity, sizeof(struct H2Stream));
+	session->streamCapacity = capacity;
+	session->streamCount = 0;
+	session->nextStream = 0;
+	return session->streams != NULL;
+}
+
+bool
+H2IsStreamSendable(const struct H2Session *session,
+				   const struct H2Stream *stream) {
+	return stream->remaining != 0 && stream->sendWindow > 0
+		&& session->sendWindow > 0;
+}
+
+struct H2Stream *
+H2OpenStream(struct H2Session *session, uint32_t id, bool isEndStream) {
+	struct H2Stream *stream;
+
+	if (session->streamCount == session->streamCapacity) {
+		SMAddCounter(SMC_HTTP2_STREAMS_REFUSED, 1);
+		return NULL;
+	}
+
+	SMAddCounter(SMC_HTTP2_STREAMS, 1);
+
+	stream = &session->streams[session->streamCount++];
+	stream->id = id;
+	stream->state = isEndStream ? H2_STREAM_HALF_CLOSED_REMOTE
+								: H2_STREAM_OPEN;
+	stream->sendWindow = session->remoteSettings.initialWindowSize;
+	stream->receiveWindow = session->receiveWindowSize;
+	stream->data = NULL;
+	stream->remaining = 0;
+	stream->priority.urgency = H2_DEFAULT_URGENCY;
+	stream->priority.isIncremental = false;
+	stream->isPriorityExplicit = false;
+	stream->dependency = 0;
+	stream->weight = H2_DEFAULT_WEIGHT;
+	stream->virtualTime = session->virtualTime;
+	return stream;
+}
+
+bool
+H2SendStreamData(struct H2Session *session) {
+	bool isEndStream;
+	size_t size;
+	struct H2Stream *stream;
+
+	stream = H2ScheduleStream(session);
+	if (stream == NULL)
+		return true;
+
+	size = stream->remaining;
+	if (size > session->remoteSettings.maxFrameSize)
+		size = session->remoteSettings.maxFrameSize;
+	if (size > OMHTTP2MaxDataFrameSize)
+		size = OMHTTP2MaxDataFrameSize;
+	if (size > (size_t) stream->sendWindow)
+		size = stream->sendWindow;
+	if (size > (size_t) session->sendWindow)
+		size = session->sendWindow;
+
+	isEndStream = size == stream->remaining;
+	if (!H2SendData(session, stream->id, stream->data, size, isEndStream))
+		return false;
+
+	stream->data += size;
+	stream->remaining -= size;
+	stream->sendWindow -= size;
+	session->sendWindow -= size;
+	H2ChargeStream(session, stream, size);
+
+	if (isEndStream)
+		H2TransitionStream(session, stream, H2_STREAM_EVENT_SEND_END);
+
+	return true;
+}
+
+void
+H2TransitionStream(struct H2Session *session, struct H2Stream *stream,
+				   enum H2StreamEvent event) {
+	switch (event) {
+		case H2_STREAM_EVENT_RECEIVE_END:
+			if (stream->state == H2_STREAM_OPEN)
+				stream->state = H2_STREAM_HALF_CLOSED_REMOTE;
+			else
+				closeStream(session, stream);
+			break;
+		case H2_STREAM_EVENT_SEND_END:
+			if (stream->state == H2_STREAM_OPEN)
+				stream->state = H2_STREAM_HALF_CLOSED_LOCAL;
+			else
+				closeStream(session, stream);
+			break;
+		case H2_STREAM_EVENT_RESET:
+			closeStream(session, stream);
+			break;
+	}
+}
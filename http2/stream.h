@@ -0,0 +1,133 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The stream table of an HTTP/2 connection. Only streams that are open or
+ * half-closed occupy a slot: idle streams are implied by H2Session.lastStream
+ * and closed streams are forgotten, so the table is bounded by the
+ * SETTINGS_MAX_CONCURRENT_STREAMS we advertise. The slots are kept packed at
+ * the front of the table.
+ */
+
+#ifndef HTTP2_STREAM_H
+#define HTTP2_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "http2/scheduler.h"
+
+struct H2Session;
+
+/**
+ * RFC 7540 § 5.1, without the reserved states, since we never push.
+ */
+enum H2StreamState {
+	H2_STREAM_OPEN,
+	H2_STREAM_HALF_CLOSED_LOCAL,
+	H2_STREAM_HALF_CLOSED_REMOTE
+};
+
+enum H2StreamEvent {
+	/* A frame with the END_STREAM flag was received */
+	H2_STREAM_EVENT_RECEIVE_END,
+	/* A frame with the END_STREAM flag was sent */
+	H2_STREAM_EVENT_SEND_END,
+	/* A RST_STREAM frame was sent or received */
+	H2_STREAM_EVENT_RESET
+};
+
+struct H2Stream {
+	uint32_t id;
+	enum H2StreamState state;
+	/* The flow-control window for sending, which can become negative when
+	 * SETTINGS_INITIAL_WINDOW_SIZE is reduced (RFC 7540 § 6.9.2). */
+	int32_t sendWindow;
+	/* The octets the client can still send, see http2/flow_control.h */
+	int32_t receiveWindow;
+	/* The part of the response body that hasn't been sent yet */
+	const char *data;
+	size_t remaining;
+
+	/* See http2/scheduler.h. The virtual time is the share of the
+	 * connection a stream has used, relative to its weight. */
+	struct H2Priority priority;
+	bool isPriorityExplicit;
+	uint32_t dependency;
+	uint16_t weight;
+	uint64_t virtualTime;
+};
+
+/**
+ * Changes the initial window size of the open streams by the given delta.
+ * Returns false when a window would exceed H2_MAX_WINDOW_SIZE, which is a
+ * connection error of type FLOW_CONTROL_ERROR.
+ */
+bool
+H2AdjustStreamWindows(struct H2Session *, int64_t);
+
+void
+H2DestroyStreams(struct H2Session *);
+
+/* Returns NULL if the stream is idle or closed. */
+struct H2Stream *
+H2FindStream(struct H2Session *, uint32_t);
+
+/* Whether or not a stream has a DATA frame that can be sent right now. */
+bool
+H2HasStreamData(struct H2Session *);
+
+bool
+H2IsStreamSendable(const struct H2Session *, const struct H2Stream *);
+
+bool
+H2InitStreams(struct H2Session *, size_t);
+
+/**
+ * Opens an idle stream, which starts half-closed (remote) if the HEADERS frame
+ * ended it. Returns NULL when the table is full.
+ */
+struct H2Stream *
+H2OpenStream(struct H2Session *, uint32_t, bool);
+
+/**
+ * Sends the next DATA frame of the stream chosen by the scheduler. A frame is
+ * limited by the flow-control windows of its stream and of the connection, and
+ * by the SETTINGS_MAX_FRAME_SIZE of the client.
+ */
+bool
+H2SendStreamData(struct H2Session *);
+
+/**
+ * Applies an event to the state of a stream. When this closes the stream, its
+ * slot is reused, so the stream can't be accessed afterwards.
+ */
+void
+H2TransitionStream(struct H2Session *, struct H2Stream *, enum H2StreamEvent);
+
+#endif /* HTTP2_STREAM_H */
@@ -44,6 +44,7 @@
 #include "core/server.h"
 #include "misc/default.h"
 #include "misc/options.h"
+#include "misc/rate_limiter.h"
 #include "misc/statistics.h"
 #include "redir/server.h"
 
@@ -58,6 +59,7 @@ static void StopWithError(const char *, const char *);
 int main(void) {
 	pthread_attr_t attribs;
 	size_t lastCount;
+	size_t secondsSinceCheck;
 	int ret;
 	struct sigaction act;
 	struct timespec time;
@@ -83,6 +85,12 @@ int main(void) {
 		StopWithError("SignalSetup", "Failed to set signal handler.");
 	}
 
+	/* SIGHUP reloads the certificates. */
+	if (sigaction(SIGHUP,	&act, NULL) == -1) {
+		perror("[Main] sigaction() failed");
+		StopWithError("SignalSetup", "Failed to set signal handler.");
+	}
+
 	/* Ignore the SIGPIPE signal. */
 	signal(SIGPIPE, SIG_IGN);
 
@@ -92,6 +100,8 @@ int main(void) {
 
 	cleanUpFunctions[cufIndex++] = OMDestroy;
 
+	RLSetup();
+
 	/* Start security */
 	if (CSSetupSecurityManager() <= 0)
 		StopWithError("CoreSecurity", "Failed to setup the SecurityManager.");
@@ -125,6 +135,7 @@ int main(void) {
 		warn("[Main] W: Failed to destroy thread attributes.");
 
 	lastCount = 0;
+	secondsSinceCheck = 0;
 
 	SMBegin();
 	fputs("[Main] Initialization was "ANSI_COLOR_GREEN"succesful"
@@ -143,6 +154,25 @@ int main(void) {
 				   ANSI_COLOR_RESETLN, currentCount);
 			lastCount = currentCount;
 		}
+
+		secondsSinceCheck += 1;
+		if (OMSCertificateCheckInterval != 0 &&
+			secondsSinceCheck >= OMSCertificateCheckInterval) {
+			secondsSinceCheck = 0;
+			if (CSSHaveCertificatesChanged())
+				GSReloadRequested = 1;
+			else if (CSSHasOCSPResponseChanged())
+				CSSReloadOCSPResponse();
+		}
+
+		/* The certificates are reloaded in this thread, so building the new
+		 * context doesn't delay any connections. */
+		if (GSReloadRequested) {
+			GSReloadRequested = 0;
+			if (CSSReloadSecurityManager())
+				puts(ANSI_COLOR_GREEN"[Main] Reloaded the certificates."
+					 ANSI_COLOR_RESET);
+		}
 	}
 
 	/* Newline for ^C */
@@ -185,6 +215,8 @@ int main(void) {
 static void CatchSignal(int signo) {
 	if (signo == SIGINT)
 		GSNotify(GSA_INTERRUPT);
+	else if (signo == SIGHUP)
+		GSNotify(GSA_RELOAD);
 }
 
 static void StopWithError(const char *section, const char *message) {
@@ -30,13 +30,13 @@
 #include "io.h"
 
 #include <netinet/in.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -127,18 +127,38 @@ IOCreateSocket(uint16_t port, bool nonBlocking) {
 	return sockfd;
 }
 
+bool
+IOSetNonBlocking(int fd, bool nonBlocking) {
+	int flags;
+
+	flags = fcntl(fd, F_GETFL, 0);
+	if (flags == -1)
+		return false;
+
+	if (nonBlocking)
+		flags |= O_NONBLOCK;
+	else
+		flags &= ~O_NONBLOCK;
+
+	return fcntl(fd, F_SETFL, flags) != -1;
+}
+
+/* poll() is used instead of select(), which can't handle fds >= FD_SETSIZE */
 bool
 IOTimeoutAvailableData(int fd, size_t microTimeout) {
-	fd_set set;
-	struct timeval timeout;
+	struct pollfd pollInfo;
+	int ret;
 
-	FD_ZERO(&set);
-	FD_SET(fd, &set);
+	pollInfo.fd = fd;
+	pollInfo.events = POLLIN;
+	pollInfo.revents = 0;
 
-	timeout.tv_sec = 0;
-	timeout.tv_usec = microTimeout;
+	do {
+		/* Round up, so a short timeout doesn't become a non-blocking check */
+		ret = poll(&pollInfo, 1, (microTimeout + 999) / 1000);
+	} while (ret == -1 && errno == EINTR);
 
-	return select(fd+1, &set, NULL, NULL, &timeout) > 0;
+	return ret > 0;
 }
 
 int
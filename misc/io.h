@@ -44,6 +44,14 @@ extern const char *IOErrors[];
 int
 IOCreateSocket(uint16_t, bool);
 
+/**
+ * Parameters:
+ * int			the file descriptor
+ * int			boolean: non-blocking or not
+ */
+bool
+IOSetNonBlocking(int, bool);
+
 /**
  * Parameters:
  * int			the file descriptor
@@ -33,15 +33,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "misc/default.h"
 
 /* Secure/recommended value by default: none */
 enum OSILevel OMGSSystemInformationInServerHeader = OSIL_NONE;
 
-const char	*OMSCertificateFile;
-const char	*OMSCertificateChainFile;
-const char	*OMSCertificatePrivateKeyFile;
+struct OMSCertificate *OMSCertificates;
+size_t		 OMSCertificateCount;
 const char	*OMSCipherList = "ECDHE-ECDSA-AES128-GCM-SHA256:"
 	"ECDHE-RSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:"
 	"ECDHE-RSA-AES256-GCM-SHA384:ECDHE-ECDSA-CHACHA20-POLY1305:"
@@ -51,21 +51,224 @@ const char	*OMSCipherList = "ECDHE-ECDSA-AES128-GCM-SHA256:"
 const char	*OMSCipherSuites = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:"
 "TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_CCM_SHA256:TLS_AES_128_CCM_8_SHA256";
 
+size_t		 OMSCertificateCheckInterval = 60;
+const char	*OMSOCSPResponseFileName = NULL;
+
+bool		 OMSKernelTLS = true;
+bool		 OMSCertificateCompression = true;
+
+size_t		 OMSSessionCacheSize = 20480;
+long		 OMSSessionLifetime = 7200;
+const char	*OMSTicketKeyFile = NULL;
+time_t		 OMSTicketKeyLifetime = 3600;
+
+unsigned int OMSMaxEarlyData = 16384;
+time_t		 OMSEarlyDataReplayWindow = 10;
+
+size_t		 OMSHandshakeTimeout = 10000;
+size_t		 OMSMaxPendingHandshakes = 4096;
+size_t		 OMSCryptoThreadCount = 4;
+
+size_t		 OMSRecordIdleTimeout = 1000;
+size_t		 OMSRecordSmallCount = 40;
+/* An MSS of 1460, minus TCP options and the TLS 1.3 record overhead */
+size_t		 OMSRecordSmallSize = 1369;
+
 const char	*OMCacheLocation = "/var/www/cache";
+bool		 OMCacheEarlyHints = true;
+size_t		 OMCacheSendFileThreshold = 65536;
+
+size_t		 OMKeepAliveAdaptiveThreshold = 50;
+time_t		 OMKeepAliveMaxLifetime = 300;
+size_t		 OMKeepAliveMaxRequests = 100;
+size_t		 OMKeepAliveMinimumTimeout = 500;
+size_t		 OMKeepAliveTimeout = 5000;
+
+size_t		 OMWorkerThreadCount = 500;
+size_t		 OMWorkerStackSize = 262144;
+
+size_t		 OMRateLimitBurst = 64;
+size_t		 OMRateLimitRate = 32;
+
+bool		 OMLoadSheddingEnabled = true;
+size_t		 OMLoadSheddingHandshakeLatency = 500000;
+size_t		 OMLoadSheddingOccupancy = 90;
+size_t		 OMLoadSheddingQueueWait = 50000;
+size_t		 OMLoadSheddingRecoveryPercentage = 80;
+size_t		 OMLoadSheddingRetryAfter = 5;
 
-char *internalCert;
-char *internalChain;
-char *internalPrivKey;
+size_t		 OMHTTP2MaxConcurrentStreams = 100;
+size_t		 OMHTTP2MaxDataFrameSize = 65536;
+size_t		 OMHTTP2MaxHeaderListSize = 16384;
+size_t		 OMHTTP2InitialReceiveWindow = 262144;
+size_t		 OMHTTP2MaxReceiveWindow = 262144;
 
 const char *internalPrefixPath = "/etc/letsencrypt/live/";
 const char *internalSuffixCert = "/cert.pem";
 const char *internalSuffixChain = "/chain.pem";
 const char *internalSuffixPrivKey = "/privkey.pem";
 
+/* Returns the path of the file in the certificate directory, or NULL. */
+static char *
+internalJoinPath(const char *directory, const char *suffix) {
+	size_t a, b, c;
+	char *path;
+
+	a = strlen(internalPrefixPath);
+	b = strlen(directory);
+	c = strlen(suffix);
+
+	path = malloc(a + b + c + 1);
+	if (!path)
+		return NULL;
+
+	memcpy(path, internalPrefixPath, a);
+	memcpy(path + a, directory, b);
+	memcpy(path + a + b, suffix, c + 1);
+	return path;
+}
+
+static void
+internalDestroyKeyPair(struct OMSKeyPair *keyPair) {
+	free(keyPair->certificateFile);
+	free(keyPair->chainFile);
+	free(keyPair->privateKeyFile);
+	free(keyPair->ocspResponseFile);
+}
+
+static void
+internalDestroyCertificate(struct OMSCertificate *certificate) {
+	size_t i;
+
+	for (i = 0; i < certificate->keyPairCount; i++)
+		internalDestroyKeyPair(&certificate->keyPairs[i]);
+	free(certificate->name);
+}
+
+static int
+internalCompareCertificates(const void *a, const void *b) {
+	return strcmp(((const struct OMSCertificate *) a)->name,
+				  ((const struct OMSCertificate *) b)->name);
+}
+
+/**
+ * Returns the name of the certificate that the directory belongs to, which is
+ * the name of the directory without the '-ecdsa' or '-rsa' suffix.
+ */
+static char *
+internalGetCertificateName(const char *directory) {
+	const char *suffixes[] = { "-ecdsa", "-rsa" };
+	size_t length;
+	size_t i;
+
+	length = strlen(directory);
+	for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+		size_t suffixLength;
+
+		suffixLength = strlen(suffixes[i]);
+		if (length > suffixLength &&
+			strcmp(directory + length - suffixLength, suffixes[i]) == 0)
+			return strndup(directory, length - suffixLength);
+	}
+
+	return strdup(directory);
+}
+
+/* Returns the certificate with the name, which is added if it is new. */
+static struct OMSCertificate *
+internalFindCertificate(char *name) {
+	struct OMSCertificate *certificates;
+	size_t i;
+
+	for (i = 0; i < OMSCertificateCount; i++) {
+		if (strcmp(OMSCertificates[i].name, name) == 0) {
+			free(name);
+			return &OMSCertificates[i];
+		}
+	}
+
+	certificates = realloc(OMSCertificates, (OMSCertificateCount + 1) *
+						   sizeof(struct OMSCertificate));
+	if (!certificates) {
+		free(name);
+		return NULL;
+	}
+
+	OMSCertificates = certificates;
+	memset(&certificates[OMSCertificateCount], 0,
+		   sizeof(struct OMSCertificate));
+	certificates[OMSCertificateCount].name = name;
+	return &certificates[OMSCertificateCount++];
+}
+
+/**
+ * Adds the certificate directory. Returns 1 on success, 0 if the directory
+ * doesn't contain a certificate, e.g. the README file, and -1 on failure.
+ */
+static int
+internalAddCertificate(const char *directory) {
+	struct OMSKeyPair keyPair = { 0 };
+	struct OMSCertificate *certificate;
+	char *name;
+
+	keyPair.certificateFile = internalJoinPath(directory, internalSuffixCert);
+	if (!keyPair.certificateFile)
+		return -1;
+
+	if (access(keyPair.certificateFile, R_OK) != 0) {
+		free(keyPair.certificateFile);
+		return 0;
+	}
+
+	keyPair.chainFile = internalJoinPath(directory, internalSuffixChain);
+	keyPair.privateKeyFile = internalJoinPath(directory,
+											  internalSuffixPrivKey);
+	if (OMSOCSPResponseFileName != NULL) {
+		char *suffix;
+
+		suffix = malloc(strlen(OMSOCSPResponseFileName) + 2);
+		if (suffix) {
+			suffix[0] = '/';
+			strcpy(suffix + 1, OMSOCSPResponseFileName);
+			keyPair.ocspResponseFile = internalJoinPath(directory, suffix);
+			free(suffix);
+		}
+
+		if (!keyPair.ocspResponseFile) {
+			internalDestroyKeyPair(&keyPair);
+			return -1;
+		}
+	}
+
+	name = internalGetCertificateName(directory);
+	if (!name || !keyPair.chainFile || !keyPair.privateKeyFile) {
+		free(name);
+		internalDestroyKeyPair(&keyPair);
+		return -1;
+	}
+
+	certificate = internalFindCertificate(name);
+	if (!certificate) {
+		internalDestroyKeyPair(&keyPair);
+		return -1;
+	}
+
+	if (certificate->keyPairCount == OMS_MAX_KEY_PAIRS) {
+		fprintf(stderr, ANSI_COLOR_YELLOW"[Options] Ignoring the certificate "
+				"directory %s, since %s already has %i certificates."
+				ANSI_COLOR_RESETLN, directory, certificate->name,
+				OMS_MAX_KEY_PAIRS);
+		internalDestroyKeyPair(&keyPair);
+		return 0;
+	}
+
+	certificate->keyPairs[certificate->keyPairCount++] = keyPair;
+	return 1;
+}
+
 int
 internalSetupCertificatesLetsencrypt() {
 	DIR *d;
-	size_t genericSize, a, b;
 	struct dirent *dir;
 
 	d = opendir(internalPrefixPath);
@@ -76,74 +279,54 @@ internalSetupCertificatesLetsencrypt() {
 	}
 
 	while ((dir = readdir(d)) != NULL) {
-		if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+		if (dir->d_name[0] == '.')
 			continue;
 
-		a = strlen(internalPrefixPath);
-		b = strlen(dir->d_name);
-		genericSize = a + b + 1;
-
-		internalCert = malloc(genericSize + strlen(internalSuffixCert));
-		if (!internalCert) {
+		if (internalAddCertificate(dir->d_name) == -1) {
 			closedir(d);
 			return -1;
 		}
-
-		internalChain = malloc(genericSize + strlen(internalSuffixChain));
-		if (!internalChain) {
-			closedir(d);
-			free(internalCert);
-			return -2;
-		}
-
-		internalPrivKey = malloc(genericSize + strlen(internalSuffixPrivKey));
-		if (!internalPrivKey) {
-			closedir(d);
-			free(internalChain);
-			free(internalCert);
-			return -2;
-		}
-
-		strcpy(internalCert, internalPrefixPath);
-		strcpy(internalChain, internalPrefixPath);
-		strcpy(internalPrivKey, internalPrefixPath);
-		strcpy(internalCert + a, dir->d_name);
-		strcpy(internalChain + a, dir->d_name);
-		strcpy(internalPrivKey + a, dir->d_name);
-		strcpy(internalCert + a + b, internalSuffixCert);
-		strcpy(internalChain + a + b, internalSuffixChain);
-		strcpy(internalPrivKey + a + b, internalSuffixPrivKey);
-
-		OMSCertificateFile = internalCert;
-		OMSCertificateChainFile = internalChain;
-		OMSCertificatePrivateKeyFile = internalPrivKey;
-
-		closedir(d);
-
-		return 1;
 	}
 
 	closedir(d);
-	return 0;
+
+	/* The order of readdir() is unspecified, but the first certificate is
+	 * the default one. */
+	qsort(OMSCertificates, OMSCertificateCount,
+		  sizeof(struct OMSCertificate), internalCompareCertificates);
+
+	return OMSCertificateCount == 0 ? 0 : 1;
 }
 
 bool
 OMSetup(void) {
-	internalCert = NULL;
-	internalChain = NULL;
-	internalPrivKey = NULL;
-
 	if (internalSetupCertificatesLetsencrypt() <= 0) {
 		puts("Failed to setup certificate files using Letsencrypt.");
+		OMDestroy();
 		return false;
 	}
 
+	/* The replay window of early data only covers this process, while the
+	 * tickets of a shared key file are accepted by every process using it. */
+	if (OMSMaxEarlyData != 0 && OMSTicketKeyFile != NULL
+		&& OMSTicketKeyLifetime != 0) {
+		fputs(ANSI_COLOR_YELLOW"[Options] Disabling early data, since the "
+			  "ticket keys are shared through OMSTicketKeyFile."
+			  ANSI_COLOR_RESETLN, stderr);
+		OMSMaxEarlyData = 0;
+	}
+
 	return true;
 }
 
 void
 OMDestroy(void) {
-	free(internalCert);
-	free(internalChain);
-	free(internalPrivKey);
+	size_t i;
+
+	for (i = 0; i < OMSCertificateCount; i++)
+		internalDestroyCertificate(&OMSCertificates[i]);
+
+	free(OMSCertificates);
+	OMSCertificates = NULL;
+	OMSCertificateCount = 0;
 }
@@ -34,6 +34,8 @@
 #define MISC_OPTIONS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 
 /**
  * The system information level. You can choose to include information about
@@ -75,14 +77,253 @@ enum OSILevel {
 	OSIL_MACHINE = 8
 };
 
-extern const char	*OMSCertificateFile;
-extern const char	*OMSCertificateChainFile;
-extern const char	*OMSCertificatePrivateKeyFile;
+/**
+ * The files of a certificate directory in /etc/letsencrypt/live/.
+ */
+struct OMSKeyPair {
+	char		*certificateFile;
+	char		*chainFile;
+	char		*privateKeyFile;
+	/* NULL if OMSOCSPResponseFileName is NULL */
+	char		*ocspResponseFile;
+};
+
+/* One ECDSA and one RSA certificate */
+#define OMS_MAX_KEY_PAIRS 2
+
+/**
+ * Every certificate directory is loaded, and the hostnames in the
+ * certificates select the certificate using SNI. The first certificate
+ * (sorted by name) is used for clients that request an unknown hostname or
+ * none at all.
+ *
+ * Directories named 'example.com-ecdsa' and 'example.com-rsa' form a single
+ * certificate named 'example.com' with two key pairs, and OpenSSL selects
+ * the one that the client supports. ECDSA signatures are much cheaper, so
+ * the RSA certificate is only for legacy clients.
+ */
+struct OMSCertificate {
+	/* The name of the directory, usually the primary hostname. */
+	char		*name;
+	struct OMSKeyPair keyPairs[OMS_MAX_KEY_PAIRS];
+	size_t		 keyPairCount;
+};
+
+extern struct OMSCertificate *OMSCertificates;
+extern size_t		 OMSCertificateCount;
+
+/**
+ * The ciphers of TLS 1.2 (OMSCipherList) and TLS 1.3 (OMSCipherSuites), in
+ * order of preference of the server. AES-GCM comes first, as it is the
+ * fastest on CPUs with AES acceleration. On other CPUs, the ChaCha20 ciphers
+ * are moved to the front. Clients that prefer ChaCha20 get it either way.
+ */
 extern const char	*OMSCipherList;
 extern const char	*OMSCipherSuites;
 
+/**
+ * The certificate files are checked for modifications every
+ * OMSCertificateCheckInterval seconds (0 disables this), and reloaded when
+ * they have changed, e.g. after a renewal. A reload can also be requested by
+ * sending SIGHUP. Existing connections aren't affected by a reload.
+ */
+extern size_t		 OMSCertificateCheckInterval;
+
+/**
+ * The name of the file in every certificate directory containing the
+ * DER-encoded OCSP response for the certificate, which is stapled to the
+ * handshake. The file should be refreshed by an external fetcher, e.g.
+ * 'openssl ocsp -respout'. It is checked for modifications along with the
+ * certificates and reloaded in the background. A response that has expired,
+ * or is older than the certificate, isn't stapled. NULL disables stapling.
+ */
+extern const char	*OMSOCSPResponseFileName;
+
+/**
+ * Lets OpenSSL offload the record encryption to the kernel (kTLS) when the
+ * kernel supports it, so large responses can be sent with sendfile(2).
+ */
+extern bool			 OMSKernelTLS;
+
+/**
+ * Compresses the certificate chains with Brotli for clients that support it
+ * (RFC 8879), so the first flight of the handshake is smaller. The chains are
+ * compressed once when the certificates are loaded. This needs OpenSSL 3.2 or
+ * newer.
+ */
+extern bool			 OMSCertificateCompression;
+
+/**
+ * TLS session resumption. The session cache holds at most
+ * OMSSessionCacheSize sessions (0 disables it), which expire after
+ * OMSSessionLifetime seconds.
+ *
+ * The session ticket keys are rotated every OMSTicketKeyLifetime seconds
+ * (0 disables tickets), and tickets encrypted with the previous key are still
+ * accepted. The keys are derived from the 32-octet secret in OMSTicketKeyFile,
+ * so all servers sharing that file accept each other's tickets. Without the
+ * file, a random secret is used.
+ */
+extern size_t		 OMSSessionCacheSize;
+extern long			 OMSSessionLifetime;
+extern const char	*OMSTicketKeyFile;
+extern time_t		 OMSTicketKeyLifetime;
+
+/**
+ * TLS 1.3 early (0-RTT) data. Resumed clients can send up to OMSMaxEarlyData
+ * octets (0 disables early data) in their first flight. Only GET and HEAD
+ * requests for cached files are answered before the handshake completes.
+ *
+ * A ClientHello with early data is rejected if it was already seen in the last
+ * OMSEarlyDataReplayWindow seconds. Older ClientHellos are rejected by OpenSSL
+ * because of their ticket age.
+ *
+ * The replay window is kept per process, so early data is disabled when the
+ * ticket keys are shared with other processes through OMSTicketKeyFile: early
+ * data captured on one of them could be replayed to another.
+ */
+extern unsigned int	 OMSMaxEarlyData;
+extern time_t		 OMSEarlyDataReplayWindow;
+
+/**
+ * TLS handshakes are performed by a single event loop before a worker thread
+ * is assigned to the connection. At most OMSMaxPendingHandshakes handshakes
+ * can be in progress; more connections are shed. A handshake that doesn't
+ * complete within OMSHandshakeTimeout milliseconds is aborted, or three times
+ * that while it waits for the crypto threads.
+ */
+extern size_t		 OMSHandshakeTimeout;
+extern size_t		 OMSMaxPendingHandshakes;
+
+/**
+ * The signatures of full handshakes are computed by OMSCryptoThreadCount
+ * crypto threads, so the handshake event loop isn't blocked by them (see
+ * core/crypto_pool.h). 0 computes them on the event loop instead.
+ */
+extern size_t		 OMSCryptoThreadCount;
+
+/**
+ * Dynamic TLS record sizing. The first OMSRecordSmallCount records of a
+ * response are at most OMSRecordSmallSize octets, so that each fits in a
+ * single TCP segment and the browser can start parsing early. After that,
+ * full 16 KB records are used for throughput, until the connection has been
+ * idle for OMSRecordIdleTimeout milliseconds. 0 small records disables this.
+ *
+ * tools/record_size_benchmark.py can be used to tune these values.
+ */
+extern size_t		 OMSRecordIdleTimeout;
+extern size_t		 OMSRecordSmallCount;
+extern size_t		 OMSRecordSmallSize;
+
 extern const char	*OMCacheLocation;
 
+/**
+ * When enabled, HTML files are scanned for stylesheets, preload links and
+ * module scripts in their <head>, and a '103 Early Hints' response is sent
+ * for these resources before the final response.
+ */
+extern bool			 OMCacheEarlyHints;
+
+/**
+ * Cached files (and their compressed versions) of at least this size in
+ * octets are backed by a file descriptor, so they can be sent with
+ * sendfile(2) when kernel TLS is used. 0 disables this.
+ */
+extern size_t		 OMCacheSendFileThreshold;
+
+/**
+ * Keep-alive connection budgeting. An HTTP/1.1 connection is closed after it
+ * has served OMKeepAliveMaxRequests requests or has been open for
+ * OMKeepAliveMaxLifetime seconds, whichever comes first.
+ *
+ * The idle timeout (in milliseconds) between two requests is
+ * OMKeepAliveTimeout, but once the occupancy of the worker threads rises above
+ * OMKeepAliveAdaptiveThreshold percent, it is linearly reduced towards
+ * OMKeepAliveMinimumTimeout. This way, idle connections make room for new
+ * clients when the server gets busy. A minimum that isn't below
+ * OMKeepAliveTimeout disables the reduction.
+ */
+extern size_t		 OMKeepAliveAdaptiveThreshold;
+extern time_t		 OMKeepAliveMaxLifetime;
+extern size_t		 OMKeepAliveMaxRequests;
+extern size_t		 OMKeepAliveMinimumTimeout;
+extern size_t		 OMKeepAliveTimeout;
+
+/**
+ * Every connection is served by its own worker thread, of which at most
+ * OMWorkerThreadCount exist at once. Their stacks are OMWorkerStackSize octets
+ * (0 uses the default of the system, usually 8 MiB), which is plenty for the
+ * handlers and OpenSSL, and lets many idle connections share an address space.
+ */
+extern size_t		 OMWorkerThreadCount;
+extern size_t		 OMWorkerStackSize;
+
+/**
+ * Per-client rate limiting of new connections, using a token bucket per IPv4
+ * address or IPv6 /64 prefix. A client can open OMRateLimitBurst connections
+ * at once, and its budget is refilled with OMRateLimitRate connections per
+ * second. Setting OMRateLimitBurst to 0 disables rate limiting.
+ */
+extern size_t		 OMRateLimitBurst;
+extern size_t		 OMRateLimitRate;
+
+/**
+ * Load shedding. When the server is overloaded, new requests are answered
+ * with a '503 Service Unavailable' response, which is much cheaper than
+ * serving them, so the latency of the admitted requests stays bounded.
+ *
+ * The server is considered overloaded if the occupancy (in percent) of the
+ * worker threads reaches OMLoadSheddingOccupancy, or the average time that a
+ * connection waits for its thread (in microseconds) reaches
+ * OMLoadSheddingQueueWait, or the average duration of a TLS handshake (in
+ * microseconds) reaches OMLoadSheddingHandshakeLatency. Shedding stops when
+ * all of these are below OMLoadSheddingRecoveryPercentage percent of their
+ * thresholds.
+ *
+ * Clients are asked to retry after OMLoadSheddingRetryAfter seconds.
+ */
+extern bool			 OMLoadSheddingEnabled;
+extern size_t		 OMLoadSheddingHandshakeLatency;
+extern size_t		 OMLoadSheddingOccupancy;
+extern size_t		 OMLoadSheddingQueueWait;
+extern size_t		 OMLoadSheddingRecoveryPercentage;
+extern size_t		 OMLoadSheddingRetryAfter;
+
+/**
+ * The SETTINGS_MAX_CONCURRENT_STREAMS that is advertised to HTTP/2 clients.
+ * It bounds the stream table of a connection; streams that are opened beyond
+ * it are refused with RST_STREAM (REFUSED_STREAM), which clients can retry.
+ */
+extern size_t		 OMHTTP2MaxConcurrentStreams;
+
+/**
+ * The largest DATA frame that is sent in octets, if the SETTINGS_MAX_FRAME_SIZE
+ * of the client allows it. Larger frames carry bulk responses with less
+ * overhead, but make more urgent streams wait longer for their turn.
+ */
+extern size_t		 OMHTTP2MaxDataFrameSize;
+
+/**
+ * The SETTINGS_MAX_HEADER_LIST_SIZE that is advertised to HTTP/2 clients, as
+ * defined in RFC 7540 § 6.5.2. Requests with a larger header list are reset.
+ */
+extern size_t		 OMHTTP2MaxHeaderListSize;
+
+/**
+ * The HTTP/2 receive windows in octets, for both the connection and its
+ * streams. Windows start at OMHTTP2InitialReceiveWindow, which is advertised
+ * with SETTINGS_INITIAL_WINDOW_SIZE, and grow up to OMHTTP2MaxReceiveWindow
+ * towards the bandwidth-delay product of the connection, which is measured
+ * with PING frames while the client is sending data.
+ *
+ * Request bodies are discarded, so a larger window only lets clients send
+ * more data that is thrown away. The maximum is therefore the initial window
+ * by default, which disables the growth and the PING frames. It should only
+ * be raised once request bodies are consumed.
+ */
+extern size_t		 OMHTTP2InitialReceiveWindow;
+extern size_t		 OMHTTP2MaxReceiveWindow;
+
 extern enum OSILevel OMGSSystemInformationInServerHeader;
 
 /* Functions */
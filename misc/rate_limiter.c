@@ -0,0 +1,264 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rate_limiter.h"
+
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "misc/options.h"
+#include "misc/statistics.h"
+
+/* Use function macros for testing */
+#ifndef FUNC_CLOCK_GETTIME
+#define FUNC_CLOCK_GETTIME clock_gettime
+#endif
+
+#define RL_SHARD_COUNT 16
+#define RL_SHARD_SIZE 1024
+#define RL_PROBE_LIMIT 8
+
+/* Tokens are stored in 1/256th units, so low refill rates still work. */
+#define RL_TOKEN_SCALE 256
+#define RL_TOKEN_BITS 24
+#define RL_TOKEN_MASK ((UINT64_C(1) << RL_TOKEN_BITS) - 1)
+
+/* Refilling is capped, so the multiplication below can't overflow. */
+#define RL_MAX_ELAPSED (UINT64_C(1) << 24)
+
+struct RLBucket {
+	/* The hashed address prefix, or 0 if the bucket is unused. */
+	atomic_uint_least64_t key;
+
+	/* The upper 40 bits contain the time of the last update in milliseconds,
+	 * the lower RL_TOKEN_BITS bits contain the amount of tokens left. */
+	atomic_uint_least64_t state;
+};
+
+/**
+ * The table is split up into shards, selected by the upper bits of the hash.
+ * Collisions are resolved by linear probing within the shard, and when no
+ * bucket is free, the least recently used bucket is taken over.
+ */
+struct RLShard {
+	struct RLBucket buckets[RL_SHARD_SIZE];
+};
+
+static struct RLShard RLShards[RL_SHARD_COUNT];
+static struct timespec RLEpoch;
+static uint64_t RLSeed;
+
+static uint64_t
+getMilliseconds(void) {
+	struct timespec now;
+
+	FUNC_CLOCK_GETTIME(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) (now.tv_sec - RLEpoch.tv_sec) * 1000 +
+		   (now.tv_nsec - RLEpoch.tv_nsec) / 1000000;
+}
+
+/* The finalizer of SplitMix64, which has good avalanche properties. */
+static uint64_t
+mixHash(uint64_t value) {
+	value ^= RLSeed;
+	value = (value ^ (value >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	value = (value ^ (value >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return value ^ (value >> 31);
+}
+
+/* Returns false if the address family isn't supported. */
+static bool
+hashAddress(const struct sockaddr *address, uint64_t *outHash) {
+	const uint8_t *bytes;
+	uint32_t ipv4;
+	uint64_t prefix;
+
+	switch (address->sa_family) {
+		case AF_INET:
+			memcpy(&ipv4, &((const struct sockaddr_in *) address)->sin_addr,
+				   sizeof(ipv4));
+			*outHash = mixHash(ipv4);
+			break;
+		case AF_INET6:
+			bytes = ((const struct sockaddr_in6 *) address)->sin6_addr.s6_addr;
+
+			/* IPv4-mapped addresses (::ffff:0:0/96) are treated as IPv4 */
+			if (IN6_IS_ADDR_V4MAPPED(
+					&((const struct sockaddr_in6 *) address)->sin6_addr)) {
+				memcpy(&ipv4, bytes + 12, sizeof(ipv4));
+				*outHash = mixHash(ipv4);
+				break;
+			}
+
+			/* A single subscriber usually gets a whole /64 */
+			memcpy(&prefix, bytes, sizeof(prefix));
+			*outHash = mixHash(prefix ^ UINT64_C(0x6666666666666666));
+			break;
+		default:
+			return false;
+	}
+
+	/* 0 is reserved for unused buckets */
+	if (*outHash == 0)
+		*outHash = 1;
+
+	return true;
+}
+
+static struct RLBucket *
+findBucket(uint64_t hash, uint64_t fullState) {
+	struct RLBucket *oldest;
+	uint64_t oldestKey;
+	uint64_t oldestTime;
+	struct RLShard *shard;
+	size_t i;
+
+	shard = &RLShards[hash >> 60];
+	oldest = NULL;
+	oldestKey = 0;
+	oldestTime = UINT64_MAX;
+
+	for (i = 0; i < RL_PROBE_LIMIT; i++) {
+		struct RLBucket *bucket;
+		uint_least64_t key;
+		uint64_t time;
+
+		bucket = &shard->buckets[(hash + i) % RL_SHARD_SIZE];
+		key = atomic_load_explicit(&bucket->key, memory_order_acquire);
+
+		if (key == hash)
+			return bucket;
+
+		if (key == 0) {
+			if (atomic_compare_exchange_strong(&bucket->key, &key, hash)) {
+				atomic_store(&bucket->state, fullState);
+				return bucket;
+			}
+
+			/* Another thread was faster */
+			if (key == hash)
+				return bucket;
+			continue;
+		}
+
+		time = atomic_load_explicit(&bucket->state, memory_order_relaxed)
+				>> RL_TOKEN_BITS;
+		if (time < oldestTime) {
+			oldest = bucket;
+			oldestKey = key;
+			oldestTime = time;
+		}
+	}
+
+	/* Evict the least recently used bucket. If another thread changes it in
+	 * the meantime, the client is given the benefit of the doubt. */
+	if (oldest == NULL ||
+		!atomic_compare_exchange_strong(&oldest->key, &oldestKey, hash))
+		return NULL;
+
+	atomic_store(&oldest->state, fullState);
+	SMAddCounter(SMC_RATE_LIMIT_EVICTED, 1);
+	return oldest;
+}
+
+bool
+RLAdmit(const struct sockaddr *address) {
+	struct RLBucket *bucket;
+	uint64_t hash;
+	uint64_t maxTokens;
+	uint64_t now;
+	uint_least64_t state;
+	uint64_t newState;
+
+	if (OMRateLimitBurst == 0 || !hashAddress(address, &hash))
+		return true;
+
+	maxTokens = (uint64_t) OMRateLimitBurst * RL_TOKEN_SCALE;
+	if (maxTokens > RL_TOKEN_MASK)
+		maxTokens = RL_TOKEN_MASK;
+
+	now = getMilliseconds();
+	bucket = findBucket(hash, (now << RL_TOKEN_BITS) | maxTokens);
+	if (bucket == NULL) {
+		SMAddCounter(SMC_RATE_LIMIT_ADMITTED, 1);
+		return true;
+	}
+
+	state = atomic_load_explicit(&bucket->state, memory_order_relaxed);
+	do {
+		uint64_t last;
+		uint64_t tokens;
+
+		last = state >> RL_TOKEN_BITS;
+		tokens = state & RL_TOKEN_MASK;
+
+		if (now > last) {
+			uint64_t elapsed;
+
+			elapsed = now - last;
+			if (elapsed > RL_MAX_ELAPSED)
+				elapsed = RL_MAX_ELAPSED;
+			tokens += elapsed * OMRateLimitRate * RL_TOKEN_SCALE / 1000;
+			last = now;
+		}
+
+		if (tokens > maxTokens)
+			tokens = maxTokens;
+
+		if (tokens < RL_TOKEN_SCALE) {
+			SMAddCounter(SMC_RATE_LIMIT_REJECTED, 1);
+			return false;
+		}
+
+		newState = (last << RL_TOKEN_BITS) | (tokens - RL_TOKEN_SCALE);
+	} while (!atomic_compare_exchange_weak_explicit(&bucket->state, &state,
+				newState, memory_order_relaxed, memory_order_relaxed));
+
+	SMAddCounter(SMC_RATE_LIMIT_ADMITTED, 1);
+	return true;
+}
+
+void
+RLSetup(void) {
+	FUNC_CLOCK_GETTIME(CLOCK_MONOTONIC, &RLEpoch);
+
+	/* The seed doesn't have to be cryptographically secure; it only makes it
+	 * harder to craft addresses that collide on purpose. */
+	RLSeed = mixHash((uint64_t) time(NULL) ^
+					 ((uint64_t) getpid() << 32) ^
+					 (uint64_t) RLEpoch.tv_nsec);
+}
@@ -30,6 +30,7 @@
 #include "statistics.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
@@ -40,6 +41,51 @@ static pthread_mutex_t MSTrafficMutex = PTHREAD_MUTEX_INITIALIZER;
 static size_t MSTrafficCount = 0;
 static clock_t MSBeginTime = -1;
 
+static atomic_size_t MSCounters[SMC_COUNT];
+static const char *MSCounterNames[SMC_COUNT] = {
+	"RateLimitAdmitted",
+	"RateLimitRejected",
+	"RateLimitEvicted",
+	"HTTPRequests",
+	"HTTP2Streams",
+	"HTTP2StreamsRefused",
+	"HTTP2WindowsGrown",
+	"LoadShedConnections",
+	"LoadShedRequests",
+	"TLSHandshakesFull",
+	"TLSHandshakesResumed",
+	"TLSSessionCacheHits",
+	"TLSSessionCacheMisses",
+	"TLSTicketsRenewed",
+	"TLSEarlyDataAccepted",
+	"TLSEarlyDataDeferred",
+	"TLSEarlyDataReplayed",
+	"TLSHandshakesFailed",
+	"TLSHandshakesTimedOut",
+	"TLSHandshakeMicroseconds",
+	"TLSContextReloads",
+	"TLSOCSPStapled",
+	"TLSSNIUnknown",
+	"TLSHandshakesECDSA",
+	"TLSHandshakesRSA",
+	"TLSSignaturesOffloaded",
+	"TLSOctetsAES128GCM",
+	"TLSOctetsAES256GCM",
+	"TLSOctetsChaCha20Poly1305",
+	"TLSOctetsOtherCiphers",
+};
+
+void
+SMAddCounter(enum SMCounter counter, size_t amount) {
+	atomic_fetch_add_explicit(&MSCounters[counter], amount,
+							  memory_order_relaxed);
+}
+
+size_t
+SMGetCounter(enum SMCounter counter) {
+	return atomic_load_explicit(&MSCounters[counter], memory_order_relaxed);
+}
+
 size_t
 SMGetPageTraffic(void) {
 	size_t result;
@@ -69,7 +115,9 @@ SMBegin(void) {
 
 void
 SMEnd(void) {
+	enum SMCounter counter;
 	clock_t endTime;
+	size_t handshakes;
 	bool hasPrinted;
 
 	endTime = clock();
@@ -146,4 +194,38 @@ SMEnd(void) {
 
 		puts(ANSI_COLOR_RESET);
 	}
+
+	for (counter = 0; counter < SMC_COUNT; counter++) {
+		size_t value;
+
+		value = SMGetCounter(counter);
+		if (value != 0)
+			printf(ANSI_COLOR_CYAN"Counter> "ANSI_COLOR_GREY"%s = %zu"
+				   ANSI_COLOR_RESETLN, MSCounterNames[counter], value);
+	}
+
+	if (SMGetCounter(SMC_HTTP_REQUESTS) != 0)
+		printf(ANSI_COLOR_CYAN"Shed> "ANSI_COLOR_GREY"%.2f%% of the requests "
+			   "were shed."ANSI_COLOR_RESETLN,
+			   SMGetCounter(SMC_LOAD_SHED_REQUESTS) * 100.0 /
+			   SMGetCounter(SMC_HTTP_REQUESTS));
+
+	handshakes = SMGetCounter(SMC_TLS_HANDSHAKES_FULL) +
+				 SMGetCounter(SMC_TLS_HANDSHAKES_RESUMED);
+	if (handshakes != 0)
+		printf(ANSI_COLOR_CYAN"Resumption> "ANSI_COLOR_GREY"%.2f%% of the "
+			   "handshakes were resumed."ANSI_COLOR_RESETLN,
+			   SMGetCounter(SMC_TLS_HANDSHAKES_RESUMED) * 100.0 / handshakes);
+
+	if (SMGetCounter(SMC_TLS_HANDSHAKES_FULL) != 0)
+		printf(ANSI_COLOR_CYAN"Certificates> "ANSI_COLOR_GREY"%.2f%% of the "
+			   "full handshakes used ECDSA."ANSI_COLOR_RESETLN,
+			   SMGetCounter(SMC_TLS_HANDSHAKES_ECDSA) * 100.0 /
+			   SMGetCounter(SMC_TLS_HANDSHAKES_FULL));
+
+	if (handshakes != 0)
+		printf(ANSI_COLOR_CYAN"Handshake> "ANSI_COLOR_GREY"A handshake took "
+			   "%.2f ms on average."ANSI_COLOR_RESETLN,
+			   SMGetCounter(SMC_TLS_HANDSHAKE_MICROSECONDS) / 1000.0 /
+			   handshakes);
 }
@@ -37,12 +37,63 @@
 
 #include <stddef.h>
 
+/**
+ * Counters that are exported for tuning. They are printed when the server
+ * stops. Updating a counter is lock-free, so they can be used on hot paths.
+ */
+enum SMCounter {
+	SMC_RATE_LIMIT_ADMITTED,
+	SMC_RATE_LIMIT_REJECTED,
+	SMC_RATE_LIMIT_EVICTED,
+	SMC_HTTP_REQUESTS,
+	SMC_HTTP2_STREAMS,
+	SMC_HTTP2_STREAMS_REFUSED,
+	/* Receive windows that were grown to the bandwidth-delay product. */
+	SMC_HTTP2_WINDOWS_GROWN,
+	SMC_LOAD_SHED_CONNECTIONS,
+	SMC_LOAD_SHED_REQUESTS,
+	SMC_TLS_HANDSHAKES_FULL,
+	SMC_TLS_HANDSHAKES_RESUMED,
+	SMC_TLS_SESSION_CACHE_HITS,
+	SMC_TLS_SESSION_CACHE_MISSES,
+	SMC_TLS_TICKETS_RENEWED,
+	SMC_TLS_EARLY_DATA_ACCEPTED,
+	SMC_TLS_EARLY_DATA_DEFERRED,
+	SMC_TLS_EARLY_DATA_REPLAYED,
+	SMC_TLS_HANDSHAKES_FAILED,
+	SMC_TLS_HANDSHAKES_TIMED_OUT,
+	/* The total time spent in (successful) handshakes. */
+	SMC_TLS_HANDSHAKE_MICROSECONDS,
+	SMC_TLS_CONTEXT_RELOADS,
+	SMC_TLS_OCSP_STAPLED,
+	SMC_TLS_SNI_UNKNOWN,
+	/* Full handshakes, by the type of the certificate that was used. */
+	SMC_TLS_HANDSHAKES_ECDSA,
+	SMC_TLS_HANDSHAKES_RSA,
+	/* Signatures that were computed by the crypto pool. */
+	SMC_TLS_SIGNATURES_OFFLOADED,
+	/* The octets of application data that were encrypted, by cipher. */
+	SMC_TLS_OCTETS_AES_128_GCM,
+	SMC_TLS_OCTETS_AES_256_GCM,
+	SMC_TLS_OCTETS_CHACHA20_POLY1305,
+	SMC_TLS_OCTETS_OTHER_CIPHERS,
+
+	/* The amount of counters, not an actual counter. */
+	SMC_COUNT
+};
+
+void
+SMAddCounter(enum SMCounter, size_t);
+
 void
 SMBegin(void);
 
 void
 SMEnd(void);
 
+size_t
+SMGetCounter(enum SMCounter);
+
 size_t
 SMGetPageTraffic(void);
 
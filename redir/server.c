@@ -40,6 +40,7 @@
 
 #include "base/global_state.h"
 #include "misc/default.h"
+#include "misc/rate_limiter.h"
 #include "client.h"
 
 static void *
@@ -53,6 +54,8 @@ RSEntrypoint(void *threadParameter) {
 	pollInfo.fd = GSRedirSocket;
 
 	while (GSMainLoop) {
+		struct sockaddr_storage address;
+		socklen_t addressLength;
 		int ret;
 		int sockfd;
 
@@ -71,7 +74,9 @@ RSEntrypoint(void *threadParameter) {
 		if (pollInfo.revents == POLLNVAL)
 			break;
 
-		sockfd = accept(GSRedirSocket, NULL, 0);
+		addressLength = sizeof(address);
+		sockfd = accept(GSRedirSocket, (struct sockaddr *) &address,
+						&addressLength);
 
 		if (sockfd == -1) {
 			if (errno == EAGAIN ||
@@ -101,7 +106,13 @@ RSEntrypoint(void *threadParameter) {
 			break;
 		}
 
-		if (!GSScheduleChildThread(GSTP_REDIR, RSChildEntrypoint, sockfd)) {
+		if (!RLAdmit((struct sockaddr *) &address)) {
+			close(sockfd);
+			continue;
+		}
+
+		if (!GSScheduleChildThread(GSTP_REDIR, RSChildEntrypoint, sockfd,
+								   NULL)) {
 			close(sockfd);
 			fputs(
 				ANSI_COLOR_RED
@@ -0,0 +1,346 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Measures the first flight of the server (ServerHello up to Finished) and the
+ * duration of full TLS 1.3 handshakes, with and without certificate
+ * compression. The compressed chain is only sent when OpenSSL 3.2 or later is
+ * used; with older versions only the uncompressed handshake is measured.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "core/security.c"
+
+#define HANDSHAKE_COUNT 200
+
+struct Test {
+	bool (*function)(void);
+	const char *name;
+};
+
+struct Measurement {
+	size_t	 flightSize;
+	double	 microseconds;
+};
+
+static char Directory[] = "/tmp/certificate_compressionXXXXXX";
+static char CertificateFile[64];
+static char ChainFile[64];
+static char PrivateKeyFile[64];
+
+static struct OMSCertificate Certificate = {
+	"localhost",
+	{ { CertificateFile, ChainFile, PrivateKeyFile, NULL } },
+	1
+};
+
+static struct Measurement Uncompressed;
+
+bool TestUncompressed(void);
+bool TestCompressed(void);
+
+static bool createFiles(void);
+static void removeFiles(void);
+
+int main(void) {
+	size_t i;
+	bool ret;
+
+	struct Test tests[] = {
+		{ TestUncompressed, "Uncompressed" },
+		{ TestCompressed, "Compressed" },
+	};
+
+	if (!createFiles()) {
+		puts("Failed to create the certificates");
+		removeFiles();
+		return EXIT_FAILURE;
+	}
+
+	OMSCertificates = &Certificate;
+	OMSCertificateCount = 1;
+	OMSCryptoThreadCount = 0;
+	ret = CSSetupSecurityManager() == 1;
+	removeFiles();
+	if (!ret) {
+		puts("Failed to set up the security manager");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("Running test %s...", tests[i].name);
+		fflush(stdout);
+
+		if (!tests[i].function()) {
+			printf("\rRunning test %s...failed\n", tests[i].name);
+			CSDestroySecurityManager();
+			return EXIT_FAILURE;
+		}
+	}
+
+	CSDestroySecurityManager();
+	return EXIT_SUCCESS;
+}
+
+/* Signs the certificate with the key of the issuer, which is the certificate
+ * itself when issuer is NULL. */
+static X509 *
+createCertificate(const char *name, EVP_PKEY *key, X509 *issuer,
+				  EVP_PKEY *issuerKey) {
+	X509 *certificate;
+	X509_NAME *subject;
+
+	certificate = X509_new();
+	subject = X509_NAME_new();
+	if (!certificate || !subject ||
+		!X509_set_version(certificate, 2) ||
+		!ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1) ||
+		!X509_gmtime_adj(X509_getm_notBefore(certificate), 0) ||
+		!X509_gmtime_adj(X509_getm_notAfter(certificate), 86400) ||
+		!X509_NAME_add_entry_by_txt(subject, "O", MBSTRING_ASC,
+									(const unsigned char *) "FeatherServer",
+									-1, -1, 0) ||
+		!X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC,
+									(const unsigned char *) name, -1, -1, 0) ||
+		!X509_set_subject_name(certificate, subject) ||
+		!X509_set_issuer_name(certificate, issuer ?
+							  X509_get_subject_name(issuer) : subject) ||
+		!X509_set_pubkey(certificate, key) ||
+		!X509_sign(certificate, issuerKey, EVP_sha256())) {
+		X509_NAME_free(subject);
+		X509_free(certificate);
+		return NULL;
+	}
+
+	X509_NAME_free(subject);
+	return certificate;
+}
+
+static bool
+writeFile(const char *path, X509 *certificate, EVP_PKEY *key) {
+	FILE *file;
+	bool ret;
+
+	file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	ret = certificate ? PEM_write_X509(file, certificate) == 1
+					  : PEM_write_PrivateKey(file, key, NULL, NULL, 0, NULL,
+											 NULL) == 1;
+	return fclose(file) == 0 && ret;
+}
+
+/* Creates an RSA authority and a leaf certificate signed by it, the usual
+ * shape of a chain that is sent in the handshake. */
+static bool
+createFiles(void) {
+	EVP_PKEY *authorityKey;
+	EVP_PKEY *key;
+	X509 *authority = NULL;
+	X509 *leaf = NULL;
+	bool ret;
+
+	if (!mkdtemp(Directory))
+		return false;
+
+	snprintf(CertificateFile, sizeof(CertificateFile), "%s/cert.pem",
+			 Directory);
+	snprintf(ChainFile, sizeof(ChainFile), "%s/chain.pem", Directory);
+	snprintf(PrivateKeyFile, sizeof(PrivateKeyFile), "%s/key.pem", Directory);
+
+	authorityKey = EVP_RSA_gen(2048);
+	key = EVP_RSA_gen(2048);
+	if (authorityKey && key) {
+		authority = createCertificate("FeatherServer Test CA", authorityKey,
+									  NULL, authorityKey);
+		if (authority)
+			leaf = createCertificate("localhost", key, authority,
+									 authorityKey);
+	}
+
+	ret = leaf != NULL &&
+		  writeFile(CertificateFile, leaf, NULL) &&
+		  writeFile(ChainFile, authority, NULL) &&
+		  writeFile(PrivateKeyFile, NULL, key);
+
+	X509_free(leaf);
+	X509_free(authority);
+	EVP_PKEY_free(key);
+	EVP_PKEY_free(authorityKey);
+	return ret;
+}
+
+static void
+removeFiles(void) {
+	unlink(CertificateFile);
+	unlink(ChainFile);
+	unlink(PrivateKeyFile);
+	rmdir(Directory);
+}
+
+/**
+ * Performs one full handshake over a BIO pair, and stores the octets the
+ * server wrote before the client finished, i.e. its first flight. Session
+ * tickets are disabled so the flight only contains the handshake itself.
+ */
+static bool
+handshake(SSL_CTX *clientContext, size_t *flightSize) {
+	SSL *client;
+	SSL *server;
+	BIO *clientBIO;
+	BIO *serverBIO;
+	bool isClientDone = false;
+	bool isServerDone = false;
+	size_t i;
+
+	client = SSL_new(clientContext);
+	server = SSL_new(CSSSites[0].context);
+	if (!client || !server ||
+		!BIO_new_bio_pair(&clientBIO, 0, &serverBIO, 0)) {
+		SSL_free(client);
+		SSL_free(server);
+		return false;
+	}
+
+	SSL_set_bio(client, clientBIO, clientBIO);
+	SSL_set_bio(server, serverBIO, serverBIO);
+	SSL_set_connect_state(client);
+	SSL_set_accept_state(server);
+	SSL_set_num_tickets(server, 0);
+
+	for (i = 0; i < 16 && !(isClientDone && isServerDone); i++) {
+		if (!isClientDone) {
+			isClientDone = SSL_do_handshake(client) == 1;
+			if (isClientDone)
+				*flightSize = BIO_number_written(serverBIO);
+		}
+
+		if (!isServerDone)
+			isServerDone = SSL_do_handshake(server) == 1;
+	}
+
+	SSL_free(client);
+	SSL_free(server);
+	ERR_clear_error();
+	return isClientDone && isServerDone;
+}
+
+/* Performs HANDSHAKE_COUNT handshakes with the client context. */
+static bool
+measure(SSL_CTX *clientContext, struct Measurement *measurement) {
+	struct timespec start;
+	struct timespec end;
+	size_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < HANDSHAKE_COUNT; i++) {
+		if (!handshake(clientContext, &measurement->flightSize))
+			return false;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	measurement->microseconds = ((end.tv_sec - start.tv_sec) * 1e6 +
+								 (end.tv_nsec - start.tv_nsec) / 1e3) /
+								HANDSHAKE_COUNT;
+	return true;
+}
+
+static SSL_CTX *
+createClientContext(void) {
+	SSL_CTX *context;
+
+	context = SSL_CTX_new(TLS_client_method());
+	if (!context)
+		return NULL;
+
+	SSL_CTX_set_min_proto_version(context, TLS1_3_VERSION);
+	SSL_CTX_set_verify(context, SSL_VERIFY_NONE, NULL);
+	return context;
+}
+
+bool
+TestUncompressed(void) {
+	SSL_CTX *context;
+	bool ret;
+
+	context = createClientContext();
+	if (!context)
+		return false;
+
+#ifdef CSS_CERTIFICATE_COMPRESSION
+	SSL_CTX_set_options(context, SSL_OP_NO_RX_CERTIFICATE_COMPRESSION);
+#endif
+
+	ret = measure(context, &Uncompressed);
+	SSL_CTX_free(context);
+	if (ret)
+		printf("%zu octets, %.0f us per handshake\n", Uncompressed.flightSize,
+			   Uncompressed.microseconds);
+	return ret;
+}
+
+bool
+TestCompressed(void) {
+#ifdef CSS_CERTIFICATE_COMPRESSION
+	struct Measurement compressed;
+	SSL_CTX *context;
+	int algorithms[] = { TLSEXT_comp_cert_brotli };
+	bool ret;
+
+	context = createClientContext();
+	if (!context)
+		return false;
+
+	SSL_CTX_set1_cert_comp_preference(context, algorithms, 1);
+	ret = measure(context, &compressed);
+	SSL_CTX_free(context);
+	if (!ret)
+		return false;
+
+	printf("%zu octets, %.0f us per handshake\n", compressed.flightSize,
+		   compressed.microseconds);
+	return compressed.flightSize < Uncompressed.flightSize;
+#else
+	puts("skipped (requires OpenSSL 3.2)");
+	return true;
+#endif
+}
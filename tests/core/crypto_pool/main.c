@@ -0,0 +1,254 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The crypto pool uses the deprecated RSA_METHOD and EC_KEY_METHOD. */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/async.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+
+#include "core/crypto_pool.c"
+
+struct Test {
+	bool (*function)(void);
+	const char *name;
+};
+
+struct Signature {
+	EVP_PKEY		*key;
+	unsigned char	 data[512];
+	size_t			 size;
+};
+
+static const unsigned char Message[] = "FeatherServer";
+
+static EVP_PKEY *ECKey;
+static EVP_PKEY *RSAKey;
+
+bool TestInline(void);
+bool TestAsyncECDSA(void);
+bool TestAsyncRSA(void);
+bool TestAbandoned(void);
+
+int main(void) {
+	size_t i;
+
+	struct Test tests[] = {
+		{ TestInline, "Inline" },
+		{ TestAsyncECDSA, "AsyncECDSA" },
+		{ TestAsyncRSA, "AsyncRSA" },
+		{ TestAbandoned, "Abandoned" },
+	};
+
+	OMSCryptoThreadCount = 2;
+	if (!CPSetup() || !CPIsEnabled()) {
+		puts("Failed to set up the crypto pool");
+		return EXIT_FAILURE;
+	}
+
+	ECKey = EVP_EC_gen("P-256");
+	RSAKey = EVP_RSA_gen(2048);
+	if (ECKey == NULL || RSAKey == NULL) {
+		puts("Failed to generate the keys");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("Running test %s...", tests[i].name);
+
+		if (!tests[i].function()) {
+			printf("\rRunning test %s...failed\n", tests[i].name);
+			return EXIT_FAILURE;
+		}
+
+		puts("ok");
+	}
+
+	CPDestroy();
+	EVP_PKEY_free(ECKey);
+	EVP_PKEY_free(RSAKey);
+	return EXIT_SUCCESS;
+}
+
+/* Signs the message like TLS 1.3 does, i.e. RSA keys use PSS. */
+static bool
+sign(struct Signature *signature) {
+	EVP_MD_CTX *context;
+	EVP_PKEY_CTX *keyContext;
+	bool ret;
+
+	context = EVP_MD_CTX_new();
+	if (context == NULL)
+		return false;
+
+	signature->size = sizeof(signature->data);
+	ret = EVP_DigestSignInit(context, &keyContext, EVP_sha256(), NULL,
+							 signature->key) == 1 &&
+		  (EVP_PKEY_get_base_id(signature->key) != EVP_PKEY_RSA ||
+		   EVP_PKEY_CTX_set_rsa_padding(keyContext,
+										RSA_PKCS1_PSS_PADDING) == 1) &&
+		  EVP_DigestSign(context, signature->data, &signature->size, Message,
+						 sizeof(Message)) == 1;
+
+	EVP_MD_CTX_free(context);
+	return ret;
+}
+
+/* Verifies the signature using the original key. */
+static bool
+verify(const struct Signature *signature, EVP_PKEY *key) {
+	EVP_MD_CTX *context;
+	EVP_PKEY_CTX *keyContext;
+	bool ret;
+
+	context = EVP_MD_CTX_new();
+	if (context == NULL)
+		return false;
+
+	ret = EVP_DigestVerifyInit(context, &keyContext, EVP_sha256(), NULL,
+							   key) == 1 &&
+		  (EVP_PKEY_get_base_id(key) != EVP_PKEY_RSA ||
+		   EVP_PKEY_CTX_set_rsa_padding(keyContext,
+										RSA_PKCS1_PSS_PADDING) == 1) &&
+		  EVP_DigestVerify(context, signature->data, signature->size,
+						   Message, sizeof(Message)) == 1;
+
+	EVP_MD_CTX_free(context);
+	return ret;
+}
+
+static int
+signJob(void *argument) {
+	return sign(*(struct Signature **) argument);
+}
+
+/* Waits until the file descriptor of the paused job is readable. */
+static bool
+waitForJob(ASYNC_WAIT_CTX *waitContext) {
+	struct pollfd pollInfo;
+	OSSL_ASYNC_FD fd;
+	size_t count;
+
+	if (!ASYNC_WAIT_CTX_get_all_fds(waitContext, NULL, &count) ||
+		count != 1 || !ASYNC_WAIT_CTX_get_all_fds(waitContext, &fd, &count))
+		return false;
+
+	pollInfo.fd = fd;
+	pollInfo.events = POLLIN;
+	return poll(&pollInfo, 1, 5000) == 1;
+}
+
+/* Signs the message in an async job, which should be paused once. */
+static bool
+signAsync(EVP_PKEY *key) {
+	ASYNC_WAIT_CTX *waitContext;
+	ASYNC_JOB *job;
+	struct Signature signature;
+	struct Signature *argument;
+	size_t offloaded;
+	int result;
+	bool ret;
+
+	signature.key = CPWrapPrivateKey(key);
+	if (signature.key == NULL)
+		return false;
+
+	waitContext = ASYNC_WAIT_CTX_new();
+	job = NULL;
+	argument = &signature;
+	offloaded = SMGetCounter(SMC_TLS_SIGNATURES_OFFLOADED);
+
+	ret = ASYNC_start_job(&job, waitContext, &result, signJob, &argument,
+						  sizeof(argument)) == ASYNC_PAUSE &&
+		  waitForJob(waitContext) &&
+		  ASYNC_start_job(&job, waitContext, &result, signJob, &argument,
+						  sizeof(argument)) == ASYNC_FINISH &&
+		  result == 1 &&
+		  SMGetCounter(SMC_TLS_SIGNATURES_OFFLOADED) == offloaded + 1 &&
+		  verify(&signature, key);
+
+	ASYNC_WAIT_CTX_free(waitContext);
+	EVP_PKEY_free(signature.key);
+	return ret;
+}
+
+bool TestInline(void) {
+	struct Signature signature;
+	bool ret;
+
+	/* Outside of a job, the signature is computed by the caller. */
+	signature.key = CPWrapPrivateKey(ECKey);
+	ret = signature.key != NULL && sign(&signature) &&
+		  SMGetCounter(SMC_TLS_SIGNATURES_OFFLOADED) == 0 &&
+		  verify(&signature, ECKey);
+
+	EVP_PKEY_free(signature.key);
+	return ret;
+}
+
+bool TestAsyncECDSA(void) {
+	return signAsync(ECKey);
+}
+
+bool TestAsyncRSA(void) {
+	return signAsync(RSAKey);
+}
+
+bool TestAbandoned(void) {
+	ASYNC_WAIT_CTX *waitContext;
+	ASYNC_JOB *job;
+	struct Signature signature;
+	struct Signature *argument;
+	int result;
+	bool ret;
+
+	signature.key = CPWrapPrivateKey(ECKey);
+	if (signature.key == NULL)
+		return false;
+
+	waitContext = ASYNC_WAIT_CTX_new();
+	job = NULL;
+	argument = &signature;
+
+	/* Like a connection that is destroyed while its job is paused. The
+	 * task must stay valid until the crypto thread has finished it. */
+	ret = ASYNC_start_job(&job, waitContext, &result, signJob, &argument,
+						  sizeof(argument)) == ASYNC_PAUSE;
+
+	ASYNC_WAIT_CTX_free(waitContext);
+	EVP_PKEY_free(signature.key);
+	return ret;
+}
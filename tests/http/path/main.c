@@ -0,0 +1,155 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http/path.c"
+
+struct Test {
+	bool (*function)(void);
+	const char *name;
+};
+
+bool TestPlain(void);
+bool TestQueryAndFragment(void);
+bool TestPercentDecoding(void);
+bool TestDotSegments(void);
+bool TestSlashes(void);
+bool TestInvalid(void);
+
+int main(void) {
+	size_t i;
+
+	struct Test tests[] = {
+		{ TestPlain, "Plain" },
+		{ TestQueryAndFragment, "QueryAndFragment" },
+		{ TestPercentDecoding, "PercentDecoding" },
+		{ TestDotSegments, "DotSegments" },
+		{ TestSlashes, "Slashes" },
+		{ TestInvalid, "Invalid" },
+	};
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("Running test %s...", tests[i].name);
+
+		if (!tests[i].function()) {
+			printf("\n\rRunning test %s...failed\n", tests[i].name);
+			return EXIT_FAILURE;
+		}
+
+		puts("ok");
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static bool
+check(const char *path, const char *expected) {
+	char output[256];
+	size_t length;
+
+	if (!HTTPCanonicalizePath(path, strlen(path), output, &length)) {
+		printf("\n\t'%s' was rejected", path);
+		return false;
+	}
+
+	if (length != strlen(output) || strcmp(output, expected) != 0) {
+		printf("\n\t'%s' became '%s' instead of '%s'", path, output,
+			   expected);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+checkInvalid(const char *path) {
+	char output[256];
+	size_t length;
+
+	if (HTTPCanonicalizePath(path, strlen(path), output, &length)) {
+		printf("\n\t'%s' was accepted as '%s'", path, output);
+		return false;
+	}
+
+	return true;
+}
+
+bool TestPlain(void) {
+	return check("/", "/") &&
+		   check("/index.html", "/index.html") &&
+		   check("/a/", "/a/") &&
+		   check("/assets/stylesheets/main.min.css",
+				 "/assets/stylesheets/main.min.css") &&
+		   check("/.well-known/security.txt", "/.well-known/security.txt");
+}
+
+bool TestQueryAndFragment(void) {
+	return check("/x?v=2", "/x") &&
+		   check("/x#top", "/x") &&
+		   check("/a/?b=/../c", "/a/") &&
+		   check("/averylongsegmentname.js?", "/averylongsegmentname.js");
+}
+
+bool TestPercentDecoding(void) {
+	return check("/%61.css", "/a.css") &&
+		   check("/%2e%2E/a", "/a") &&
+		   check("/a%20b%3F", "/a b?") &&
+		   check("/%C3%A9t%C3%A9.html", "/\xC3\xA9t\xC3\xA9.html");
+}
+
+bool TestDotSegments(void) {
+	return check("/./a", "/a") &&
+		   check("/a/./b/../c", "/a/c") &&
+		   check("/a/b/..", "/a/") &&
+		   check("/a/.", "/a/") &&
+		   check("/../../a", "/a") &&
+		   check("/..", "/") &&
+		   check("/a/..b/.c", "/a/..b/.c");
+}
+
+bool TestSlashes(void) {
+	return check("//", "/") &&
+		   check("/a//b///c", "/a/b/c") &&
+		   check("/a/.//b", "/a/b");
+}
+
+bool TestInvalid(void) {
+	return checkInvalid("") &&
+		   checkInvalid("a/b") &&
+		   checkInvalid("/%") &&
+		   checkInvalid("/%4") &&
+		   checkInvalid("/%zz") &&
+		   checkInvalid("/a%00.html") &&
+		   checkInvalid("/a%2fb") &&
+		   checkInvalid("/a%2Fb");
+}
@@ -0,0 +1,728 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "http2/hpack.c"
+
+#define OUTPUT_SIZE 4096
+
+struct Test {
+	bool (*function)(void);
+	const char *name;
+};
+
+/* A header block from RFC 7541 Appendix C, with the expected outcome */
+struct Example {
+	const char *block;
+	const char *headers;
+	size_t tableSize;
+};
+
+struct Header {
+	const char *name;
+	const char *value;
+};
+
+/* The headers of the decoded blocks, as "name: value\n" lines */
+static char Decoded[OUTPUT_SIZE];
+static size_t DecodedLength;
+
+bool TestIntegers(void);
+bool TestLiterals(void);
+bool TestRequests(void);
+bool TestHuffmanRequests(void);
+bool TestResponses(void);
+bool TestHuffmanResponses(void);
+bool TestHuffman(void);
+bool TestEncoder(void);
+bool TestSizeUpdate(void);
+bool TestRoundTrip(void);
+bool TestMalformed(void);
+
+static void
+benchmark(void);
+
+int main(int argc, char **argv) {
+	size_t i;
+
+	struct Test tests[] = {
+		{ TestIntegers, "Integers" },
+		{ TestLiterals, "Literals" },
+		{ TestRequests, "Requests" },
+		{ TestHuffmanRequests, "HuffmanRequests" },
+		{ TestResponses, "Responses" },
+		{ TestHuffmanResponses, "HuffmanResponses" },
+		{ TestHuffman, "Huffman" },
+		{ TestEncoder, "Encoder" },
+		{ TestSizeUpdate, "SizeUpdate" },
+		{ TestRoundTrip, "RoundTrip" },
+		{ TestMalformed, "Malformed" },
+	};
+
+	pthread_once(&HPHuffmanOnce, buildHuffmanTransitions);
+
+	if (argc > 1 && strcmp(argv[1], "benchmark") == 0) {
+		benchmark();
+		return EXIT_SUCCESS;
+	}
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("Running test %s...", tests[i].name);
+
+		if (!tests[i].function()) {
+			printf("\rRunning test %s...failed\n", tests[i].name);
+			return EXIT_FAILURE;
+		}
+
+		puts("ok");
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Converts the hexadecimal notation of the RFC, spaces are ignored. */
+static size_t
+fromHex(const char *hex, uint8_t *output) {
+	size_t length = 0;
+	unsigned int octet;
+
+	while (*hex != '\0') {
+		if (*hex == ' ') {
+			hex++;
+			continue;
+		}
+
+		sscanf(hex, "%2x", &octet);
+		output[length++] = (uint8_t) octet;
+		hex += 2;
+	}
+
+	return length;
+}
+
+static bool
+collectHeader(void *userData, const char *name, size_t nameLength,
+			  const char *value, size_t valueLength) {
+	(void) userData;
+
+	if (DecodedLength + nameLength + valueLength + 3 > sizeof(Decoded))
+		return false;
+
+	memcpy(Decoded + DecodedLength, name, nameLength);
+	DecodedLength += nameLength;
+	memcpy(Decoded + DecodedLength, ": ", 2);
+	DecodedLength += 2;
+	memcpy(Decoded + DecodedLength, value, valueLength);
+	DecodedLength += valueLength;
+	Decoded[DecodedLength++] = '\n';
+	Decoded[DecodedLength] = '\0';
+	return true;
+}
+
+static bool
+countHeader(void *userData, const char *name, size_t nameLength,
+			const char *value, size_t valueLength) {
+	(void) name;
+	(void) nameLength;
+	(void) value;
+	(void) valueLength;
+
+	*((size_t *) userData) += 1;
+	return true;
+}
+
+static bool
+decodeExamples(const struct Example *examples, size_t count,
+			   size_t tableSize) {
+	static struct HPDecoder decoder;
+	uint8_t block[OUTPUT_SIZE];
+	size_t length;
+	size_t i;
+	bool ret = true;
+
+	HPInitDecoder(&decoder);
+	decoder.table.maxSize = tableSize;
+
+	for (i = 0; i < count && ret; i++) {
+		DecodedLength = 0;
+		Decoded[0] = '\0';
+
+		length = fromHex(examples[i].block, block);
+		if (!HPDecode(&decoder, block, length, collectHeader, NULL)) {
+			printf("\n\tblock %zu failed to decode", i);
+			ret = false;
+		} else if (strcmp(Decoded, examples[i].headers) != 0) {
+			printf("\n\tblock %zu decoded to:\n%s", i, Decoded);
+			ret = false;
+		} else if (decoder.table.size != examples[i].tableSize) {
+			printf("\n\tblock %zu: table size %zu", i, decoder.table.size);
+			ret = false;
+		}
+	}
+
+	HPDestroyDecoder(&decoder);
+	return ret;
+}
+
+/* RFC 7541 Appendix C.1 */
+bool
+TestIntegers(void) {
+	const uint8_t tooLarge[] = { 0x1F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+	const uint8_t truncated[] = { 0x1F, 0x9A };
+	uint8_t buffer[8];
+	const uint8_t *position;
+	uint32_t value;
+
+	buffer[0] = 0xE0;
+	if (encodeInteger(buffer, sizeof(buffer), 5, 0xE0, 10) != 1
+		|| buffer[0] != 0xEA)
+		return false;
+
+	if (encodeInteger(buffer, sizeof(buffer), 5, 0x00, 1337) != 3
+		|| buffer[0] != 0x1F || buffer[1] != 0x9A || buffer[2] != 0x0A)
+		return false;
+
+	if (encodeInteger(buffer, 2, 5, 0x00, 1337) != 0)
+		return false;
+
+	position = buffer;
+	if (!decodeInteger(&position, buffer + 3, 5, &value) || value != 1337
+		|| position != buffer + 3)
+		return false;
+
+	position = tooLarge;
+	if (decodeInteger(&position, tooLarge + sizeof(tooLarge), 5, &value))
+		return false;
+
+	position = truncated;
+	return !decodeInteger(&position, truncated + sizeof(truncated), 5,
+						  &value);
+}
+
+/* RFC 7541 Appendix C.2 */
+bool
+TestLiterals(void) {
+	const struct Example examples[] = {
+		{ "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572",
+		  "custom-key: custom-header\n", 55 },
+		{ "040c 2f73 616d 706c 652f 7061 7468",
+		  ":path: /sample/path\n", 55 },
+		{ "1008 7061 7373 776f 7264 0673 6563 7265 74",
+		  "password: secret\n", 55 },
+		{ "82",
+		  ":method: GET\n", 55 },
+	};
+
+	return decodeExamples(examples, sizeof(examples) / sizeof(examples[0]),
+						  HP_DEFAULT_TABLE_SIZE);
+}
+
+/* RFC 7541 Appendix C.3 */
+bool
+TestRequests(void) {
+	const struct Example examples[] = {
+		{ "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+		  ":method: GET\n:scheme: http\n:path: /\n"
+		  ":authority: www.example.com\n", 57 },
+		{ "8286 84be 5808 6e6f 2d63 6163 6865",
+		  ":method: GET\n:scheme: http\n:path: /\n"
+		  ":authority: www.example.com\ncache-control: no-cache\n", 110 },
+		{ "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661"
+		  "6c75 65",
+		  ":method: GET\n:scheme: https\n:path: /index.html\n"
+		  ":authority: www.example.com\ncustom-key: custom-value\n", 164 },
+	};
+
+	return decodeExamples(examples, sizeof(examples) / sizeof(examples[0]),
+						  HP_DEFAULT_TABLE_SIZE);
+}
+
+/* RFC 7541 Appendix C.4 */
+bool
+TestHuffmanRequests(void) {
+	const struct Example examples[] = {
+		{ "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+		  ":method: GET\n:scheme: http\n:path: /\n"
+		  ":authority: www.example.com\n", 57 },
+		{ "8286 84be 5886 a8eb 1064 9cbf",
+		  ":method: GET\n:scheme: http\n:path: /\n"
+		  ":authority: www.example.com\ncache-control: no-cache\n", 110 },
+		{ "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf",
+		  ":method: GET\n:scheme: https\n:path: /index.html\n"
+		  ":authority: www.example.com\ncustom-key: custom-value\n", 164 },
+	};
+
+	return decodeExamples(examples, sizeof(examples) / sizeof(examples[0]),
+						  HP_DEFAULT_TABLE_SIZE);
+}
+
+/* RFC 7541 Appendix C.5, which evicts entries from a 256 octet table */
+bool
+TestResponses(void) {
+	const struct Example examples[] = {
+		{ "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63"
+		  "7420 3230 3133 2032 303a 3133 3a32 3120 474d 546e 1768 7474 7073"
+		  "3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+		  ":status: 302\ncache-control: private\n"
+		  "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+		  "location: https://www.example.com\n", 222 },
+		{ "4803 3330 37c1 c0bf",
+		  ":status: 307\ncache-control: private\n"
+		  "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+		  "location: https://www.example.com\n", 222 },
+		{ "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133"
+		  "3a32 3220 474d 54c0 5a04 677a 6970 7738 666f 6f3d 4153 444a 4b48"
+		  "514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 553b 206d 6178"
+		  "2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e 3d31",
+		  ":status: 200\ncache-control: private\n"
+		  "date: Mon, 21 Oct 2013 20:13:22 GMT\n"
+		  "location: https://www.example.com\ncontent-encoding: gzip\n"
+		  "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; "
+		  "version=1\n", 215 },
+	};
+
+	return decodeExamples(examples, sizeof(examples) / sizeof(examples[0]),
+						  256);
+}
+
+/* RFC 7541 Appendix C.6 */
+bool
+TestHuffmanResponses(void) {
+	const struct Example examples[] = {
+		{ "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504"
+		  "0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae"
+		  "43d3",
+		  ":status: 302\ncache-control: private\n"
+		  "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+		  "location: https://www.example.com\n", 222 },
+		{ "4883 640e ffc1 c0bf",
+		  ":status: 307\ncache-control: private\n"
+		  "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+		  "location: https://www.example.com\n", 222 },
+		{ "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff"
+		  "c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af"
+		  "2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed 4ee5 b106 3d50"
+		  "07",
+		  ":status: 200\ncache-control: private\n"
+		  "date: Mon, 21 Oct 2013 20:13:22 GMT\n"
+		  "location: https://www.example.com\ncontent-encoding: gzip\n"
+		  "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; "
+		  "version=1\n", 215 },
+	};
+
+	return decodeExamples(examples, sizeof(examples) / sizeof(examples[0]),
+						  256);
+}
+
+bool
+TestHuffman(void) {
+	/* 'a' is 00011, followed by padding */
+	const uint8_t valid[] = { 0x1F };
+	const uint8_t zeroPadding[] = { 0x18 };
+	const uint8_t longPadding[] = { 0x1F, 0xFF };
+	const uint8_t eos[] = { 0xFF, 0xFF, 0xFF, 0xFF };
+	char input[256];
+	char output[HP_STRING_BUFFER_SIZE];
+	uint8_t encoded[1024];
+	size_t length;
+	size_t i;
+
+	if (huffmanDecode(valid, sizeof(valid), output) != 1 || output[0] != 'a')
+		return false;
+
+	if (huffmanDecode(zeroPadding, sizeof(zeroPadding), output) != -1
+		|| huffmanDecode(longPadding, sizeof(longPadding), output) != -1
+		|| huffmanDecode(eos, sizeof(eos), output) != -1)
+		return false;
+
+	/* Every symbol has to survive a round trip */
+	for (i = 0; i < sizeof(input); i++)
+		input[i] = (char) i;
+
+	length = huffmanEncodedLength(input, sizeof(input));
+	huffmanEncode(input, sizeof(input), encoded);
+
+	return huffmanDecode(encoded, length, output) == sizeof(input)
+		&& memcmp(input, output, sizeof(input)) == 0;
+}
+
+static bool
+encodeHeaders(struct HPEncoder *encoder, const struct Header *headers,
+			  size_t count, const char *expected) {
+	uint8_t block[OUTPUT_SIZE];
+	uint8_t expectedBlock[OUTPUT_SIZE];
+	size_t expectedLength;
+	size_t length = 0;
+	size_t written;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		written = HPEncode(encoder, block + length, sizeof(block) - length,
+						   headers[i].name, strlen(headers[i].name),
+						   headers[i].value, strlen(headers[i].value),
+						   HP_INDEXING_INCREMENTAL);
+		if (written == 0)
+			return false;
+		length += written;
+	}
+
+	expectedLength = fromHex(expected, expectedBlock);
+	return length == expectedLength
+		&& memcmp(block, expectedBlock, length) == 0;
+}
+
+/* The encoder should produce exactly the blocks of RFC 7541 C.4 and C.6 */
+bool
+TestEncoder(void) {
+	static struct HPEncoder encoder;
+	const struct Header request1[] = {
+		{ ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+		{ ":authority", "www.example.com" },
+	};
+	const struct Header request2[] = {
+		{ ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+		{ ":authority", "www.example.com" }, { "cache-control", "no-cache" },
+	};
+	const struct Header request3[] = {
+		{ ":method", "GET" }, { ":scheme", "https" },
+		{ ":path", "/index.html" }, { ":authority", "www.example.com" },
+		{ "custom-key", "custom-value" },
+	};
+	const struct Header response1[] = {
+		{ ":status", "302" }, { "cache-control", "private" },
+		{ "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+		{ "location", "https://www.example.com" },
+	};
+	const struct Header response2[] = {
+		{ ":status", "307" }, { "cache-control", "private" },
+		{ "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+		{ "location", "https://www.example.com" },
+	};
+	const struct Header response3[] = {
+		{ ":status", "200" }, { "cache-control", "private" },
+		{ "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+		{ "location", "https://www.example.com" },
+		{ "content-encoding", "gzip" },
+		{ "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; "
+						"version=1" },
+	};
+	bool ret;
+
+	HPInitEncoder(&encoder);
+	ret = encodeHeaders(&encoder, request1, 4,
+				"8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff")
+		&& encodeHeaders(&encoder, request2, 5,
+				"8286 84be 5886 a8eb 1064 9cbf")
+		&& encodeHeaders(&encoder, request3, 5,
+				"8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf")
+		&& encoder.table.size == 164;
+	HPDestroyEncoder(&encoder);
+
+	if (!ret)
+		return false;
+
+	/* Both sides agreed on 256 octets without signaling it */
+	HPInitEncoder(&encoder);
+	encoder.table.maxSize = 256;
+	ret = encodeHeaders(&encoder, response1, 4,
+				"4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005"
+				"9504 0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8"
+				"e9ae 82ae 43d3")
+		/* Unlike the RFC, "307" isn't Huffman-encoded, since that wouldn't
+		 * make it any shorter. */
+		&& encodeHeaders(&encoder, response2, 4,
+				"4803 3330 37c1 c0bf")
+		&& encodeHeaders(&encoder, response3, 6,
+				"88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d"
+				"1bff c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b"
+				"3960 d5af 2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed"
+				"4ee5 b106 3d50 07")
+		&& encoder.table.size == 215;
+	HPDestroyEncoder(&encoder);
+
+	return ret;
+}
+
+bool
+TestSizeUpdate(void) {
+	static struct HPEncoder encoder;
+	static struct HPDecoder decoder;
+	const struct Header header = { "custom-key", "custom-header" };
+	uint8_t block[64];
+	size_t length;
+	size_t count = 0;
+	bool ret;
+
+	HPInitEncoder(&encoder);
+	HPInitDecoder(&decoder);
+
+	/* Shrinking and growing again has to signal both sizes */
+	HPSetEncoderTableSize(&encoder, 0);
+	HPSetEncoderTableSize(&encoder, 65536);
+	length = HPEncode(&encoder, block, sizeof(block), header.name,
+					  strlen(header.name), header.value, strlen(header.value),
+					  HP_INDEXING_INCREMENTAL);
+
+	ret = length > 3 && block[0] == 0x20 && block[1] == 0x3F
+		&& block[2] == 0xE1 && block[3] == 0x1F
+		&& encoder.table.maxSize == HP_DEFAULT_TABLE_SIZE
+		&& HPDecode(&decoder, block, length, countHeader, &count)
+		&& count == 1 && decoder.table.size == encoder.table.size;
+
+	/* The next block doesn't carry an update anymore */
+	length = HPEncode(&encoder, block, sizeof(block), header.name,
+					  strlen(header.name), header.value, strlen(header.value),
+					  HP_INDEXING_INCREMENTAL);
+	ret = ret && length == 1 && block[0] == 0xBE;
+
+	HPDestroyEncoder(&encoder);
+	HPDestroyDecoder(&decoder);
+
+	return ret;
+}
+
+/* Random fields through both sides, which exercises eviction as well */
+bool
+TestRoundTrip(void) {
+	static struct HPEncoder encoder;
+	static struct HPDecoder decoder;
+	static const char *names[] = {
+		"accept", "cookie", "x-request-id", "user-agent", "etag", ":path"
+	};
+	char expected[OUTPUT_SIZE];
+	char value[128];
+	uint8_t block[OUTPUT_SIZE];
+	size_t expectedLength;
+	size_t valueLength;
+	size_t length;
+	size_t round;
+	size_t field;
+	size_t i;
+	const char *name;
+	bool ret = true;
+
+	srand(1);
+	HPInitEncoder(&encoder);
+	HPInitDecoder(&decoder);
+
+	for (round = 0; round < 1000 && ret; round++) {
+		length = 0;
+		expectedLength = 0;
+
+		for (field = 0; field < 8; field++) {
+			name = names[rand() % 6];
+
+			/* A small set of values, so some of them are indexed again */
+			valueLength = (size_t) (rand() % 4) * 30 + (size_t) (rand() % 3);
+			for (i = 0; i < valueLength; i++)
+				value[i] = (char) (' ' + (i * 7 + valueLength) % 90);
+
+			length += HPEncode(&encoder, block + length,
+							   sizeof(block) - length, name, strlen(name),
+							   value, valueLength,
+							   (enum HPIndexing) (rand() % 3));
+
+			expectedLength += (size_t) sprintf(expected + expectedLength,
+											   "%s: %.*s\n", name,
+											   (int) valueLength, value);
+		}
+
+		DecodedLength = 0;
+		Decoded[0] = '\0';
+		ret = HPDecode(&decoder, block, length, collectHeader, NULL)
+			&& DecodedLength == expectedLength
+			&& memcmp(Decoded, expected, expectedLength) == 0
+			&& decoder.table.size == encoder.table.size
+			&& decoder.table.count == encoder.table.count
+			&& decoder.table.size <= HP_DEFAULT_TABLE_SIZE;
+	}
+
+	HPDestroyEncoder(&encoder);
+	HPDestroyDecoder(&decoder);
+
+	return ret;
+}
+
+bool
+TestMalformed(void) {
+	static struct HPDecoder decoder;
+	static const char *blocks[] = {
+		/* Index 0 */
+		"80",
+		/* Beyond the (empty) dynamic table */
+		"be",
+		/* A size update after a field */
+		"82 20",
+		/* A size update beyond SETTINGS_HEADER_TABLE_SIZE */
+		"3fe2 1f",
+		/* A string that's longer than the block */
+		"400a 6375 7374",
+		/* A Huffman string with EOS */
+		"4084 ffff ffff 00",
+		/* A truncated integer */
+		"ff",
+	};
+	uint8_t block[64];
+	size_t length;
+	size_t count = 0;
+	size_t i;
+	bool ret = true;
+
+	for (i = 0; i < sizeof(blocks) / sizeof(blocks[0]) && ret; i++) {
+		HPInitDecoder(&decoder);
+
+		length = fromHex(blocks[i], block);
+		if (HPDecode(&decoder, block, length, countHeader, &count)) {
+			printf("\n\tblock %zu was accepted", i);
+			ret = false;
+		}
+
+		HPDestroyDecoder(&decoder);
+	}
+
+	return ret;
+}
+
+static double
+getSeconds(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * Measures headers/sec for a typical browser request and a typical response.
+ * "Cold" starts every block with an empty dynamic table, like the first
+ * request on a connection; "warm" keeps the table, like the requests after it.
+ */
+static void
+benchmark(void) {
+	static struct HPEncoder encoder;
+	static struct HPDecoder decoder;
+	static const struct Header request[] = {
+		{ ":method", "GET" }, { ":scheme", "https" },
+		{ ":authority", "www.example.com" }, { ":path", "/css/main.css" },
+		{ "sec-ch-ua", "\"Chromium\";v=\"118\", \"Not=A?Brand\";v=\"99\"" },
+		{ "sec-ch-ua-mobile", "?0" },
+		{ "user-agent", "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+						"(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36" },
+		{ "sec-ch-ua-platform", "\"Linux\"" },
+		{ "accept", "text/css,*/*;q=0.1" },
+		{ "sec-fetch-site", "same-origin" }, { "sec-fetch-mode", "no-cors" },
+		{ "sec-fetch-dest", "style" },
+		{ "referer", "https://www.example.com/" },
+		{ "accept-encoding", "gzip, deflate, br" },
+		{ "accept-language", "en-US,en;q=0.9" },
+	};
+	static const struct Header response[] = {
+		{ ":status", "200" }, { "content-type", "text/css" },
+		{ "content-length", "18342" }, { "content-encoding", "br" },
+		{ "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+		{ "cache-control", "max-age=86400" }, { "vary", "accept-encoding" },
+		{ "server", "FeatherServer" },
+	};
+	const size_t requestCount = sizeof(request) / sizeof(request[0]);
+	const size_t responseCount = sizeof(response) / sizeof(response[0]);
+	const size_t iterations = 200000;
+	uint8_t block[OUTPUT_SIZE];
+	size_t length = 0;
+	size_t count = 0;
+	size_t iteration;
+	size_t i;
+	double start;
+	int pass;
+
+	for (pass = 0; pass < 2; pass++) {
+		bool isWarm = pass == 1;
+
+		HPInitEncoder(&encoder);
+		HPInitDecoder(&decoder);
+
+		/* Decoding */
+		length = 0;
+		for (i = 0; i < requestCount; i++)
+			length += HPEncode(&encoder, block + length, sizeof(block) - length,
+							   request[i].name, strlen(request[i].name),
+							   request[i].value, strlen(request[i].value),
+							   HP_INDEXING_INCREMENTAL);
+		if (isWarm) {
+			HPDecode(&decoder, block, length, countHeader, &count);
+			length = 0;
+			for (i = 0; i < requestCount; i++)
+				length += HPEncode(&encoder, block + length,
+								   sizeof(block) - length, request[i].name,
+								   strlen(request[i].name), request[i].value,
+								   strlen(request[i].value),
+								   HP_INDEXING_INCREMENTAL);
+		}
+
+		start = getSeconds();
+		for (iteration = 0; iteration < iterations; iteration++) {
+			if (!isWarm) {
+				HPDestroyDecoder(&decoder);
+				HPInitDecoder(&decoder);
+			}
+			HPDecode(&decoder, block, length, countHeader, &count);
+		}
+		printf("decode (%s, %zu octets): %.0f headers/sec\n",
+			   isWarm ? "warm" : "cold", length,
+			   (double) (iterations * requestCount)
+			   / (getSeconds() - start));
+
+		/* Encoding */
+		start = getSeconds();
+		for (iteration = 0; iteration < iterations; iteration++) {
+			if (!isWarm) {
+				HPDestroyEncoder(&encoder);
+				HPInitEncoder(&encoder);
+			}
+
+			length = 0;
+			for (i = 0; i < responseCount; i++)
+				length += HPEncode(&encoder, block + length,
+								   sizeof(block) - length, response[i].name,
+								   strlen(response[i].name), response[i].value,
+								   strlen(response[i].value),
+								   HP_INDEXING_INCREMENTAL);
+		}
+		printf("encode (%s, %zu octets): %.0f headers/sec\n",
+			   isWarm ? "warm" : "cold", length,
+			   (double) (iterations * responseCount)
+			   / (getSeconds() - start));
+
+		HPDestroyEncoder(&encoder);
+		HPDestroyDecoder(&decoder);
+	}
+}
@@ -0,0 +1,351 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http2/scheduler.c"
+#include "http2/stream.c"
+
+#define FRAME_SIZE 1000
+#define MAX_SENT 64
+
+struct Test {
+	bool (*function)(void);
+	const char *name;
+};
+
+/* A priority field value with the outcome H2ParsePriority should have */
+struct Example {
+	const char *field;
+	bool isValid;
+	uint8_t urgency;
+	bool isIncremental;
+};
+
+static struct H2Session Session;
+static const char Body[FRAME_SIZE * 4];
+
+/* The stream of every DATA frame that was sent, in order */
+static uint32_t Sent[MAX_SENT];
+static size_t SentCount;
+
+bool TestParse(void);
+bool TestParseMalformed(void);
+bool TestParseOutOfRange(void);
+bool TestUrgency(void);
+bool TestNonIncremental(void);
+bool TestIncremental(void);
+bool TestDefaultPriority(void);
+bool TestDependency(void);
+bool TestSelfDependency(void);
+
+int main(void) {
+	size_t i;
+
+	struct Test tests[] = {
+		{ TestParse, "Parse" },
+		{ TestParseMalformed, "ParseMalformed" },
+		{ TestParseOutOfRange, "ParseOutOfRange" },
+		{ TestUrgency, "Urgency" },
+		{ TestNonIncremental, "NonIncremental" },
+		{ TestIncremental, "Incremental" },
+		{ TestDefaultPriority, "DefaultPriority" },
+		{ TestDependency, "Dependency" },
+		{ TestSelfDependency, "SelfDependency" },
+	};
+
+	OMHTTP2MaxDataFrameSize = FRAME_SIZE;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("Running test %s...", tests[i].name);
+
+		/* Every test starts with a fresh session */
+		memset(&Session, 0, sizeof(Session));
+		if (!H2InitStreams(&Session, 8)) {
+			puts("Failed to allocate the streams");
+			return EXIT_FAILURE;
+		}
+		Session.remoteSettings.initialWindowSize = H2_MAX_WINDOW_SIZE;
+		Session.remoteSettings.maxFrameSize = 16384;
+		Session.sendWindow = H2_MAX_WINDOW_SIZE;
+		SentCount = 0;
+
+		if (!tests[i].function()) {
+			printf("\rRunning test %s...failed\n", tests[i].name);
+			H2DestroyStreams(&Session);
+			return EXIT_FAILURE;
+		}
+
+		H2DestroyStreams(&Session);
+		puts("ok");
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Records the frame instead of writing it to the connection. */
+bool
+H2SendData(struct H2Session *session, uint32_t stream, const char *data,
+		   size_t size, bool isEndStream) {
+	(void) session;
+	(void) data;
+	(void) size;
+	(void) isEndStream;
+
+	if (SentCount == MAX_SENT)
+		return false;
+
+	Sent[SentCount++] = stream;
+	return true;
+}
+
+/* Opens a stream, ended by the client, with a response of the given amount
+ * of frames. */
+static struct H2Stream *
+openStream(uint32_t id, uint8_t urgency, bool isIncremental, size_t frames) {
+	struct H2Stream *stream;
+
+	stream = H2OpenStream(&Session, id, true);
+	if (stream == NULL)
+		return NULL;
+
+	stream->priority.urgency = urgency;
+	stream->priority.isIncremental = isIncremental;
+	stream->isPriorityExplicit = true;
+	stream->data = Body;
+	stream->remaining = frames * FRAME_SIZE;
+	return stream;
+}
+
+/* Sends every response, and compares the streams of the DATA frames. */
+static bool
+expectOrder(const uint32_t *expected, size_t count) {
+	size_t i;
+
+	while (H2HasStreamData(&Session))
+		if (!H2SendStreamData(&Session))
+			return false;
+
+	if (SentCount != count) {
+		printf("\n\t%zu frames were sent, instead of %zu\n", SentCount, count);
+		return false;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (Sent[i] != expected[i]) {
+			printf("\n\tFrame %zu was of stream %u, instead of %u\n", i,
+				   Sent[i], expected[i]);
+			return false;
+		}
+	}
+
+	return Session.streamCount == 0;
+}
+
+static bool
+runExamples(const struct Example *examples, size_t count) {
+	struct H2Priority priority;
+	size_t i;
+	bool isValid;
+
+	for (i = 0; i < count; i++) {
+		/* An invalid field leaves the priority as it is */
+		priority.urgency = 6;
+		priority.isIncremental = true;
+
+		isValid = H2ParsePriority(examples[i].field,
+								  strlen(examples[i].field), &priority);
+		if (isValid != examples[i].isValid
+			|| priority.urgency != (isValid ? examples[i].urgency : 6)
+			|| priority.isIncremental
+				!= (isValid ? examples[i].isIncremental : true)) {
+			printf("\n\t'%s': valid=%d u=%u i=%d\n", examples[i].field,
+				   isValid, priority.urgency, priority.isIncremental);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool
+TestParse(void) {
+	static const struct Example examples[] = {
+		{ "", true, H2_DEFAULT_URGENCY, false },
+		{ "u=5", true, 5, false },
+		{ "i", true, H2_DEFAULT_URGENCY, true },
+		{ "u=0, i", true, 0, true },
+		{ "i=?1,u=7", true, 7, true },
+		{ "u=1, i=?0", true, 1, false },
+		{ " u=2 ", true, 2, false },
+		{ "u=2;foo=bar, i;x", true, 2, true },
+		/* Unknown members are ignored, whatever their value */
+		{ "x=\"u=1\", u=4, y=(1 2 \"a\");z, w=:YQ==:", true, 4, false },
+		/* A later member of the same name overrides */
+		{ "u=2, u=5", true, 5, false },
+	};
+
+	return runExamples(examples, sizeof(examples) / sizeof(examples[0]));
+}
+
+bool
+TestParseMalformed(void) {
+	static const struct Example examples[] = {
+		{ "u=", false, 0, false },
+		{ "u=1,", false, 0, false },
+		{ "u=1 i", false, 0, false },
+		{ "U=1", false, 0, false },
+		{ "=1", false, 0, false },
+		{ "u=?2", false, 0, false },
+		{ "u=\"1", false, 0, false },
+		{ "u=(1 2", false, 0, false },
+		{ "u=1;", false, 0, false },
+		{ "u=1234567890123456", false, 0, false },
+	};
+
+	return runExamples(examples, sizeof(examples) / sizeof(examples[0]));
+}
+
+bool
+TestParseOutOfRange(void) {
+	static const struct Example examples[] = {
+		{ "u=8", true, H2_DEFAULT_URGENCY, false },
+		{ "u=-1", true, H2_DEFAULT_URGENCY, false },
+		{ "u=1.5", true, H2_DEFAULT_URGENCY, false },
+		{ "u=?1", true, H2_DEFAULT_URGENCY, false },
+		{ "u=\"1\"", true, H2_DEFAULT_URGENCY, false },
+		{ "i=1", true, H2_DEFAULT_URGENCY, false },
+		{ "i=\"?1\"", true, H2_DEFAULT_URGENCY, false },
+		/* An invalid value doesn't override a valid one */
+		{ "u=2, u=9", true, 2, false },
+	};
+
+	return runExamples(examples, sizeof(examples) / sizeof(examples[0]));
+}
+
+bool
+TestUrgency(void) {
+	static const uint32_t expected[] = { 3, 3, 1, 1, 5, 5 };
+
+	return openStream(1, 3, false, 2) != NULL
+		&& openStream(3, 1, false, 2) != NULL
+		&& openStream(5, 5, false, 2) != NULL
+		&& expectOrder(expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+bool
+TestNonIncremental(void) {
+	/* Incremental streams of the same urgency wait for non-incremental
+	 * ones, which are sent one after another. */
+	static const uint32_t expected[] = { 3, 3, 5, 5, 1, 1 };
+
+	return openStream(1, 3, true, 2) != NULL
+		&& openStream(3, 3, false, 2) != NULL
+		&& openStream(5, 3, false, 2) != NULL
+		&& expectOrder(expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+bool
+TestIncremental(void) {
+	static const uint32_t expected[] = { 1, 3, 5, 1, 3, 5, 3 };
+
+	return openStream(1, 4, true, 2) != NULL
+		&& openStream(3, 4, true, 3) != NULL
+		&& openStream(5, 4, true, 2) != NULL
+		&& expectOrder(expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+bool
+TestDefaultPriority(void) {
+	static const uint32_t expected[] = { 5, 3, 1, 7, 1, 7 };
+	struct H2Stream *stream;
+	size_t i;
+	const char *mediaTypes[] = {
+		"image/png", "application/javascript", "text/css", "image/webp"
+	};
+
+	for (i = 0; i < 4; i++) {
+		stream = H2OpenStream(&Session, i * 2 + 1, true);
+		if (stream == NULL)
+			return false;
+
+		H2SetDefaultPriority(stream, mediaTypes[i]);
+		stream->data = Body;
+		stream->remaining = (i == 0 || i == 3 ? 2 : 1) * FRAME_SIZE;
+	}
+
+	/* Stylesheets go first, then scripts, and the images take turns */
+	return expectOrder(expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+bool
+TestDependency(void) {
+	static const uint32_t expected[] = { 1, 5, 1, 3, 3, 5 };
+	struct H2Stream *stream;
+
+	/* Stream 3 waits for 1, and 5 gets a sixteenth of the share of 1 */
+	if (openStream(1, H2_DEFAULT_URGENCY, false, 2) == NULL
+		|| (stream = openStream(3, H2_DEFAULT_URGENCY, false, 2)) == NULL)
+		return false;
+	H2SetStreamDependency(&Session, stream, 1, H2_DEFAULT_WEIGHT, false);
+
+	stream = openStream(5, H2_DEFAULT_URGENCY, false, 2);
+	if (stream == NULL)
+		return false;
+	H2SetStreamDependency(&Session, stream, 0, 1, false);
+
+	return expectOrder(expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+bool
+TestSelfDependency(void) {
+	static const uint32_t expected[] = { 1, 1 };
+	struct H2Stream *stream;
+
+	/* The dependency is refused, rather than blocking the stream forever */
+	stream = openStream(1, H2_DEFAULT_URGENCY, false, 2);
+	if (stream == NULL)
+		return false;
+	H2SetStreamDependency(&Session, stream, 1, 32, false);
+	if (stream->dependency != 0 || stream->weight != H2_DEFAULT_WEIGHT)
+		return false;
+
+	/* A stream that can't be scheduled has no data to send, so the
+	 * connection waits for the client instead of spinning. */
+	stream->dependency = 1;
+	Session.isRFC7540Priority = true;
+	if (H2HasStreamData(&Session) || H2ScheduleStream(&Session) != NULL)
+		return false;
+
+	stream->dependency = 0;
+	return expectOrder(expected, sizeof(expected) / sizeof(expected[0]));
+}
@@ -0,0 +1,369 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http2/flow_control.c"
+#include "http2/scheduler.c"
+#include "http2/stream.c"
+
+#define WINDOW_SIZE 1000
+
+struct Test {
+	bool (*function)(void);
+	const char *name;
+};
+
+/* The frames that were sent, of which only the last one of a type is kept */
+struct SentFrames {
+	size_t dataSize;
+	bool isDataEndStream;
+	size_t pingCount;
+	uint32_t initialWindowSize;
+	uint32_t windowUpdateStream;
+	uint32_t windowUpdateIncrement;
+};
+
+static struct H2Session Session;
+static struct SentFrames Sent;
+static const char Body[WINDOW_SIZE * 4];
+
+bool TestRemoteEndFirst(void);
+bool TestLocalEndFirst(void);
+bool TestReset(void);
+bool TestTableFull(void);
+bool TestSendWindow(void);
+bool TestAdjustWindows(void);
+bool TestReceiveWindow(void);
+bool TestReceiveWindowExceeded(void);
+bool TestStreamWindow(void);
+bool TestWindowGrowth(void);
+bool TestWindowLimit(void);
+
+int main(void) {
+	size_t i;
+
+	struct Test tests[] = {
+		{ TestRemoteEndFirst, "RemoteEndFirst" },
+		{ TestLocalEndFirst, "LocalEndFirst" },
+		{ TestReset, "Reset" },
+		{ TestTableFull, "TableFull" },
+		{ TestSendWindow, "SendWindow" },
+		{ TestAdjustWindows, "AdjustWindows" },
+		{ TestReceiveWindow, "ReceiveWindow" },
+		{ TestReceiveWindowExceeded, "ReceiveWindowExceeded" },
+		{ TestStreamWindow, "StreamWindow" },
+		{ TestWindowGrowth, "WindowGrowth" },
+		{ TestWindowLimit, "WindowLimit" },
+	};
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("Running test %s...", tests[i].name);
+
+		/* Every test starts with a fresh session, of which the windows
+		 * don't grow unless the test allows it. */
+		memset(&Session, 0, sizeof(Session));
+		memset(&Sent, 0, sizeof(Sent));
+		if (!H2InitStreams(&Session, 2)) {
+			puts("Failed to allocate the streams");
+			return EXIT_FAILURE;
+		}
+		Session.remoteSettings.initialWindowSize = WINDOW_SIZE;
+		Session.remoteSettings.maxFrameSize = 16384;
+		Session.sendWindow = H2_MAX_WINDOW_SIZE;
+		Session.receiveWindow = WINDOW_SIZE;
+		Session.receiveWindowSize = WINDOW_SIZE;
+		OMHTTP2MaxReceiveWindow = WINDOW_SIZE;
+
+		if (!tests[i].function()) {
+			printf("\rRunning test %s...failed\n", tests[i].name);
+			H2DestroyStreams(&Session);
+			return EXIT_FAILURE;
+		}
+
+		H2DestroyStreams(&Session);
+		puts("ok");
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* The frames are recorded instead of written to the connection. */
+bool
+H2SendData(struct H2Session *session, uint32_t stream, const char *data,
+		   size_t size, bool isEndStream) {
+	(void) session;
+	(void) stream;
+	(void) data;
+
+	Sent.dataSize = size;
+	Sent.isDataEndStream = isEndStream;
+	return true;
+}
+
+bool
+H2SendPing(struct H2Session *session, const uint8_t *data, bool isAck) {
+	(void) session;
+
+	if (isAck || memcmp(data, H2_BDP_PING_DATA, 8) != 0)
+		return false;
+
+	Sent.pingCount += 1;
+	return true;
+}
+
+bool
+H2SendSettings(struct H2Session *session, struct H2Setting *settings,
+			   size_t count) {
+	(void) session;
+
+	if (count != 1 || settings[0].id != H2_SETTING_INITIAL_WINDOW_SIZE)
+		return false;
+
+	Sent.initialWindowSize = settings[0].value;
+	return true;
+}
+
+bool
+H2SendWindowUpdate(struct H2Session *session, uint32_t stream,
+				   uint32_t increment) {
+	(void) session;
+
+	Sent.windowUpdateStream = stream;
+	Sent.windowUpdateIncrement = increment;
+	return true;
+}
+
+bool
+TestRemoteEndFirst(void) {
+	struct H2Stream *stream;
+
+	stream = H2OpenStream(&Session, 1, false);
+	if (stream == NULL || stream->state != H2_STREAM_OPEN)
+		return false;
+
+	H2TransitionStream(&Session, stream, H2_STREAM_EVENT_RECEIVE_END);
+	if (Session.streamCount != 1
+		|| stream->state != H2_STREAM_HALF_CLOSED_REMOTE)
+		return false;
+
+	H2TransitionStream(&Session, stream, H2_STREAM_EVENT_SEND_END);
+	return Session.streamCount == 0 && H2FindStream(&Session, 1) == NULL;
+}
+
+bool
+TestLocalEndFirst(void) {
+	struct H2Stream *stream;
+
+	stream = H2OpenStream(&Session, 1, false);
+	if (stream == NULL)
+		return false;
+
+	H2TransitionStream(&Session, stream, H2_STREAM_EVENT_SEND_END);
+	if (Session.streamCount != 1
+		|| stream->state != H2_STREAM_HALF_CLOSED_LOCAL)
+		return false;
+
+	H2TransitionStream(&Session, stream, H2_STREAM_EVENT_RECEIVE_END);
+	return Session.streamCount == 0;
+}
+
+bool
+TestReset(void) {
+	struct H2Stream *stream;
+
+	/* A HEADERS frame with END_STREAM opens the stream half-closed */
+	if (H2OpenStream(&Session, 1, true) == NULL
+		|| (stream = H2OpenStream(&Session, 3, false)) == NULL
+		|| H2FindStream(&Session, 1)->state != H2_STREAM_HALF_CLOSED_REMOTE)
+		return false;
+
+	/* The slot of a closed stream is taken by the last one */
+	H2TransitionStream(&Session, H2FindStream(&Session, 1),
+					   H2_STREAM_EVENT_RESET);
+	stream = H2FindStream(&Session, 3);
+	if (Session.streamCount != 1 || stream != &Session.streams[0]
+		|| stream->state != H2_STREAM_OPEN)
+		return false;
+
+	H2TransitionStream(&Session, stream, H2_STREAM_EVENT_RESET);
+	return Session.streamCount == 0;
+}
+
+bool
+TestTableFull(void) {
+	return H2OpenStream(&Session, 1, true) != NULL
+		&& H2OpenStream(&Session, 3, true) != NULL
+		&& H2OpenStream(&Session, 5, true) == NULL
+		&& Session.streamCount == 2;
+}
+
+bool
+TestSendWindow(void) {
+	struct H2Stream *stream;
+
+	stream = H2OpenStream(&Session, 1, true);
+	if (stream == NULL)
+		return false;
+
+	stream->data = Body;
+	stream->remaining = WINDOW_SIZE + 200;
+
+	/* The window of the stream limits the frame */
+	if (!H2SendStreamData(&Session) || Sent.dataSize != WINDOW_SIZE
+		|| Sent.isDataEndStream || stream->sendWindow != 0
+		|| H2HasStreamData(&Session))
+		return false;
+
+	/* And so does the window of the connection */
+	stream->sendWindow = WINDOW_SIZE;
+	Session.sendWindow = 100;
+	if (!H2SendStreamData(&Session) || Sent.dataSize != 100
+		|| Sent.isDataEndStream || Session.sendWindow != 0
+		|| H2HasStreamData(&Session))
+		return false;
+
+	/* The last frame ends the stream, which closes it */
+	Session.sendWindow = WINDOW_SIZE;
+	return H2SendStreamData(&Session) && Sent.dataSize == 100
+		&& Sent.isDataEndStream && Session.streamCount == 0;
+}
+
+bool
+TestAdjustWindows(void) {
+	struct H2Stream *stream;
+
+	stream = H2OpenStream(&Session, 1, true);
+	if (stream == NULL)
+		return false;
+
+	/* A window can become negative (RFC 7540 § 6.9.2) */
+	if (!H2AdjustStreamWindows(&Session, -2 * WINDOW_SIZE)
+		|| stream->sendWindow != -WINDOW_SIZE
+		|| H2IsStreamSendable(&Session, stream))
+		return false;
+
+	return H2AdjustStreamWindows(&Session, H2_MAX_WINDOW_SIZE)
+		&& stream->sendWindow == H2_MAX_WINDOW_SIZE - WINDOW_SIZE
+		&& !H2AdjustStreamWindows(&Session, WINDOW_SIZE + 1);
+}
+
+bool
+TestReceiveWindow(void) {
+	/* The window is replenished once half of it is used */
+	if (!H2ConsumeReceiveWindow(&Session, WINDOW_SIZE / 2 - 1)
+		|| Sent.windowUpdateIncrement != 0)
+		return false;
+
+	return H2ConsumeReceiveWindow(&Session, 1)
+		&& Sent.windowUpdateStream == 0
+		&& Sent.windowUpdateIncrement == WINDOW_SIZE / 2
+		&& Session.receiveWindow == WINDOW_SIZE
+		&& Sent.pingCount == 0;
+}
+
+bool
+TestReceiveWindowExceeded(void) {
+	Session.receiveWindow = 100;
+
+	return !H2ConsumeReceiveWindow(&Session, 101)
+		&& Session.error == H2_ERROR_FLOW_CONTROL_ERROR;
+}
+
+bool
+TestStreamWindow(void) {
+	struct H2Stream *stream;
+
+	stream = H2OpenStream(&Session, 1, false);
+	if (stream == NULL || stream->receiveWindow != WINDOW_SIZE)
+		return false;
+
+	stream->receiveWindow = WINDOW_SIZE / 2 + 1;
+	if (!H2ReplenishStreamWindow(&Session, stream)
+		|| Sent.windowUpdateIncrement != 0)
+		return false;
+
+	stream->receiveWindow = WINDOW_SIZE / 2;
+	return H2ReplenishStreamWindow(&Session, stream)
+		&& Sent.windowUpdateStream == 1
+		&& Sent.windowUpdateIncrement == WINDOW_SIZE / 2
+		&& stream->receiveWindow == WINDOW_SIZE;
+}
+
+bool
+TestWindowGrowth(void) {
+	struct H2Stream *stream;
+
+	OMHTTP2MaxReceiveWindow = WINDOW_SIZE * 4;
+	stream = H2OpenStream(&Session, 1, false);
+	if (stream == NULL)
+		return false;
+
+	/* The first DATA frame starts a sample */
+	if (!H2ConsumeReceiveWindow(&Session, 400) || Sent.pingCount != 1
+		|| !Session.isBandwidthSampling
+		|| !H2ConsumeReceiveWindow(&Session, 300) || Sent.pingCount != 1)
+		return false;
+
+	/* A sample that nearly fills the window doubles it */
+	if (!H2FinishBandwidthSample(&Session,
+								 (const uint8_t *) H2_BDP_PING_DATA)
+		|| Session.isBandwidthSampling
+		|| Sent.initialWindowSize != 1400
+		|| Session.receiveWindowSize != 1400
+		|| stream->receiveWindow != WINDOW_SIZE + 400)
+		return false;
+
+	/* A small sample leaves it as it is */
+	Sent.initialWindowSize = 0;
+	return H2ConsumeReceiveWindow(&Session, 100) && Sent.pingCount == 2
+		&& H2FinishBandwidthSample(&Session,
+								   (const uint8_t *) H2_BDP_PING_DATA)
+		&& Sent.initialWindowSize == 0 && Session.receiveWindowSize == 1400;
+}
+
+bool
+TestWindowLimit(void) {
+	OMHTTP2MaxReceiveWindow = WINDOW_SIZE + 100;
+
+	/* The growth stops at the maximum, after which nothing is sampled */
+	if (!H2ConsumeReceiveWindow(&Session, WINDOW_SIZE) || Sent.pingCount != 1
+		|| !H2FinishBandwidthSample(&Session,
+									(const uint8_t *) H2_BDP_PING_DATA)
+		|| Session.receiveWindowSize != WINDOW_SIZE + 100)
+		return false;
+
+	/* PING frames of the client don't end a sample */
+	return H2ConsumeReceiveWindow(&Session, 10) && Sent.pingCount == 1
+		&& H2FinishBandwidthSample(&Session, (const uint8_t *) "12345678")
+		&& Session.receiveWindowSize == WINDOW_SIZE + 100;
+}
@@ -0,0 +1,192 @@
+/**
+ * BSD-2-Clause
+ *
+ * Copyright (c) 2020 Tristan
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS  SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND  ANY  EXPRESS  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED  WARRANTIES  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE  DISCLAIMED.  IN  NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE   FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+ * CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+ * SUBSTITUTE  GOODS  OR  SERVICES;  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING  IN  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int
+FUNC_IMPL_clock_gettime(clockid_t, struct timespec *);
+
+#define FUNC_CLOCK_GETTIME FUNC_IMPL_clock_gettime
+#include "misc/rate_limiter.c"
+
+struct Test {
+	bool (*function)(void);
+	const char *name;
+};
+
+/* The simulated monotonic clock, in milliseconds */
+static uint64_t FakeTime;
+
+bool TestBurst(void);
+bool TestIndependentClients(void);
+bool TestIPv6Prefix(void);
+bool TestRefill(void);
+bool TestDisabled(void);
+
+int main(void) {
+	size_t i;
+
+	struct Test tests[] = {
+		{ TestBurst, "Burst" },
+		{ TestIndependentClients, "IndependentClients" },
+		{ TestIPv6Prefix, "IPv6Prefix" },
+		{ TestRefill, "Refill" },
+		{ TestDisabled, "Disabled" },
+	};
+
+	FakeTime = 1000;
+	RLSetup();
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("Running test %s...", tests[i].name);
+
+		/* Every test starts with a fresh table */
+		memset(RLShards, 0, sizeof(RLShards));
+		OMRateLimitBurst = 4;
+		OMRateLimitRate = 2;
+
+		if (!tests[i].function()) {
+			printf("\rRunning test %s...failed\n", tests[i].name);
+			return EXIT_FAILURE;
+		}
+
+		puts("ok");
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int
+FUNC_IMPL_clock_gettime(clockid_t clock, struct timespec *spec) {
+	(void) clock;
+
+	spec->tv_sec = FakeTime / 1000;
+	spec->tv_nsec = (FakeTime % 1000) * 1000000;
+	return 0;
+}
+
+static struct sockaddr_in
+createIPv4(const char *text) {
+	struct sockaddr_in address;
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	inet_pton(AF_INET, text, &address.sin_addr);
+	return address;
+}
+
+static struct sockaddr_in6
+createIPv6(const char *text) {
+	struct sockaddr_in6 address;
+
+	memset(&address, 0, sizeof(address));
+	address.sin6_family = AF_INET6;
+	inet_pton(AF_INET6, text, &address.sin6_addr);
+	return address;
+}
+
+/* Returns the amount of connections admitted out of 'attempts' */
+static size_t
+admitMany(const void *address, size_t attempts) {
+	size_t admitted;
+	size_t i;
+
+	admitted = 0;
+	for (i = 0; i < attempts; i++)
+		if (RLAdmit(address))
+			admitted++;
+
+	return admitted;
+}
+
+bool TestBurst(void) {
+	struct sockaddr_in address;
+
+	address = createIPv4("192.0.2.1");
+	return admitMany(&address, 10) == 4;
+}
+
+bool TestIndependentClients(void) {
+	struct sockaddr_in a;
+	struct sockaddr_in b;
+
+	a = createIPv4("192.0.2.1");
+	b = createIPv4("192.0.2.2");
+
+	return admitMany(&a, 10) == 4 && admitMany(&b, 10) == 4;
+}
+
+bool TestIPv6Prefix(void) {
+	struct sockaddr_in6 a;
+	struct sockaddr_in6 b;
+	struct sockaddr_in6 c;
+
+	/* a and b share their /64 prefix, c doesn't */
+	a = createIPv6("2001:db8:0:1::1");
+	b = createIPv6("2001:db8:0:1::2");
+	c = createIPv6("2001:db8:0:2::1");
+
+	return admitMany(&a, 2) == 2 &&
+		   admitMany(&b, 10) == 2 &&
+		   admitMany(&c, 10) == 4;
+}
+
+bool TestRefill(void) {
+	struct sockaddr_in address;
+
+	address = createIPv4("192.0.2.1");
+	if (admitMany(&address, 10) != 4)
+		return false;
+
+	/* Half a second refills a single token at 2 connections per second */
+	FakeTime += 500;
+	if (admitMany(&address, 10) != 1)
+		return false;
+
+	/* The bucket can't be filled past the burst size */
+	FakeTime += 60000;
+	return admitMany(&address, 10) == 4;
+}
+
+bool TestDisabled(void) {
+	struct sockaddr_in address;
+
+	OMRateLimitBurst = 0;
+	address = createIPv4("192.0.2.1");
+	return admitMany(&address, 100) == 100;
+}
@@ -0,0 +1,115 @@
+#!/usr/bin/python3
+
+# BSD-2-Clause
+#
+# Copyright (c) 2020 Tristan
+# All Rights Reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+#    this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# THIS  SOFTWARE  IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND  ANY  EXPRESS  OR  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED  WARRANTIES  OF MERCHANTABILITY  AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE  DISCLAIMED.  IN  NO  EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE   FOR   ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+# CONSEQUENTIAL   DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+# SUBSTITUTE  GOODS  OR  SERVICES;  LOSS  OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY  THEORY OF LIABILITY, WHETHER IN
+# CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING  NEGLIGENCE OR OTHERWISE)
+# ARISING  IN  ANY  WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Soak test for idle keep-alive connections. It opens a number of TLS
+# connections to the server, sends a single request on each of them and
+# keeps them open without sending anything else. The resident memory of the
+# server is measured before and after, which gives the memory that an idle
+# connection costs.
+#
+# The server closes idle connections after OMKeepAliveTimeout, and sheds them
+# when it runs out of worker threads, so for large amounts of connections
+# OMKeepAliveTimeout, OMKeepAliveAdaptiveThreshold (100 disables it),
+# OMWorkerThreadCount and OMRateLimitBurst (0 disables it) should be raised
+# first, as well as the open file limit of both processes (ulimit -n).
+#
+# Usage: idle_soak.py <server pid> <connections> [host] [port] [path]
+
+import asyncio
+import ssl
+import sys
+
+def getResidentMemory(pid):
+	with open("/proc/" + str(pid) + "/status") as file:
+		for line in file:
+			if line.startswith("VmRSS:"):
+				return int(line.split()[1]) * 1024
+	raise Exception("The process has no VmRSS")
+
+async def openConnection(context, host, port, path, limit):
+	# Limit the amount of concurrent handshakes, to not trigger the shedding
+	# of handshakes.
+	async with limit:
+		reader, writer = await asyncio.open_connection(host, port, ssl=context)
+		writer.write(("HEAD " + path + " HTTP/1.1\r\nHost: " + host +
+					  "\r\n\r\n").encode())
+		await writer.drain()
+		await reader.readuntil(b"\r\n\r\n")
+	return reader, writer
+
+async def soak(pid, count, host, port, path):
+	context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+	context.check_hostname = False
+	context.verify_mode = ssl.CERT_NONE
+
+	limit = asyncio.Semaphore(64)
+	before = getResidentMemory(pid)
+
+	results = await asyncio.gather(
+		*[openConnection(context, host, port, path, limit)
+		  for i in range(count)],
+		return_exceptions=True)
+	connections = [result for result in results
+				   if not isinstance(result, BaseException)]
+	errors = [result for result in results
+			  if isinstance(result, BaseException)]
+
+	# Let the server settle, e.g. release its TLS buffers.
+	await asyncio.sleep(2)
+	after = getResidentMemory(pid)
+	alive = sum(1 for reader, writer in connections if not reader.at_eof())
+
+	print("Connections:      %i of %i opened, %i still open" %
+		  (len(connections), count, alive))
+	print("Resident memory:  %.1f MiB before, %.1f MiB after" %
+		  (before / 1048576, after / 1048576))
+	if errors:
+		print("First error:      " + repr(errors[0]))
+	if alive:
+		print("Per connection:   %.1f KiB" % ((after - before) / alive / 1024))
+
+	for reader, writer in connections:
+		writer.close()
+
+def main():
+	if len(sys.argv) < 3:
+		print("Usage: " + sys.argv[0] +
+			  " <server pid> <connections> [host] [port] [path]")
+		sys.exit(1)
+
+	pid = int(sys.argv[1])
+	count = int(sys.argv[2])
+	host = sys.argv[3] if len(sys.argv) > 3 else "127.0.0.1"
+	port = int(sys.argv[4]) if len(sys.argv) > 4 else 443
+	path = sys.argv[5] if len(sys.argv) > 5 else "/"
+
+	asyncio.run(soak(pid, count, host, port, path))
+
+if __name__ == "__main__":
+	main()
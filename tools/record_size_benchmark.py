@@ -0,0 +1,114 @@
+#!/usr/bin/python3
+
+# BSD-2-Clause
+#
+# Copyright (c) 2020 Tristan
+# All Rights Reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+#    this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# THIS  SOFTWARE  IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND  ANY  EXPRESS  OR  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED  WARRANTIES  OF MERCHANTABILITY  AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE  DISCLAIMED.  IN  NO  EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE   FOR   ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+# CONSEQUENTIAL   DAMAGES  (INCLUDING,  BUT  NOT  LIMITED  TO,  PROCUREMENT  OF
+# SUBSTITUTE  GOODS  OR  SERVICES;  LOSS  OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION)  HOWEVER  CAUSED  AND  ON  ANY  THEORY OF LIABILITY, WHETHER IN
+# CONTRACT,  STRICT  LIABILITY,  OR  TORT  (INCLUDING  NEGLIGENCE OR OTHERWISE)
+# ARISING  IN  ANY  WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Benchmarks the time to first byte and the throughput of responses, which
+# are affected by the dynamic TLS record sizing options (OMSRecord*) in
+# misc/options.c. Run it against large cached files, once for every
+# configuration that should be compared.
+#
+# The effect of small records is only visible when there is latency, e.g.
+# by emulating it on the loopback interface:
+#	tc qdisc add dev lo root netem delay 20ms
+#
+# Usage: record_size_benchmark.py <host> <path> [requests] [port]
+
+import socket
+import ssl
+import statistics
+import sys
+import time
+
+def fetch(context, host, port, path):
+	connection = socket.create_connection((host, port))
+	client = context.wrap_socket(connection, server_hostname=host)
+
+	begin = time.perf_counter()
+	client.sendall(("GET " + path + " HTTP/1.1\r\nHost: " + host +
+					"\r\nAccept-Encoding: identity\r\n\r\n").encode())
+
+	data = b""
+	while b"\r\n\r\n" not in data:
+		chunk = client.recv(65536)
+		if not chunk:
+			raise Exception("The connection was closed")
+		data += chunk
+
+	head, body = data.split(b"\r\n\r\n", 1)
+	length = None
+	for line in head.split(b"\r\n")[1:]:
+		name, value = line.split(b":", 1)
+		if name.strip().lower() == b"content-length":
+			length = int(value)
+
+	if length is None:
+		raise Exception("The response doesn't have a Content-Length")
+
+	# The first byte of the body is usually in the record of the headers.
+	firstByte = time.perf_counter() - begin
+	received = len(body)
+	while received < length:
+		chunk = client.recv(65536)
+		if not chunk:
+			raise Exception("The connection was closed")
+		received += len(chunk)
+
+	total = time.perf_counter() - begin
+	client.close()
+	return firstByte, total, length
+
+def main():
+	if len(sys.argv) < 3:
+		print("Usage: " + sys.argv[0] + " <host> <path> [requests] [port]")
+		sys.exit(1)
+
+	host = sys.argv[1]
+	path = sys.argv[2]
+	requests = int(sys.argv[3]) if len(sys.argv) > 3 else 20
+	port = int(sys.argv[4]) if len(sys.argv) > 4 else 443
+
+	context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+	context.check_hostname = False
+	context.verify_mode = ssl.CERT_NONE
+
+	firstBytes = []
+	totals = []
+	for i in range(requests):
+		firstByte, total, length = fetch(context, host, port, path)
+		firstBytes.append(firstByte)
+		totals.append(total)
+
+	total = statistics.median(totals)
+	print("Requests:         %i of %i octets" % (requests, length))
+	print("Time to headers:  %.2f ms (median)" %
+		  (statistics.median(firstBytes) * 1000))
+	print("Total time:       %.2f ms (median)" % (total * 1000))
+	print("Throughput:       %.2f MB/s" % (length / total / 1e6))
+
+if __name__ == "__main__":
+	main()